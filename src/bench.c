@@ -0,0 +1,352 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Benchmark suite: runs every combination of update kernel, grid size and pattern, and reports
+// generations per second as CSV or JSON.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include <omp.h>
+#include "life.h"
+#include "defines.h"
+#include "utils.h"
+#include "log.h"
+#include "argtable3.h"
+
+#ifndef GOL_PATTERNS_DIR
+#define GOL_PATTERNS_DIR "data/patterns"
+#endif
+
+/// Default patterns, relative to GOL_PATTERNS_DIR
+/// (p1megacell is 32770x32770, so it fits none of the default sizes and gets an auto sized grid)
+static const char *defaultPatterns[] = {"turingmachine.rle", "breeder1.txt",
+                                        "gosperglidergun.rle", "p1megacell.rle"};
+#define NUM_DEFAULT_PATTERNS (sizeof(defaultPatterns) / sizeof(defaultPatterns[0]))
+
+/// Maximum number of items in a comma separated command line list
+#define MAX_LIST_ITEMS 64
+
+/// Results of one benchmark configuration. Throughput is in generations per second.
+typedef struct {
+    const char *kernel;
+    const char *pattern;
+    uint32_t width, height;
+    int threads;
+    int trials;
+    int generations;
+    double median, mean, stdev, min, max;
+} BenchResult_t;
+
+/**
+ * Splits a comma separated list in place.
+ * @param list string to split, will be modified
+ * @param items output array of pointers into list
+ * @return number of items
+ */
+static size_t splitList(char *list, char **items) {
+    size_t count = 0;
+    for (char *tok = strtok(list, ","); tok != NULL && count < MAX_LIST_ITEMS;
+         tok = strtok(NULL, ",")) {
+        items[count++] = tok;
+    }
+    return count;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/// Computes summary statistics of the per-trial throughputs into the result
+static void computeStats(BenchResult_t *result, double *samples, int count) {
+    qsort(samples, count, sizeof(double), compareDouble);
+    result->min = samples[0];
+    result->max = samples[count - 1];
+    result->median = count % 2 == 1 ? samples[count / 2]
+                                    : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    result->mean = sum / count;
+    double sumSq = 0.0;
+    for (int i = 0; i < count; i++) {
+        sumSq += (samples[i] - result->mean) * (samples[i] - result->mean);
+    }
+    // sample standard deviation
+    result->stdev = count > 1 ? sqrt(sumSq / (count - 1)) : 0.0;
+}
+
+/// Resets the world to the initial state of the pattern, exiting if it can't be loaded
+static void loadWorld(const char *pattern, uint32_t width, uint32_t height, LifeKernel_t kernel) {
+    lifeDestroy();
+    if (!lifeInit(width, height)) {
+        exit(1);
+    }
+    lifeSetKernel(kernel);
+    if (!lifeInsertPattern(pattern, 0, 0)) {
+        exit(1);
+    }
+}
+
+/**
+ * Benchmarks one configuration. Every trial starts from the freshly loaded pattern so they all do
+ * the same work, runs the warm-up generations untimed, then times the measured generations.
+ */
+static void runBenchmark(BenchResult_t *result, LifeKernel_t kernel, const char *pattern,
+                         int warmup, double *samples) {
+    for (int trial = 0; trial < result->trials; trial++) {
+        loadWorld(pattern, result->width, result->height, kernel);
+        if (warmup > 0) {
+            lifeUpdateMulti(warmup);
+        }
+        double begin = utilsGetTime();
+        lifeUpdateMulti(result->generations);
+        double elapsed = utilsGetTime() - begin;
+        samples[trial] = result->generations / elapsed;
+    }
+    computeStats(result, samples, result->trials);
+}
+
+static void printCSVHeader(FILE *out) {
+    fprintf(out, "kernel,threads,width,height,pattern,trials,generations,median_gens_per_sec,"
+                 "mean_gens_per_sec,stdev_gens_per_sec,min_gens_per_sec,max_gens_per_sec,"
+                 "median_cells_per_sec\n");
+}
+
+static void printResult(FILE *out, const BenchResult_t *r, bool json, bool first) {
+    double cells = (double) r->width * r->height;
+    if (json) {
+        fprintf(out, "%s  {\"kernel\": \"%s\", \"threads\": %d, \"width\": %u, \"height\": %u, "
+                     "\"pattern\": \"%s\", \"trials\": %d, \"generations\": %d, "
+                     "\"median_gens_per_sec\": %.3f, \"mean_gens_per_sec\": %.3f, "
+                     "\"stdev_gens_per_sec\": %.3f, \"min_gens_per_sec\": %.3f, "
+                     "\"max_gens_per_sec\": %.3f, \"median_cells_per_sec\": %.1f}",
+                first ? "" : ",\n", r->kernel, r->threads, r->width, r->height, r->pattern,
+                r->trials, r->generations, r->median, r->mean, r->stdev, r->min, r->max,
+                r->median * cells);
+    } else {
+        fprintf(out, "%s,%d,%u,%u,%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n", r->kernel, r->threads,
+                r->width, r->height, r->pattern, r->trials, r->generations, r->median, r->mean,
+                r->stdev, r->min, r->max, r->median * cells);
+    }
+    fflush(out);
+}
+
+int main(int argc, char *argv[]) {
+    struct arg_lit *argHelp = arg_lit0(NULL, "help", "Display help and exit.");
+    struct arg_str *argKernels = arg_str0(NULL, "kernels", "a,b,...",
+            "Kernels to benchmark. Defaults to all of them.");
+    struct arg_str *argSizes = arg_str0(NULL, "sizes", "WxH,...",
+            "Grid sizes to benchmark, \"auto\" sizes the grid to fit each pattern. Patterns that "
+            "fit none of the sizes get an auto sized grid. Defaults to " BENCH_DEFAULT_SIZES ".");
+    struct arg_str *argPatterns = arg_str0(NULL, "patterns", "file,...",
+            "Pattern files to benchmark. Defaults to the bundled turingmachine, breeder1, "
+            "gosperglidergun and p1megacell patterns.");
+    struct arg_int *argWarmup = arg_int0(NULL, "warmup", "int",
+            "Untimed generations to run before each trial. Defaults to "
+            XSTR(BENCH_DEFAULT_WARMUP) ".");
+    struct arg_int *argTrials = arg_int0(NULL, "trials", "int",
+            "Trials per configuration. Defaults to " XSTR(BENCH_DEFAULT_TRIALS) ".");
+    struct arg_int *argGens = arg_int0(NULL, "generations", "int",
+            "Timed generations per trial. Defaults to " XSTR(BENCH_DEFAULT_GENERATIONS) ".");
+    struct arg_int *argThreads = arg_int0(NULL, "threads", "int",
+            "OMP threads to use. Defaults to all of them.");
+    struct arg_str *argFormat = arg_str0(NULL, "format", "csv|json",
+            "Output format. Defaults to csv.");
+    struct arg_file *argOutput = arg_file0(NULL, "output", "file",
+            "Write results to this file instead of stdout.");
+    struct arg_end *argEnd = arg_end(20);
+
+    void *argtable[] = {argHelp, argKernels, argSizes, argPatterns, argWarmup, argTrials, argGens,
+                        argThreads, argFormat, argOutput, argEnd};
+    assert(arg_nullcheck(argtable) == 0);
+
+    *argSizes->sval = BENCH_DEFAULT_SIZES;
+    *argWarmup->ival = BENCH_DEFAULT_WARMUP;
+    *argTrials->ival = BENCH_DEFAULT_TRIALS;
+    *argGens->ival = BENCH_DEFAULT_GENERATIONS;
+    *argThreads->ival = omp_get_max_threads();
+    *argFormat->sval = "csv";
+
+    int nerrors = arg_parse(argc, argv, argtable);
+    if (argHelp->count > 0) {
+        printf("Game of Life benchmark suite v" VERSION "\n");
+        printf("Usage: gol_bench");
+        arg_print_syntax(stdout, argtable, "\n");
+        arg_print_glossary(stdout, argtable, "  %-30s %s\n");
+        arg_free(argtable);
+        exit(0);
+    } else if (nerrors > 0) {
+        arg_print_errors(stderr, argEnd, "gol_bench");
+        arg_free(argtable);
+        exit(1);
+    }
+
+    int warmup = *argWarmup->ival;
+    int trials = *argTrials->ival;
+    int generations = *argGens->ival;
+    int threads = *argThreads->ival;
+    bool json = strcasecmp(*argFormat->sval, "json") == 0;
+    if (warmup < 0 || trials <= 0 || generations <= 0 || threads <= 0) {
+        log_error("Warm-up must be non-negative, and trials, generations and threads positive.");
+        exit(1);
+    } else if (!json && strcasecmp(*argFormat->sval, "csv") != 0) {
+        log_error("Unknown output format: %s", *argFormat->sval);
+        exit(1);
+    }
+    omp_set_num_threads(threads);
+
+    FILE *out = stdout;
+    if (argOutput->count > 0) {
+        out = fopen(*argOutput->filename, "w");
+        if (out == NULL) {
+            log_error("Failed to open file %s for writing: %s", *argOutput->filename,
+                      strerror(errno));
+            exit(1);
+        }
+        log_set_level(LOG_INFO);
+    } else {
+        // results go to stdout, so only log warnings and errors, and send them all to stderr
+        // (the log normally prints warnings to stdout)
+        log_set_level(LOG_WARN);
+        log_set_quiet(true);
+        log_set_fp(stderr);
+    }
+
+    // kernels
+    LifeKernel_t kernels[LIFE_KERNEL_COUNT];
+    size_t numKernels = 0;
+    if (argKernels->count > 0) {
+        char *copy = strdup(*argKernels->sval);
+        char *names[MAX_LIST_ITEMS];
+        size_t numNames = splitList(copy, names);
+        for (size_t i = 0; i < numNames && numKernels < LIFE_KERNEL_COUNT; i++) {
+            kernels[numKernels] = lifeFindKernel(names[i]);
+            if (kernels[numKernels] == LIFE_KERNEL_COUNT) {
+                log_error("Unknown kernel: %s", names[i]);
+                exit(1);
+            }
+            numKernels++;
+        }
+        free(copy);
+    } else {
+        for (LifeKernel_t kernel = 0; kernel < LIFE_KERNEL_COUNT; kernel++) {
+            kernels[numKernels++] = kernel;
+        }
+    }
+
+    // grid sizes, "auto" is stored as 0x0 and resolved per pattern
+    char *sizesCopy = strdup(*argSizes->sval);
+    char *sizeStrs[MAX_LIST_ITEMS];
+    size_t numSizes = splitList(sizesCopy, sizeStrs);
+    uint32_t widths[MAX_LIST_ITEMS], heights[MAX_LIST_ITEMS];
+    bool hasAuto = false;
+    for (size_t i = 0; i < numSizes; i++) {
+        if (strcasecmp(sizeStrs[i], "auto") == 0) {
+            widths[i] = heights[i] = 0;
+            hasAuto = true;
+        } else if (!utilsParseSize(sizeStrs[i], &widths[i], &heights[i])) {
+            exit(1);
+        }
+    }
+
+    // patterns
+    char *patterns[MAX_LIST_ITEMS];
+    size_t numPatterns = 0;
+    char *patternsCopy = NULL;
+    if (argPatterns->count > 0) {
+        patternsCopy = strdup(*argPatterns->sval);
+        numPatterns = splitList(patternsCopy, patterns);
+        for (size_t i = 0; i < numPatterns; i++) {
+            patterns[i] = strdup(patterns[i]);
+        }
+    } else {
+        for (size_t i = 0; i < NUM_DEFAULT_PATTERNS; i++) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", GOL_PATTERNS_DIR, defaultPatterns[i]);
+            patterns[numPatterns++] = strdup(path);
+        }
+    }
+
+    double *samples = calloc(trials, sizeof(double));
+    if (json) {
+        fprintf(out, "[\n");
+    } else {
+        printCSVHeader(out);
+    }
+
+    bool first = true;
+    for (size_t p = 0; p < numPatterns; p++) {
+        uint32_t patternWidth, patternHeight;
+        if (!lifeGetPatternSize(patterns[p], &patternWidth, &patternHeight)) {
+            log_error("Could not determine size of pattern %s, skipping", patterns[p]);
+            continue;
+        }
+        // the grid sizes this pattern fits, falling back to an auto sized grid if it fits none
+        uint32_t autoWidth = patternWidth + BENCH_AUTO_MARGIN;
+        uint32_t autoHeight = patternHeight + BENCH_AUTO_MARGIN;
+        uint32_t fitWidths[MAX_LIST_ITEMS + 1], fitHeights[MAX_LIST_ITEMS + 1];
+        size_t numFits = 0;
+        for (size_t s = 0; s < numSizes; s++) {
+            if (widths[s] == 0) {
+                fitWidths[numFits] = autoWidth;
+                fitHeights[numFits++] = autoHeight;
+            } else if (patternWidth > widths[s] || patternHeight > heights[s]) {
+                log_warn("Skipping %s on %ux%u grid, pattern is %ux%u", patterns[p], widths[s],
+                         heights[s], patternWidth, patternHeight);
+            } else {
+                fitWidths[numFits] = widths[s];
+                fitHeights[numFits++] = heights[s];
+            }
+        }
+        if (numFits == 0 && !hasAuto) {
+            log_warn("Benchmarking %s on an auto sized %ux%u grid instead", patterns[p], autoWidth,
+                     autoHeight);
+            fitWidths[numFits] = autoWidth;
+            fitHeights[numFits++] = autoHeight;
+        }
+
+        for (size_t s = 0; s < numFits; s++) {
+            for (size_t k = 0; k < numKernels; k++) {
+                BenchResult_t result = {
+                    .kernel = lifeGetKernelName(kernels[k]),
+                    .pattern = patterns[p],
+                    .width = fitWidths[s],
+                    .height = fitHeights[s],
+                    .threads = threads,
+                    .trials = trials,
+                    .generations = generations,
+                };
+                log_info("Benchmarking %s on %ux%u grid with %s kernel", patterns[p],
+                         fitWidths[s], fitHeights[s], result.kernel);
+                runBenchmark(&result, kernels[k], patterns[p], warmup, samples);
+                printResult(out, &result, json, first);
+                first = false;
+            }
+        }
+    }
+
+    if (json) {
+        fprintf(out, "\n]\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    lifeDestroy();
+    free(samples);
+    for (size_t i = 0; i < numPatterns; i++) {
+        free(patterns[i]);
+    }
+    free(patternsCopy);
+    free(sizesCopy);
+    arg_free(argtable);
+    return 0;
+}
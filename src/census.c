@@ -0,0 +1,1202 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Soup census: runs thousands of small random soups, each in its own torus universe, until they
+// stabilise, then classifies the objects left behind and writes a summary of how often each one
+// turned up. Universes are bit-packed (64 cells per word) and every thread runs its own, one soup
+// at a time, so the whole machine is kept busy without any of them sharing the global grid. With
+// --engine sliced, each thread instead runs SLICE_UNIVERSES soups at once in the bit-sliced engine,
+// starting a new soup in a universe as soon as the one in it has stabilised. By default the engine
+// is picked by universe size, since the sliced one only wins on small universes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <assert.h>
+#include <omp.h>
+#include "life.h"
+#include "slice.h"
+#include "defines.h"
+#include "utils.h"
+#include "log.h"
+#include "argtable3.h"
+
+/// Longest period detected, both of the population of a whole universe (to tell when it has
+/// stabilised) and of each object (to classify it)
+#define CENSUS_MAX_PERIOD 60
+/// Generations of population history kept per universe. A universe has stabilised once its whole
+/// history is periodic.
+#define CENSUS_HISTORY 256
+/// How often (in generations) to check whether a universe has stabilised
+#define CENSUS_CHECK_INTERVAL 16
+/// Live cells at most this far apart (in both x and y) are counted as part of the same object
+#define CENSUS_OBJECT_DISTANCE 2
+/// Objects bigger than this in either direction aren't classified
+#define CENSUS_MAX_OBJECT_SIZE 128
+/// Longest object code, which is enough for any object up to CENSUS_MAX_OBJECT_SIZE
+#define CENSUS_MAX_CODE 4096
+/// Groups of at most this many cells are checked for separate objects
+#define CENSUS_MAX_SPLIT_CELLS 256
+/// Code used for objects that can't be classified
+#define CENSUS_PATHOLOGICAL "PATHOLOGICAL"
+
+#define DEFAULT_CENSUS_FILE "census.txt"
+#define CENSUS_DEFAULT_SOUPS 1000
+#define CENSUS_DEFAULT_MAX_GENERATIONS 20000
+/// With --engine auto, universes of at most this many cells use the sliced engine. Sliced is about
+/// 1.7x faster at 64x64, they break even around 128x128, and packed is about 15% faster at 256x256.
+#define CENSUS_SLICED_MAX_CELLS 16384
+
+/// Extended Wechsler digits. A strip column uses the first 32, zero runs use all 36.
+static const char wechslerDigits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+/// A cell in a universe. Coordinates of cells in objects are unwrapped, so may be off the universe.
+typedef struct {
+    int32_t x, y;
+} CensusPoint_t;
+
+/// A torus universe, bit-packed with cell x of a row in bit x % 64 of word x / 64
+typedef struct {
+    uint32_t width, height;
+    /// Words per row
+    uint32_t words;
+    uint64_t *cells, *next;
+    /// Bits 0 and 1 of the sum of each cell and its left and right neighbours
+    uint64_t *ones, *twos;
+    /// True for rows with any live cells, so empty space can be skipped
+    bool *rowLive;
+} CensusUniverse_t;
+
+/// Number of times an object turned up
+typedef struct {
+    char *code;
+    uint64_t count;
+} CensusEntry_t;
+
+/// Hash table of object counts, keyed by object code
+typedef struct {
+    CensusEntry_t *entries;
+    size_t count, capacity;
+} CensusTable_t;
+
+/// A well known object, so the summary can name it
+typedef struct {
+    const char *code;
+    const char *name;
+} CensusName_t;
+
+static const CensusName_t names[] = {
+    {"xs4_33", "block"},
+    {"xp2_7", "blinker"},
+    {"xs6_696", "beehive"},
+    {"xq4_153", "glider"},
+    {"xs7_2596", "loaf"},
+    {"xs5_253", "boat"},
+    {"xs8_6996", "pond"},
+    {"xs6_356", "ship"},
+    {"xs4_252", "tub"},
+    {"xp2_7e", "toad"},
+    {"xp2_318c", "beacon"},
+    {"xs7_25ac", "long boat"},
+    {"xs6_25a4", "barge"},
+    {"xs6_bd", "snake"},
+    {"xs7_178c", "eater 1"},
+    {"xs8_69ic", "mango"},
+    {"xs12_g8o653z11", "ship-tie"},
+    {"xs14_g88m952z121", "half-bakery"},
+    {"xs14_69bqic", "paperclip"},
+    {"xp3_co9nas0san9oczgoldlo0oldlogz1047210127401", "pulsar"},
+    {"xq4_6frc", "lightweight spaceship"},
+    {"xq4_27dee6", "middleweight spaceship"},
+};
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+/// An object with a known code, for --self-test
+typedef struct {
+    /// Rows of the object, '.' for dead and 'O' for alive, separated by '$'
+    const char *cells;
+    const char *code;
+} CensusCheck_t;
+
+/// Objects checked by --self-test, including ones that never settle down, which must come out as
+/// pathological rather than running off the end of the phases
+static const CensusCheck_t checks[] = {
+    {"OO$OO", "xs4_33"},
+    {"OOO", "xp2_7"},
+    {".O$..O$OOO", "xq4_153"},
+    {".O..O$O....$O...O$OOOO.", "xq4_6frc"},
+    {"..O....O$OO.OOOO.OO$..O....O", "xp15_4r4z4r4"},
+    {"..OOO...OOO..$.............$O....O.O....O$O....O.O....O$O....O.O....O$..OOO...OOO..$"
+     ".............$..OOO...OOO..$O....O.O....O$O....O.O....O$O....O.O....O$.............$"
+     "..OOO...OOO..", "xp3_co9nas0san9oczgoldlo0oldlogz1047210127401"},
+    // R-pentomino, which runs for over 1000 generations
+    {".OO$OO.$.O", CENSUS_PATHOLOGICAL},
+    // Gosper glider gun, which keeps growing as it fires gliders
+    {"........................O...........$......................O.O...........$"
+     "............OO......OO............OO$...........O...O....OO............OO$"
+     "OO........O.....O...OO..............$OO........O...O.OO....O.O...........$"
+     "..........O.....O.......O...........$...........O...O....................$"
+     "............OO......................", CENSUS_PATHOLOGICAL},
+};
+#define NUM_CHECKS (sizeof(checks) / sizeof(checks[0]))
+
+/// How soups are run
+typedef enum {
+    /// One soup at a time per thread, in a bit-packed universe
+    CENSUS_ENGINE_PACKED = 0,
+    /// SLICE_UNIVERSES soups at a time per thread, in the bit-sliced engine
+    CENSUS_ENGINE_SLICED,
+    /// Sliced for universes of at most CENSUS_SLICED_MAX_CELLS cells, packed for bigger ones
+    CENSUS_ENGINE_AUTO,
+    CENSUS_ENGINE_COUNT,
+} CensusEngine_t;
+
+static const char *const engineNames[CENSUS_ENGINE_COUNT] = {
+    [CENSUS_ENGINE_PACKED] = "packed",
+    [CENSUS_ENGINE_SLICED] = "sliced",
+    [CENSUS_ENGINE_AUTO] = "auto",
+};
+
+/// A universe of the bit-sliced engine, and the soup running in it
+typedef struct {
+    /// Soup index, or -1 if there are no soups left to run in this universe
+    int64_t soup;
+    /// Generations the soup has run for
+    uint64_t gen;
+    uint32_t history[CENSUS_HISTORY];
+} CensusLane_t;
+
+/// Everything one thread needs to run soups
+typedef struct {
+    CensusUniverse_t universe;
+    /// Union of the universe's states over one period, used to group cells into objects
+    uint64_t *mask;
+    bool *soup;
+    uint32_t history[CENSUS_HISTORY];
+    /// Cells waiting to be visited while finding an object, and the object's live cells
+    CensusPoint_t *stack, *object;
+    size_t stackCapacity, objectCapacity;
+    CensusTable_t objects;
+    uint64_t stabilised, generations;
+    /// Bit-sliced engine, its universes, and one universe unpacked, for --engine sliced
+    SliceWorld_t slice;
+    CensusLane_t lanes[SLICE_UNIVERSES];
+    bool *cells;
+} CensusWorker_t;
+
+/// Settings shared by every soup
+typedef struct {
+    uint32_t universeWidth, universeHeight;
+    uint32_t soupWidth, soupHeight;
+    double density;
+    uint64_t seed;
+    uint32_t maxGenerations;
+    CensusEngine_t engine;
+} CensusConfig_t;
+
+/// FNV-1a hash of an object code
+static uint64_t hashCode(const char *code) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (; *code != '\0'; code++) {
+        hash = (hash ^ (uint8_t) *code) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/// Adds to the count of an object, copying its code if it's new
+static void tableAdd(CensusTable_t *table, const char *code, uint64_t count) {
+    if (2 * (table->count + 1) > table->capacity) {
+        // keep the table at most half full, so probe sequences stay short
+        CensusTable_t grown = {
+            .capacity = MAX(table->capacity * 2, 256),
+        };
+        grown.entries = calloc(grown.capacity, sizeof(CensusEntry_t));
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->entries[i].code != NULL) {
+                size_t slot = hashCode(table->entries[i].code) & (grown.capacity - 1);
+                while (grown.entries[slot].code != NULL) {
+                    slot = (slot + 1) & (grown.capacity - 1);
+                }
+                grown.entries[slot] = table->entries[i];
+            }
+        }
+        grown.count = table->count;
+        free(table->entries);
+        *table = grown;
+    }
+    size_t slot = hashCode(code) & (table->capacity - 1);
+    while (table->entries[slot].code != NULL && strcmp(table->entries[slot].code, code) != 0) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    if (table->entries[slot].code == NULL) {
+        table->entries[slot].code = strdup(code);
+        table->count++;
+    }
+    table->entries[slot].count += count;
+}
+
+static void tableFree(CensusTable_t *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        free(table->entries[i].code);
+    }
+    free(table->entries);
+    *table = (CensusTable_t) {0};
+}
+
+/// Sorts by count, most common first, then by code
+static int compareEntries(const void *a, const void *b) {
+    const CensusEntry_t *x = a, *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return strcmp(x->code, y->code);
+}
+
+static const char *findName(const char *code) {
+    for (size_t i = 0; i < NUM_NAMES; i++) {
+        if (strcmp(names[i].code, code) == 0) {
+            return names[i].name;
+        }
+    }
+    return "";
+}
+
+static inline bool getBit(const uint64_t *words, uint32_t wordsPerRow, uint32_t x, uint32_t y) {
+    return (words[(size_t) wordsPerRow * y + x / 64] >> (x % 64)) & 1;
+}
+
+static inline void clearBit(uint64_t *words, uint32_t wordsPerRow, uint32_t x, uint32_t y) {
+    words[(size_t) wordsPerRow * y + x / 64] &= ~(1ULL << (x % 64));
+}
+
+/**
+ * Advances a universe by one generation. Each row's horizontal sums (each cell plus its left and
+ * right neighbours, as 2 bit numbers) are worked out once, then the sums of the rows above, the row
+ * itself and the row below are added with bitwise full adders, 64 cells at a time. Including the
+ * cell itself in the total means B3/S23 becomes "total is 3, or total is 4 and the cell is alive".
+ * @return the population of the new generation
+ */
+static uint32_t stepUniverse(CensusUniverse_t *u) {
+    uint32_t n = u->words, h = u->height;
+    for (uint32_t y = 0; y < h; y++) {
+        const uint64_t *row = &u->cells[(size_t) n * y];
+        uint64_t any = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            any |= row[i];
+        }
+        u->rowLive[y] = any != 0;
+        if (!u->rowLive[y]) {
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t c = row[i];
+            uint64_t left = (c << 1) | (row[(i + n - 1) % n] >> 63);
+            uint64_t right = (c >> 1) | (row[(i + 1) % n] << 63);
+            u->ones[(size_t) n * y + i] = left ^ c ^ right;
+            u->twos[(size_t) n * y + i] = (left & c) | (right & (left ^ c));
+        }
+    }
+
+    uint32_t population = 0;
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t up = y == 0 ? h - 1 : y - 1, down = y == h - 1 ? 0 : y + 1;
+        uint64_t *next = &u->next[(size_t) n * y];
+        // optimisation: soups start out tiny, so most of the universe is empty space
+        if (!u->rowLive[up] && !u->rowLive[y] && !u->rowLive[down]) {
+            memset(next, 0, n * sizeof(uint64_t));
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t a0 = u->rowLive[up] ? u->ones[(size_t) n * up + i] : 0;
+            uint64_t a1 = u->rowLive[up] ? u->twos[(size_t) n * up + i] : 0;
+            uint64_t b0 = u->rowLive[y] ? u->ones[(size_t) n * y + i] : 0;
+            uint64_t b1 = u->rowLive[y] ? u->twos[(size_t) n * y + i] : 0;
+            uint64_t c0 = u->rowLive[down] ? u->ones[(size_t) n * down + i] : 0;
+            uint64_t c1 = u->rowLive[down] ? u->twos[(size_t) n * down + i] : 0;
+            // total = s0 + 2 * w2 + 4 * w4 + 8 * w8
+            uint64_t s0 = a0 ^ b0 ^ c0;
+            uint64_t carry = (a0 & b0) | (c0 & (a0 ^ b0));
+            uint64_t u0 = a1 ^ b1 ^ c1;
+            uint64_t u1 = (a1 & b1) | (c1 & (a1 ^ b1));
+            uint64_t w2 = u0 ^ carry, k = u0 & carry;
+            uint64_t w4 = u1 ^ k, w8 = u1 & k;
+            uint64_t alive = u->cells[(size_t) n * y + i];
+            next[i] = ~w8 & ((s0 & w2 & ~w4) | (alive & ~s0 & ~w2 & w4));
+            population += __builtin_popcountll(next[i]);
+        }
+    }
+    uint64_t *tmp = u->cells;
+    u->cells = u->next;
+    u->next = tmp;
+    return population;
+}
+
+/**
+ * Checks whether the population history (a ring buffer ending at generation gen) is periodic.
+ * @return the period, or 0 if it isn't periodic with any period up to CENSUS_MAX_PERIOD
+ */
+static uint32_t findPeriod(const uint32_t *history, uint64_t gen) {
+    for (uint32_t p = 1; p <= CENSUS_MAX_PERIOD; p++) {
+        bool periodic = true;
+        for (uint64_t i = 0; i + p < CENSUS_HISTORY && periodic; i++) {
+            periodic = history[(gen - i) % CENSUS_HISTORY]
+                       == history[(gen - i - p) % CENSUS_HISTORY];
+        }
+        if (periodic) {
+            return p;
+        }
+    }
+    return 0;
+}
+
+/// Writes a run of zero columns in extended Wechsler format ("w" is 00, "x" 000, "y0" to "yz"
+/// are 4 to 39)
+static size_t writeZeros(char *out, size_t length, uint32_t zeros) {
+    while (zeros > 0) {
+        if (zeros >= 4) {
+            uint32_t run = MIN(zeros, 39);
+            out[length++] = 'y';
+            out[length++] = wechslerDigits[run - 4];
+            zeros -= run;
+        } else {
+            out[length++] = zeros == 3 ? 'x' : zeros == 2 ? 'w' : '0';
+            zeros = 0;
+        }
+    }
+    return length;
+}
+
+/**
+ * Encodes an object in extended Wechsler format, as used by apgcodes: strips of 5 rows, each
+ * column of a strip a digit (top row least significant), with trailing zeros left out, zero runs
+ * shortened and "z" between strips.
+ * @param cells object cells, w by h, row-major
+ * @param transform orientation: bit 0 swaps x and y, bit 1 flips x, bit 2 flips y
+ * @param out where to write the code, null terminated
+ */
+static void encodeWechsler(const uint8_t *cells, uint32_t w, uint32_t h, int transform,
+                           char *out) {
+    bool swap = transform & 1;
+    uint32_t tw = swap ? h : w, th = swap ? w : h;
+    size_t length = 0;
+    for (uint32_t strip = 0; strip * 5 < th; strip++) {
+        if (strip > 0) {
+            out[length++] = 'z';
+        }
+        uint32_t zeros = 0;
+        for (uint32_t tx = 0; tx < tw; tx++) {
+            uint32_t value = 0;
+            for (uint32_t bit = 0; bit < 5 && strip * 5 + bit < th; bit++) {
+                uint32_t ty = strip * 5 + bit;
+                uint32_t sx = swap ? ty : tx, sy = swap ? tx : ty;
+                sx = transform & 2 ? w - 1 - sx : sx;
+                sy = transform & 4 ? h - 1 - sy : sy;
+                value |= (uint32_t) cells[(size_t) w * sy + sx] << bit;
+            }
+            if (value == 0) {
+                zeros++;
+                continue;
+            }
+            length = writeZeros(out, length, zeros);
+            zeros = 0;
+            out[length++] = wechslerDigits[value];
+        }
+    }
+    out[length] = '\0';
+}
+
+/// Bounding box of some live cells, inclusive
+typedef struct {
+    uint32_t minX, minY, maxX, maxY;
+} CensusBox_t;
+
+/// Box that contains nothing, and grows to fit the first cell added
+static const CensusBox_t emptyBox = {UINT32_MAX, UINT32_MAX, 0, 0};
+
+/// A small bounded universe, one byte per cell, for running an object on its own. Only the
+/// bounding box of the live cells (plus a cell all round) is updated each generation.
+typedef struct {
+    uint8_t *cells, *next;
+    uint32_t width, height;
+    /// Bounding boxes of the live cells in cells and in next
+    CensusBox_t box, nextBox;
+    uint32_t population;
+    /// True once the object has reached the edge, so it can't be run any further
+    bool overflow;
+} CensusDense_t;
+
+/// A phase of an object, cropped to its bounding box
+typedef struct {
+    uint8_t *cells;
+    uint32_t width, height;
+    uint32_t minX, minY;
+    uint32_t population;
+} CensusPhase_t;
+
+static inline void growBox(CensusBox_t *box, uint32_t x, uint32_t y) {
+    box->minX = MIN(box->minX, x);
+    box->minY = MIN(box->minY, y);
+    box->maxX = MAX(box->maxX, x);
+    box->maxY = MAX(box->maxY, y);
+}
+
+/**
+ * Sets up a dense universe holding some cells, with room round them for them to move a cell per
+ * generation for CENSUS_MAX_PERIOD generations.
+ * @param origin unwrapped coordinates of the top left of the cells' bounding box
+ * @param size size of the cells' bounding box
+ */
+static void denseInit(CensusDense_t *d, const CensusPoint_t *cells, size_t count,
+                      CensusPoint_t origin, CensusPoint_t size) {
+    uint32_t margin = CENSUS_MAX_PERIOD + 2;
+    *d = (CensusDense_t) {
+        .width = (uint32_t) size.x + 2 * margin,
+        .height = (uint32_t) size.y + 2 * margin,
+        .box = emptyBox,
+        .nextBox = emptyBox,
+    };
+    d->cells = calloc((size_t) d->width * d->height, 1);
+    d->next = calloc((size_t) d->width * d->height, 1);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t x = (uint32_t) (cells[i].x - origin.x) + margin;
+        uint32_t y = (uint32_t) (cells[i].y - origin.y) + margin;
+        if (!d->cells[(size_t) d->width * y + x]) {
+            d->cells[(size_t) d->width * y + x] = 1;
+            growBox(&d->box, x, y);
+            d->population++;
+        }
+    }
+}
+
+static void denseFree(CensusDense_t *d) {
+    free(d->cells);
+    free(d->next);
+}
+
+/// Advances a dense universe by one generation
+static void denseStep(CensusDense_t *d) {
+    if (d->population == 0 || d->overflow) {
+        return;
+    } else if (d->box.minX < 2 || d->box.minY < 2 || d->box.maxX + 2 >= d->width
+               || d->box.maxY + 2 >= d->height) {
+        d->overflow = true;
+        return;
+    }
+    // next still holds the generation before last, so clear that out first
+    for (uint32_t y = d->nextBox.minY; y <= d->nextBox.maxY && d->nextBox.minX != UINT32_MAX;
+         y++) {
+        memset(&d->next[(size_t) d->width * y + d->nextBox.minX], 0,
+               d->nextBox.maxX - d->nextBox.minX + 1);
+    }
+    CensusBox_t box = emptyBox;
+    uint32_t population = 0;
+    for (uint32_t y = d->box.minY - 1; y <= d->box.maxY + 1; y++) {
+        for (uint32_t x = d->box.minX - 1; x <= d->box.maxX + 1; x++) {
+            const uint8_t *above = &d->cells[(size_t) d->width * (y - 1) + x];
+            const uint8_t *row = &d->cells[(size_t) d->width * y + x];
+            const uint8_t *below = &d->cells[(size_t) d->width * (y + 1) + x];
+            uint32_t neighbours = above[-1] + above[0] + above[1] + row[-1] + row[1] + below[-1]
+                                  + below[0] + below[1];
+            bool alive = neighbours == 3 || (neighbours == 2 && row[0]);
+            if (alive) {
+                d->next[(size_t) d->width * y + x] = 1;
+                growBox(&box, x, y);
+                population++;
+            }
+        }
+    }
+    uint8_t *tmp = d->cells;
+    d->cells = d->next;
+    d->next = tmp;
+    d->nextBox = d->box;
+    d->box = box;
+    d->population = population;
+}
+
+static inline bool denseGet(const CensusDense_t *d, uint32_t x, uint32_t y) {
+    return d->cells[(size_t) d->width * y + x];
+}
+
+/// Copies the live cells of a dense universe, cropped to their bounding box
+static void cropPhase(const CensusDense_t *d, CensusPhase_t *phase) {
+    *phase = (CensusPhase_t) {
+        .width = d->box.maxX - d->box.minX + 1,
+        .height = d->box.maxY - d->box.minY + 1,
+        .minX = d->box.minX,
+        .minY = d->box.minY,
+        .population = d->population,
+    };
+    phase->cells = malloc((size_t) phase->width * phase->height);
+    for (uint32_t y = 0; y < phase->height; y++) {
+        memcpy(&phase->cells[(size_t) phase->width * y],
+               &d->cells[(size_t) d->width * (d->box.minY + y) + d->box.minX], phase->width);
+    }
+}
+
+/// Works out the bounding box of some cells, returning its top left corner and size
+static void boundPoints(const CensusPoint_t *cells, size_t count, CensusPoint_t *origin,
+                        CensusPoint_t *size) {
+    int32_t minX = INT32_MAX, minY = INT32_MAX, maxX = INT32_MIN, maxY = INT32_MIN;
+    for (size_t i = 0; i < count; i++) {
+        minX = MIN(minX, cells[i].x);
+        minY = MIN(minY, cells[i].y);
+        maxX = MAX(maxX, cells[i].x);
+        maxY = MAX(maxY, cells[i].y);
+    }
+    *origin = (CensusPoint_t) {minX, minY};
+    *size = (CensusPoint_t) {maxX - minX + 1, maxY - minY + 1};
+}
+
+/**
+ * Classifies an object by running it on its own until it comes back to its starting state, which
+ * gives its period and how far it moved. The code is "xs" and the population for still lifes,
+ * "xp" and the period for oscillators and "xq" and the period for spaceships, then "_" and the
+ * object in extended Wechsler format, canonicalised over every phase and orientation by taking the
+ * shortest encoding, then the first alphabetically. These are the same apgcodes Catagolue uses.
+ * @param cells the object's live cells
+ * @param count number of live cells
+ * @param code where to store the code, at least CENSUS_MAX_CODE long
+ */
+static void classifyObject(const CensusPoint_t *cells, size_t count, char *code) {
+    CensusPoint_t origin, size;
+    boundPoints(cells, count, &origin, &size);
+    if (size.x > CENSUS_MAX_OBJECT_SIZE || size.y > CENSUS_MAX_OBJECT_SIZE) {
+        snprintf(code, CENSUS_MAX_CODE, CENSUS_PATHOLOGICAL);
+        return;
+    }
+    CensusDense_t d;
+    denseInit(&d, cells, count, origin, size);
+    CensusPhase_t phases[CENSUS_MAX_PERIOD] = {0};
+    cropPhase(&d, &phases[0]);
+    uint32_t period = 0;
+    for (uint32_t gen = 1; gen <= CENSUS_MAX_PERIOD && period == 0; gen++) {
+        denseStep(&d);
+        if (d.population == 0 || d.overflow) {
+            // died out or grew too much, so it wasn't an object on its own
+            break;
+        }
+        CensusPhase_t phase;
+        cropPhase(&d, &phase);
+        if (phase.population == phases[0].population && phase.width == phases[0].width
+                && phase.height == phases[0].height
+                && memcmp(phase.cells, phases[0].cells, (size_t) phase.width * phase.height) == 0) {
+            period = gen;
+            if (phase.minX != phases[0].minX || phase.minY != phases[0].minY) {
+                snprintf(code, CENSUS_MAX_CODE, "xq%u_", period);
+            } else if (period == 1) {
+                snprintf(code, CENSUS_MAX_CODE, "xs%u_", phase.population);
+            } else {
+                snprintf(code, CENSUS_MAX_CODE, "xp%u_", period);
+            }
+            free(phase.cells);
+        } else if (gen < CENSUS_MAX_PERIOD) {
+            phases[gen] = phase;
+        } else {
+            // last generation checked, so it isn't needed as a phase
+            free(phase.cells);
+        }
+    }
+
+    if (period == 0) {
+        snprintf(code, CENSUS_MAX_CODE, CENSUS_PATHOLOGICAL);
+    } else {
+        char best[CENSUS_MAX_CODE], candidate[CENSUS_MAX_CODE];
+        best[0] = '\0';
+        for (uint32_t p = 0; p < period; p++) {
+            for (int transform = 0; transform < 8; transform++) {
+                encodeWechsler(phases[p].cells, phases[p].width, phases[p].height, transform,
+                               candidate);
+                size_t length = strlen(candidate), bestLength = strlen(best);
+                if (bestLength == 0 || length < bestLength
+                        || (length == bestLength && strcmp(candidate, best) < 0)) {
+                    strcpy(best, candidate);
+                }
+            }
+        }
+        strncat(code, best, CENSUS_MAX_CODE - strlen(code) - 1);
+    }
+    for (uint32_t p = 0; p < CENSUS_MAX_PERIOD; p++) {
+        free(phases[p].cells);
+    }
+    denseFree(&d);
+}
+
+/**
+ * Checks whether two groups of cells are separate objects, i.e. running them together gives the
+ * same result as running each on its own, for CENSUS_MAX_PERIOD generations.
+ */
+static bool isSeparable(const CensusPoint_t *cells, size_t count, size_t split) {
+    CensusPoint_t origin, size;
+    boundPoints(cells, count, &origin, &size);
+    if (size.x > CENSUS_MAX_OBJECT_SIZE || size.y > CENSUS_MAX_OBJECT_SIZE) {
+        return false;
+    }
+    CensusDense_t joint, a, b;
+    denseInit(&joint, cells, count, origin, size);
+    denseInit(&a, cells, split, origin, size);
+    denseInit(&b, &cells[split], count - split, origin, size);
+    bool separable = true;
+    for (uint32_t gen = 0; gen < CENSUS_MAX_PERIOD && separable; gen++) {
+        denseStep(&joint);
+        denseStep(&a);
+        denseStep(&b);
+        if (joint.overflow || a.overflow || b.overflow) {
+            separable = false;
+            break;
+        }
+        // compare everywhere any of them has live cells
+        CensusBox_t box = joint.box;
+        if (a.population > 0) {
+            growBox(&box, a.box.minX, a.box.minY);
+            growBox(&box, a.box.maxX, a.box.maxY);
+        }
+        if (b.population > 0) {
+            growBox(&box, b.box.minX, b.box.minY);
+            growBox(&box, b.box.maxX, b.box.maxY);
+        }
+        for (uint32_t y = box.minY; y <= box.maxY && box.minX != UINT32_MAX && separable; y++) {
+            for (uint32_t x = box.minX; x <= box.maxX; x++) {
+                if (denseGet(&joint, x, y) != (denseGet(&a, x, y) || denseGet(&b, x, y))) {
+                    separable = false;
+                    break;
+                }
+            }
+        }
+    }
+    denseFree(&joint);
+    denseFree(&a);
+    denseFree(&b);
+    return separable;
+}
+
+/**
+ * Labels the 8-connected components of some cells, and sorts the cells by component.
+ * @param starts where to store the index of the first cell of each component, plus one past the
+ * end, so at least count + 1 long
+ * @return number of components
+ */
+static size_t splitComponents(CensusPoint_t *cells, size_t count, size_t *starts) {
+    // components are found by growing each one out from its first cell, moving the cells found
+    // to the front of what's left, so they end up sorted by component
+    size_t components = 0;
+    for (size_t begin = 0; begin < count;) {
+        starts[components++] = begin;
+        size_t end = begin + 1;
+        for (size_t i = begin; i < end; i++) {
+            for (size_t j = end; j < count; j++) {
+                if (abs(cells[j].x - cells[i].x) <= 1 && abs(cells[j].y - cells[i].y) <= 1) {
+                    CensusPoint_t tmp = cells[end];
+                    cells[end++] = cells[j];
+                    cells[j] = tmp;
+                }
+            }
+        }
+        begin = end;
+    }
+    starts[components] = count;
+    return components;
+}
+
+/**
+ * Counts the objects in a group of cells that were close enough to be found together. Each
+ * connected piece that's separable from the rest (e.g. one of two blinkers next to each other) is
+ * counted on its own, and whatever's left (e.g. the two halves of a beacon) as one object.
+ */
+static void countObjects(CensusWorker_t *worker, CensusPoint_t *cells, size_t count) {
+    char code[CENSUS_MAX_CODE];
+    if (count <= CENSUS_MAX_SPLIT_CELLS) {
+        size_t starts[CENSUS_MAX_SPLIT_CELLS + 1];
+        size_t components = splitComponents(cells, count, starts);
+        // try each component in turn, last first so the ones left stay at the front
+        for (size_t c = components; c-- > 0 && components > 1;) {
+            size_t begin = starts[c], end = starts[c + 1];
+            size_t length = end - begin;
+            // rotate the component to the end of the cells that are left
+            CensusPoint_t *moved = malloc(length * sizeof(CensusPoint_t));
+            memcpy(moved, &cells[begin], length * sizeof(CensusPoint_t));
+            memmove(&cells[begin], &cells[end], (count - end) * sizeof(CensusPoint_t));
+            memcpy(&cells[count - length], moved, length * sizeof(CensusPoint_t));
+            free(moved);
+            if (isSeparable(cells, count, count - length)) {
+                classifyObject(&cells[count - length], length, code);
+                tableAdd(&worker->objects, code, 1);
+                count -= length;
+                components--;
+            }
+            for (size_t i = c + 1; i <= components; i++) {
+                starts[i] -= length;
+            }
+        }
+    }
+    classifyObject(cells, count, code);
+    tableAdd(&worker->objects, code, 1);
+}
+
+/// Appends a point to a growable array
+static void pushPoint(CensusPoint_t **points, size_t *count, size_t *capacity,
+                      CensusPoint_t point) {
+    if (*count == *capacity) {
+        *capacity = MAX(*capacity * 2, 256);
+        *points = realloc(*points, *capacity * sizeof(CensusPoint_t));
+    }
+    (*points)[(*count)++] = point;
+}
+
+/**
+ * Splits a stabilised universe into objects and counts them. Cells are grouped using the union of
+ * the universe's states over a period, so that every phase of an oscillator and every position of
+ * a spaceship ends up in one group, and cells at most CENSUS_OBJECT_DISTANCE apart are grouped
+ * together, then split up again by countObjects() where they turn out not to interact.
+ */
+static void censusObjects(CensusWorker_t *worker) {
+    CensusUniverse_t *u = &worker->universe;
+    uint32_t n = u->words;
+    for (uint32_t y = 0; y < u->height; y++) {
+        for (uint32_t x = 0; x < u->width; x++) {
+            if (!getBit(worker->mask, n, x, y)) {
+                continue;
+            }
+            // flood fill from this cell, keeping track of unwrapped coordinates so that objects
+            // that straddle the edges of the torus come out in one piece
+            size_t stackSize = 0, objectSize = 0;
+            clearBit(worker->mask, n, x, y);
+            pushPoint(&worker->stack, &stackSize, &worker->stackCapacity,
+                      (CensusPoint_t) {(int32_t) x, (int32_t) y});
+            while (stackSize > 0) {
+                CensusPoint_t p = worker->stack[--stackSize];
+                uint32_t wx = (uint32_t) (((int64_t) p.x % u->width + u->width) % u->width);
+                uint32_t wy = (uint32_t) (((int64_t) p.y % u->height + u->height) % u->height);
+                if (getBit(u->cells, n, wx, wy)) {
+                    pushPoint(&worker->object, &objectSize, &worker->objectCapacity, p);
+                }
+                for (int32_t dy = -CENSUS_OBJECT_DISTANCE; dy <= CENSUS_OBJECT_DISTANCE; dy++) {
+                    for (int32_t dx = -CENSUS_OBJECT_DISTANCE; dx <= CENSUS_OBJECT_DISTANCE; dx++) {
+                        uint32_t nx = (wx + u->width + dx) % u->width;
+                        uint32_t ny = (wy + u->height + dy) % u->height;
+                        if (getBit(worker->mask, n, nx, ny)) {
+                            clearBit(worker->mask, n, nx, ny);
+                            pushPoint(&worker->stack, &stackSize, &worker->stackCapacity,
+                                      (CensusPoint_t) {p.x + dx, p.y + dy});
+                        }
+                    }
+                }
+            }
+            if (objectSize > 0) {
+                countObjects(worker, worker->object, objectSize);
+            }
+        }
+    }
+}
+
+/**
+ * Counts the objects in a universe that has stabilised with the given period, or counts it as
+ * unstabilised if the period is 0.
+ */
+static void countUniverse(CensusWorker_t *worker, uint32_t period) {
+    CensusUniverse_t *u = &worker->universe;
+    size_t words = (size_t) u->words * u->height;
+    if (period == 0) {
+        tableAdd(&worker->objects, "zz_UNSTABILISED", 1);
+        return;
+    }
+    worker->stabilised++;
+
+    // collect the union of one period's states, which leaves the universe back in the same phase
+    memset(worker->mask, 0, words * sizeof(uint64_t));
+    for (uint32_t i = 0; i < period; i++) {
+        stepUniverse(u);
+        for (size_t w = 0; w < words; w++) {
+            worker->mask[w] |= u->cells[w];
+        }
+    }
+    censusObjects(worker);
+}
+
+/// Runs one soup until it stabilises (or runs out of generations), then counts its objects
+static void runSoup(CensusWorker_t *worker, const CensusConfig_t *config, uint64_t index) {
+    CensusUniverse_t *u = &worker->universe;
+    size_t words = (size_t) u->words * u->height;
+    memset(u->cells, 0, words * sizeof(uint64_t));
+    // soup i of seed s is the same as --soup WxH --seed (s << 32) + i in the main program, and
+    // goes in the same place, the middle of the universe
+    lifeGenerateSoup(worker->soup, config->soupWidth, config->soupHeight, config->density,
+                     (config->seed << 32) + index);
+    uint32_t oX = (u->width - config->soupWidth) / 2, oY = (u->height - config->soupHeight) / 2;
+    for (uint32_t y = 0; y < config->soupHeight; y++) {
+        for (uint32_t x = 0; x < config->soupWidth; x++) {
+            if (worker->soup[(size_t) config->soupWidth * y + x]) {
+                u->cells[(size_t) u->words * (oY + y) + (oX + x) / 64] |= 1ULL << ((oX + x) % 64);
+            }
+        }
+    }
+
+    uint32_t period = 0;
+    uint64_t gen = 0;
+    for (; gen < config->maxGenerations; gen++) {
+        uint32_t population = stepUniverse(u);
+        worker->history[gen % CENSUS_HISTORY] = population;
+        if (population == 0) {
+            period = 1;
+            break;
+        } else if (gen + 1 >= CENSUS_HISTORY && gen % CENSUS_CHECK_INTERVAL == 0) {
+            period = findPeriod(worker->history, gen);
+            if (period > 0) {
+                break;
+            }
+        }
+    }
+    worker->generations += gen;
+    countUniverse(worker, period);
+}
+
+/// Fills in the soup with the given index, in the middle of an otherwise empty universe
+static void generateUniverse(CensusWorker_t *worker, const CensusConfig_t *config, uint64_t index,
+                             bool *cells) {
+    memset(cells, 0, (size_t) config->universeWidth * config->universeHeight * sizeof(bool));
+    lifeGenerateSoup(worker->soup, config->soupWidth, config->soupHeight, config->density,
+                     (config->seed << 32) + index);
+    uint32_t oX = (config->universeWidth - config->soupWidth) / 2;
+    uint32_t oY = (config->universeHeight - config->soupHeight) / 2;
+    for (uint32_t y = 0; y < config->soupHeight; y++) {
+        memcpy(&cells[(size_t) config->universeWidth * (oY + y) + oX],
+               &worker->soup[(size_t) config->soupWidth * y], config->soupWidth * sizeof(bool));
+    }
+}
+
+/// Starts the next soup (if there are any left) in a universe of the bit-sliced engine
+static void startLane(CensusWorker_t *worker, const CensusConfig_t *config, uint32_t lane,
+                      int soups, int *nextSoup) {
+    int index;
+#pragma omp atomic capture
+    index = (*nextSoup)++;
+    CensusLane_t *l = &worker->lanes[lane];
+    l->gen = 0;
+    if (index >= soups) {
+        l->soup = -1;
+        sliceLoad(&worker->slice, lane, NULL);
+        return;
+    }
+    l->soup = index;
+    generateUniverse(worker, config, (uint64_t) index, worker->cells);
+    sliceLoad(&worker->slice, lane, worker->cells);
+}
+
+/**
+ * Runs soups SLICE_UNIVERSES at a time in the bit-sliced engine, taking the next soup index from
+ * nextSoup whenever a universe frees up, until there are none left. Stabilisation is checked the
+ * same way as runSoup() does, so the census comes out the same with either engine.
+ */
+static void runSliced(CensusWorker_t *worker, const CensusConfig_t *config, int soups,
+                      int *nextSoup) {
+    CensusUniverse_t *u = &worker->universe;
+    uint32_t populations[SLICE_UNIVERSES];
+    uint32_t running = 0;
+    for (uint32_t lane = 0; lane < SLICE_UNIVERSES; lane++) {
+        startLane(worker, config, lane, soups, nextSoup);
+        running += worker->lanes[lane].soup >= 0;
+    }
+    while (running > 0) {
+        // every thread has its own slice world, inside census's parallel region
+        sliceUpdateSingle(&worker->slice, 1);
+        slicePopulations(&worker->slice, populations);
+        for (uint32_t lane = 0; lane < SLICE_UNIVERSES; lane++) {
+            CensusLane_t *l = &worker->lanes[lane];
+            if (l->soup < 0) {
+                continue;
+            }
+            uint64_t gen = l->gen++;
+            l->history[gen % CENSUS_HISTORY] = populations[lane];
+            uint32_t period = 0;
+            if (populations[lane] == 0) {
+                period = 1;
+            } else if (gen + 1 >= CENSUS_HISTORY && gen % CENSUS_CHECK_INTERVAL == 0) {
+                period = findPeriod(l->history, gen);
+            }
+            if (period == 0 && l->gen < config->maxGenerations) {
+                continue;
+            }
+            // stabilised or given up on, so count it and start another soup in its place
+            worker->generations += period > 0 ? gen : l->gen;
+            if (period > 0) {
+                sliceExtract(&worker->slice, lane, worker->cells);
+                memset(u->cells, 0, (size_t) u->words * u->height * sizeof(uint64_t));
+                for (uint32_t y = 0; y < u->height; y++) {
+                    for (uint32_t x = 0; x < u->width; x++) {
+                        if (worker->cells[(size_t) u->width * y + x]) {
+                            u->cells[(size_t) u->words * y + x / 64] |= 1ULL << (x % 64);
+                        }
+                    }
+                }
+            }
+            countUniverse(worker, period);
+            startLane(worker, config, lane, soups, nextSoup);
+            running -= worker->lanes[lane].soup < 0;
+        }
+    }
+}
+
+static void workerInit(CensusWorker_t *worker, const CensusConfig_t *config) {
+    *worker = (CensusWorker_t) {0};
+    CensusUniverse_t *u = &worker->universe;
+    u->width = config->universeWidth;
+    u->height = config->universeHeight;
+    u->words = u->width / 64;
+    size_t words = (size_t) u->words * u->height;
+    u->cells = calloc(words, sizeof(uint64_t));
+    u->next = calloc(words, sizeof(uint64_t));
+    u->ones = calloc(words, sizeof(uint64_t));
+    u->twos = calloc(words, sizeof(uint64_t));
+    u->rowLive = calloc(u->height, sizeof(bool));
+    worker->mask = calloc(words, sizeof(uint64_t));
+    worker->soup = calloc((size_t) config->soupWidth * config->soupHeight, sizeof(bool));
+    if (config->engine == CENSUS_ENGINE_SLICED) {
+        sliceInit(&worker->slice, u->width, u->height, LIFE_TOPOLOGY_TORUS);
+        worker->cells = calloc((size_t) u->width * u->height, sizeof(bool));
+    }
+}
+
+static void workerFree(CensusWorker_t *worker) {
+    CensusUniverse_t *u = &worker->universe;
+    free(u->cells);
+    free(u->next);
+    free(u->ones);
+    free(u->twos);
+    free(u->rowLive);
+    free(worker->mask);
+    free(worker->soup);
+    free(worker->stack);
+    free(worker->object);
+    free(worker->cells);
+    if (worker->slice.cells != NULL) {
+        sliceDestroy(&worker->slice);
+    }
+    tableFree(&worker->objects);
+}
+
+/**
+ * Classifies each of the objects in checks and compares the codes with the known ones
+ * @return true if they all match, false (after logging the first that doesn't) otherwise
+ */
+static bool selfTest(void) {
+    for (size_t i = 0; i < NUM_CHECKS; i++) {
+        CensusPoint_t cells[256];
+        size_t count = 0;
+        int32_t x = 0, y = 0;
+        for (const char *c = checks[i].cells; *c != '\0'; c++) {
+            if (*c == '$') {
+                x = 0;
+                y++;
+                continue;
+            } else if (*c == 'O') {
+                assert(count < sizeof(cells) / sizeof(cells[0]));
+                cells[count++] = (CensusPoint_t) {x, y};
+            }
+            x++;
+        }
+        char code[CENSUS_MAX_CODE];
+        classifyObject(cells, count, code);
+        if (strcmp(code, checks[i].code) != 0) {
+            log_error("Object %zu (%s) was classified as %s, expected %s", i, checks[i].cells, code,
+                      checks[i].code);
+            return false;
+        }
+    }
+    log_info("All %zu objects classified correctly", NUM_CHECKS);
+    return true;
+}
+
+/// Writes the summary file, returning false (after logging why) if it can't be written
+static bool writeSummary(const char *filename, const CensusConfig_t *config,
+                         const CensusTable_t *objects, uint64_t soups, uint64_t stabilised,
+                         double elapsed) {
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        log_error("Failed to open file %s for writing: %s", filename, strerror(errno));
+        return false;
+    }
+    CensusEntry_t *sorted = malloc(MAX(objects->count, 1) * sizeof(CensusEntry_t));
+    size_t count = 0;
+    for (size_t i = 0; i < objects->capacity; i++) {
+        if (objects->entries[i].code != NULL) {
+            sorted[count++] = objects->entries[i];
+        }
+    }
+    qsort(sorted, count, sizeof(CensusEntry_t), compareEntries);
+
+    fprintf(out, "# Soup census from gol_census v" VERSION "\n");
+    fprintf(out, "# Rule %s, %ux%u torus, %ux%u soups with density %.3f, seed %lu\n", LIFE_RULE,
+            config->universeWidth, config->universeHeight, config->soupWidth, config->soupHeight,
+            config->density, config->seed);
+    fprintf(out, "# %lu soups (%lu stabilised) in %.2f s, %.1f soups/sec\n", soups, stabilised,
+            elapsed, elapsed > 0 ? soups / elapsed : 0.0);
+    fprintf(out, "# %-30s %12s  %s\n", "object", "count", "name");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "%-32s %12lu  %s\n", sorted[i].code, sorted[i].count,
+                findName(sorted[i].code));
+    }
+    free(sorted);
+    if (fclose(out) != 0) {
+        log_error("Failed to write census summary %s: %s", filename, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    struct arg_lit *argHelp = arg_lit0(NULL, "help", "Display help and exit.");
+    struct arg_int *argSoups = arg_int0(NULL, "soups", "int",
+            "Number of soups to run. Defaults to " XSTR(CENSUS_DEFAULT_SOUPS) ".");
+    struct arg_str *argSoup = arg_str0(NULL, "soup", "[width]x[height]",
+            "Size of each soup. Defaults to 16x16.");
+    struct arg_str *argUniverse = arg_str0(NULL, "universe", "[width]x[height]",
+            "Size of the torus each soup runs in. The width must be a multiple of 64. Defaults to "
+            "256x256.");
+    struct arg_dbl *argDensity = arg_dbl0(NULL, "density", "p",
+            "Probability of each soup cell being alive, from 0 to 1. Defaults to 0.5.");
+    struct arg_str *argSeed = arg_str0(NULL, "seed", "int",
+            "Random seed. Soup i is the same as gameoflife --soup WxH --seed (seed << 32) + i. "
+            "Defaults to 1.");
+    struct arg_int *argMaxGens = arg_int0(NULL, "max-generations", "int",
+            "Give up on soups that haven't stabilised after this many generations. Defaults to "
+            XSTR(CENSUS_DEFAULT_MAX_GENERATIONS) ".");
+    struct arg_str *argEngine = arg_str0(NULL, "engine", "name",
+            "How soups are run, one of: packed (one at a time per thread), sliced (64 at a time "
+            "per thread, in the bit-sliced engine), auto (sliced for universes of at most "
+            XSTR(CENSUS_SLICED_MAX_CELLS) " cells, packed otherwise). Defaults to auto.");
+    struct arg_int *argThreads = arg_int0(NULL, "threads", "int",
+            "OMP threads to use. Defaults to all of them.");
+    struct arg_file *argOutput = arg_file0(NULL, "output", "file",
+            "Write the summary to this file. Defaults to " DEFAULT_CENSUS_FILE ".");
+    struct arg_lit *argSelfTest = arg_lit0(NULL, "self-test",
+            "Classify some well known objects, check their codes and exit, with a non-zero status "
+            "if any are wrong.");
+    struct arg_end *argEnd = arg_end(20);
+
+    void *argtable[] = {argHelp, argSoups, argSoup, argUniverse, argDensity, argSeed, argMaxGens,
+                        argEngine, argThreads, argOutput, argSelfTest, argEnd};
+    assert(arg_nullcheck(argtable) == 0);
+
+    *argSoups->ival = CENSUS_DEFAULT_SOUPS;
+    *argSoup->sval = "16x16";
+    *argUniverse->sval = "256x256";
+    *argDensity->dval = 0.5;
+    *argSeed->sval = "1";
+    *argMaxGens->ival = CENSUS_DEFAULT_MAX_GENERATIONS;
+    *argEngine->sval = engineNames[CENSUS_ENGINE_AUTO];
+    *argThreads->ival = omp_get_max_threads();
+    *argOutput->filename = DEFAULT_CENSUS_FILE;
+
+    int nerrors = arg_parse(argc, argv, argtable);
+    if (argHelp->count > 0) {
+        printf("Game of Life soup census v" VERSION "\n");
+        printf("Usage: gol_census");
+        arg_print_syntax(stdout, argtable, "\n");
+        arg_print_glossary(stdout, argtable, "  %-30s %s\n");
+        arg_free(argtable);
+        exit(0);
+    } else if (nerrors > 0) {
+        arg_print_errors(stderr, argEnd, "gol_census");
+        arg_free(argtable);
+        exit(1);
+    } else if (argSelfTest->count > 0) {
+        arg_free(argtable);
+        exit(selfTest() ? 0 : 1);
+    }
+
+    CensusConfig_t config = {
+        .density = *argDensity->dval,
+        .maxGenerations = (uint32_t) MAX(*argMaxGens->ival, 0),
+    };
+    if (!utilsParseSize(*argSoup->sval, &config.soupWidth, &config.soupHeight)
+            || !utilsParseSize(*argUniverse->sval, &config.universeWidth, &config.universeHeight)) {
+        exit(1);
+    }
+    char *seedEnd = NULL;
+    config.seed = strtoull(*argSeed->sval, &seedEnd, 0);
+    config.engine = CENSUS_ENGINE_COUNT;
+    for (CensusEngine_t e = 0; e < CENSUS_ENGINE_COUNT; e++) {
+        if (strcasecmp(engineNames[e], *argEngine->sval) == 0) {
+            config.engine = e;
+        }
+    }
+    int soups = *argSoups->ival;
+    int threads = *argThreads->ival;
+    const char *output = *argOutput->filename;
+    if (strlen(seedEnd) > 0 || **argSeed->sval == '-') {
+        log_error("Seed must be a non-negative integer.");
+        exit(1);
+    } else if (config.engine == CENSUS_ENGINE_COUNT) {
+        log_error("Unknown engine '%s', must be one of: packed, sliced, auto.", *argEngine->sval);
+        exit(1);
+    } else if (soups <= 0 || threads <= 0 || *argMaxGens->ival <= 0) {
+        log_error("Soups, threads and max generations must be positive.");
+        exit(1);
+    } else if (config.density < 0.0 || config.density > 1.0) {
+        log_error("Soup density must be between 0 and 1.");
+        exit(1);
+    } else if (config.universeWidth == 0 || config.universeWidth % 64 != 0
+               || config.universeHeight < 3) {
+        log_error("Universe width must be a positive multiple of 64, and its height at least 3.");
+        exit(1);
+    } else if (config.soupWidth == 0 || config.soupHeight == 0
+               || config.soupWidth > config.universeWidth
+               || config.soupHeight > config.universeHeight) {
+        log_error("Soups must be non-empty and fit in the universe.");
+        exit(1);
+    }
+    if (config.engine == CENSUS_ENGINE_AUTO) {
+        uint64_t cells = (uint64_t) config.universeWidth * config.universeHeight;
+        config.engine = cells <= CENSUS_SLICED_MAX_CELLS ? CENSUS_ENGINE_SLICED
+                                                         : CENSUS_ENGINE_PACKED;
+    }
+    omp_set_num_threads(threads);
+    arg_free(argtable);
+
+    log_info("Running %d %ux%u soups in %ux%u tori on %d threads, with the %s engine", soups,
+             config.soupWidth, config.soupHeight, config.universeWidth, config.universeHeight,
+             threads, engineNames[config.engine]);
+    CensusTable_t objects = {0};
+    uint64_t stabilised = 0, generations = 0;
+    int nextSoup = 0;
+    double begin = utilsGetTime();
+
+#pragma omp parallel default(none) shared(config, soups, objects, nextSoup) \
+        reduction(+:stabilised, generations)
+    {
+        CensusWorker_t worker;
+        workerInit(&worker, &config);
+        if (config.engine == CENSUS_ENGINE_SLICED) {
+            runSliced(&worker, &config, soups, &nextSoup);
+        } else {
+            // soups take very different numbers of generations to settle, so hand them out
+            // dynamically
+#pragma omp for schedule(dynamic, 4) nowait
+            for (int i = 0; i < soups; i++) {
+                runSoup(&worker, &config, (uint64_t) i);
+            }
+        }
+#pragma omp critical
+        for (size_t i = 0; i < worker.objects.capacity; i++) {
+            if (worker.objects.entries[i].code != NULL) {
+                tableAdd(&objects, worker.objects.entries[i].code,
+                         worker.objects.entries[i].count);
+            }
+        }
+        stabilised += worker.stabilised;
+        generations += worker.generations;
+        workerFree(&worker);
+    }
+
+    double elapsed = utilsGetTime() - begin;
+    log_info("%lu of %d soups stabilised, after %.1f generations on average", stabilised, soups,
+             (double) generations / soups);
+    printf("Ran %d soups in %.2f s (%.1f soups/sec), summary written to %s\n", soups, elapsed,
+           elapsed > 0 ? soups / elapsed : 0.0, output);
+    bool written = writeSummary(output, &config, &objects, (uint64_t) soups, stabilised, elapsed);
+    tableFree(&objects);
+    return written ? 0 : 1;
+}
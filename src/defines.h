@@ -17,7 +17,33 @@
 /// Default window height
 #define DEFAULT_WINDOW_HEIGHT 900
 
-/// Default GoL grid width
+/// Default GoL grid width, used if the grid can't be sized automatically from the pattern
 #define DEFAULT_GRID_WIDTH 256
 /// Default GoL grid height
-#define DEFAULT_GRID_HEIGHT 256
\ No newline at end of file
+#define DEFAULT_GRID_HEIGHT 256
+/// Default number of cells of empty space around the pattern when the grid is sized automatically
+#define DEFAULT_GRID_MARGIN 64
+
+/// Snapshot file written by the S key if --save isn't given
+#define DEFAULT_SNAPSHOT_FILE "snapshot.gol"
+
+/// Pattern file written by the E key and --export-at if --export isn't given
+#define DEFAULT_EXPORT_FILE "export.rle"
+
+/// Frame time budget in milliseconds for "--steps-per-frame auto" when the framerate is unlocked
+#define AUTO_STEPS_DEFAULT_BUDGET_MS (1000.0 / 60.0)
+/// Upper limit on the number of generations "--steps-per-frame auto" will run in one frame
+#define AUTO_STEPS_MAX 65536
+/// Smoothing factor for the exponential moving averages used by "--steps-per-frame auto"
+#define AUTO_STEPS_SMOOTHING 0.2
+
+/// Default grid sizes for gol_bench
+#define BENCH_DEFAULT_SIZES "512x512,1024x1024,2048x2048"
+/// Cells added to a pattern's width and height when gol_bench sizes a grid to fit it
+#define BENCH_AUTO_MARGIN 64
+/// Default number of untimed warm-up generations per gol_bench trial
+#define BENCH_DEFAULT_WARMUP 10
+/// Default number of gol_bench trials per configuration
+#define BENCH_DEFAULT_TRIALS 5
+/// Default number of timed generations per gol_bench trial
+#define BENCH_DEFAULT_GENERATIONS 100
\ No newline at end of file
@@ -0,0 +1,393 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "generations.h"
+#include <string.h>
+#include <assert.h>
+#include <omp.h>
+#include "utils.h"
+
+static inline size_t planeIndex(const GenerationsWorld_t *world, uint32_t y, uint32_t plane) {
+    return ((size_t) y * world->numPlanes + plane) * world->rowWords;
+}
+
+static inline size_t aliveIndex(const GenerationsWorld_t *world, uint32_t y) {
+    return (size_t) (world->rowWords + 2) * y;
+}
+
+/// Mask of the bits of the last word of a row that hold cells
+static inline uint64_t lastWordMask(uint32_t width) {
+    return width % 64 == 0 ? ~0ULL : (1ULL << (width % 64)) - 1;
+}
+
+/// Works out the state of a cell from the given planes (either the current or next ones)
+static inline uint8_t getState(const GenerationsWorld_t *world, const uint64_t *planes, uint32_t x,
+                               uint32_t y) {
+    uint8_t state = 0;
+    for (uint32_t k = 0; k < world->numPlanes; k++) {
+        state |= (uint8_t) (((planes[planeIndex(world, y, k) + x / 64] >> (x % 64)) & 1) << k);
+    }
+    return state;
+}
+
+/// Sets the state of a run of cells in the given planes
+static void setStates(const GenerationsWorld_t *world, uint64_t *planes, uint32_t x, uint32_t y,
+                      uint32_t count, uint8_t state) {
+    for (uint32_t k = 0; k < world->numPlanes; k++) {
+        uint64_t *plane = &planes[planeIndex(world, y, k)];
+        bool set = (state >> k) & 1;
+        // a word at a time, with partial words at either end of the run
+        for (uint32_t i = x; i < x + count;) {
+            uint32_t shift = i % 64, n = MIN(64 - shift, x + count - i);
+            uint64_t mask = (n == 64 ? ~0ULL : (1ULL << n) - 1) << shift;
+            plane[i / 64] = set ? plane[i / 64] | mask : plane[i / 64] & ~mask;
+            i += n;
+        }
+    }
+}
+
+void generationsSetRow(GenerationsWorld_t *world, uint32_t y, const uint8_t *states) {
+    for (uint32_t k = 0; k < world->numPlanes; k++) {
+        uint64_t *plane = &world->planes[planeIndex(world, y, k)];
+        memset(plane, 0, world->rowWords * sizeof(uint64_t));
+        for (uint32_t x = 0; x < world->width; x++) {
+            plane[x / 64] |= (uint64_t) ((states[x] >> k) & 1) << (x % 64);
+        }
+    }
+}
+
+void generationsInit(GenerationsWorld_t *world, uint32_t width, uint32_t height,
+                     const LifeRule_t *rule) {
+    *world = (GenerationsWorld_t) {
+        .width = width,
+        .height = height,
+        .rowWords = (width + 63) / 64,
+    };
+    world->alive = calloc(MAX(aliveIndex(world, height), 1), sizeof(uint64_t));
+    world->zeroRow = calloc(world->rowWords + 2, sizeof(uint64_t));
+    generationsSetRule(world, rule);
+}
+
+void generationsDestroy(GenerationsWorld_t *world) {
+    free(world->planes);
+    free(world->next);
+    free(world->alive);
+    free(world->zeroRow);
+    *world = (GenerationsWorld_t) {0};
+}
+
+void generationsSetRule(GenerationsWorld_t *world, const LifeRule_t *rule) {
+    assert(rule->dyingStates > 0 && !rule->isotropic);
+    world->birth = rule->birth;
+    world->survival = rule->survival;
+    uint32_t states = rule->dyingStates + 2;
+    if (states == world->states) {
+        return;
+    }
+    world->states = states;
+    world->numPlanes = 1;
+    while ((1U << world->numPlanes) < states) {
+        world->numPlanes++;
+    }
+    assert(world->numPlanes <= GENERATIONS_MAX_PLANES);
+    free(world->planes);
+    free(world->next);
+    size_t words = MAX(planeIndex(world, world->height, 0), 1);
+    world->planes = calloc(words, sizeof(uint64_t));
+    world->next = calloc(words, sizeof(uint64_t));
+}
+
+/// Works out which cells of row y are alive (in state 1) into the alive plane, along with the
+/// cells beyond the left and right edges in the padding
+static void buildAliveRow(GenerationsWorld_t *world, uint32_t y, LifeTopology_t topology) {
+    uint32_t words = world->rowWords, w = world->width;
+    uint64_t *alive = &world->alive[aliveIndex(world, y)];
+    const uint64_t *plane = &world->planes[planeIndex(world, y, 0)];
+    for (uint32_t i = 0; i < words; i++) {
+        alive[i + 1] = plane[i];
+    }
+    for (uint32_t k = 1; k < world->numPlanes; k++) {
+        plane = &world->planes[planeIndex(world, y, k)];
+        for (uint32_t i = 0; i < words; i++) {
+            alive[i + 1] &= ~plane[i];
+        }
+    }
+    alive[0] = 0;
+    alive[words + 1] = 0;
+    if (topology == LIFE_TOPOLOGY_TORUS) {
+        // the cell before the first is the last one, and the cell after the last is the first,
+        // which goes in the bit straight after the last cell (possibly in the padding word)
+        alive[0] = ((alive[1 + (w - 1) / 64] >> ((w - 1) % 64)) & 1) << 63;
+        alive[1 + w / 64] |= (alive[1] & 1) << (w % 64);
+    }
+}
+
+/**
+ * Works out the next generation of one row. Live neighbours are counted by adding the horizontal
+ * sums of the row and the rows above and below with full adders, as in the bit-sliced engine, with
+ * each cell's left and right neighbours found by shifting the row one bit either way. Then cells
+ * whose state changes (live ones that don't survive, dead ones that are born, and every dying one)
+ * have one added to their state across the planes, wrapping round to dead after the last state.
+ * @param scratch space for 6 * rowWords words
+ */
+static void updateRow(GenerationsWorld_t *world, uint32_t y, LifeTopology_t topology,
+                      uint64_t *scratch) {
+    uint32_t words = world->rowWords, h = world->height;
+    size_t stride = words + 2;
+    const uint64_t *row = &world->alive[aliveIndex(world, y)];
+    const uint64_t *above, *below;
+    if (topology == LIFE_TOPOLOGY_TORUS) {
+        above = &world->alive[aliveIndex(world, y == 0 ? h - 1 : y - 1)];
+        below = &world->alive[aliveIndex(world, y == h - 1 ? 0 : y + 1)];
+    } else {
+        above = y == 0 ? world->zeroRow : row - stride;
+        below = y == h - 1 ? world->zeroRow : row + stride;
+    }
+    uint64_t *change = scratch, *any = &scratch[words];
+    // neighbours = s0 + 2 * s1 + 4 * s2 + 8 * s3
+    uint64_t *s0 = &scratch[2 * words], *s1 = &scratch[3 * words];
+    uint64_t *s2 = &scratch[4 * words], *s3 = &scratch[5 * words];
+
+    for (uint32_t i = 0; i < words; i++) {
+        // these start at the left padding word, so word i is at i + 1
+        uint64_t a = above[i + 1], b = row[i + 1], c = below[i + 1];
+        uint64_t al = (a << 1) | (above[i] >> 63), ar = (a >> 1) | (above[i + 2] << 63);
+        uint64_t bl = (b << 1) | (row[i] >> 63), br = (b >> 1) | (row[i + 2] << 63);
+        uint64_t cl = (c << 1) | (below[i] >> 63), cr = (c >> 1) | (below[i + 2] << 63);
+        // horizontal sums of each row as 2 bit numbers, leaving out the cell itself
+        uint64_t a0 = al ^ a ^ ar;
+        uint64_t a1 = (al & a) | (ar & (al ^ a));
+        uint64_t b0 = bl ^ br;
+        uint64_t b1 = bl & br;
+        uint64_t c0 = cl ^ c ^ cr;
+        uint64_t c1 = (cl & c) | (cr & (cl ^ c));
+        uint64_t carry = (a0 & b0) | (c0 & (a0 ^ b0));
+        uint64_t u0 = a1 ^ b1 ^ c1;
+        uint64_t u1 = (a1 & b1) | (c1 & (a1 ^ b1));
+        uint64_t k = u0 & carry;
+        s0[i] = a0 ^ b0 ^ c0;
+        s1[i] = u0 ^ carry;
+        s2[i] = u1 ^ k;
+        s3[i] = u1 & k;
+        change[i] = 0;
+    }
+
+    // live cells that don't survive and dead cells that are born change state, so for each number
+    // of neighbours, live cells change if it isn't in the survival mask and dead ones if it's in
+    // the birth mask
+    for (uint32_t t = 0; t <= 8; t++) {
+        uint64_t alive = (world->survival >> t) & 1 ? 0 : ~0ULL;
+        uint64_t dead = (world->birth >> t) & 1 ? ~0ULL : 0;
+        if ((alive | dead) == 0) {
+            continue;
+        }
+        // flipping the planes whose bit of t is clear means the ones with that count are all ones
+        uint64_t f0 = t & 1 ? 0 : ~0ULL, f1 = t & 2 ? 0 : ~0ULL;
+        uint64_t f2 = t & 4 ? 0 : ~0ULL, f3 = t & 8 ? 0 : ~0ULL;
+        for (uint32_t i = 0; i < words; i++) {
+            uint64_t match = (s0[i] ^ f0) & (s1[i] ^ f1) & (s2[i] ^ f2) & (s3[i] ^ f3);
+            change[i] |= match & ((row[i + 1] & alive) | (~row[i + 1] & dead));
+        }
+    }
+
+    // dying cells always move on, and are the ones in a state other than dead or alive
+    const uint64_t *plane = &world->planes[planeIndex(world, y, 0)];
+    for (uint32_t i = 0; i < words; i++) {
+        any[i] = plane[i];
+    }
+    for (uint32_t k = 1; k < world->numPlanes; k++) {
+        plane = &world->planes[planeIndex(world, y, k)];
+        for (uint32_t i = 0; i < words; i++) {
+            any[i] |= plane[i];
+        }
+    }
+    for (uint32_t i = 0; i < words; i++) {
+        uint64_t dying = any[i] & ~row[i + 1];
+        change[i] = (change[i] & ~dying) | dying;
+    }
+    // the bits past the width (where a torus keeps a copy of the first cell) must stay dead
+    change[words - 1] &= lastWordMask(world->width);
+
+    // add one to each changing cell's state, with the carry rippling up through the planes
+    for (uint32_t k = 0; k < world->numPlanes; k++) {
+        plane = &world->planes[planeIndex(world, y, k)];
+        uint64_t *next = &world->next[planeIndex(world, y, k)];
+        for (uint32_t i = 0; i < words; i++) {
+            next[i] = plane[i] ^ change[i];
+            change[i] &= plane[i];
+        }
+    }
+
+    // states past the last one wrap round to dead. When the number of states is a power of two,
+    // that happens by itself, since the carry out of the top plane is dropped.
+    if (world->states < (1U << world->numPlanes)) {
+        uint64_t *wrapped = any;
+        for (uint32_t i = 0; i < words; i++) {
+            wrapped[i] = ~0ULL;
+        }
+        for (uint32_t k = 0; k < world->numPlanes; k++) {
+            const uint64_t *next = &world->next[planeIndex(world, y, k)];
+            uint64_t flip = (world->states >> k) & 1 ? 0 : ~0ULL;
+            for (uint32_t i = 0; i < words; i++) {
+                wrapped[i] &= next[i] ^ flip;
+            }
+        }
+        for (uint32_t k = 0; k < world->numPlanes; k++) {
+            uint64_t *next = &world->next[planeIndex(world, y, k)];
+            for (uint32_t i = 0; i < words; i++) {
+                next[i] &= ~wrapped[i];
+            }
+        }
+    }
+}
+
+void generationsUpdate(GenerationsWorld_t *world, LifeTopology_t topology, uint32_t steps) {
+    if (world->width == 0 || world->height == 0) {
+        return;
+    }
+    // one parallel region for the whole batch, as in life.c's updateRows(), with each thread's
+    // scratch rows allocated once rather than every generation
+#pragma omp parallel default(none) shared(world, topology, steps)
+    {
+        uint64_t *scratch = malloc(6 * (size_t) world->rowWords * sizeof(uint64_t));
+        for (uint32_t i = 0; i < steps; i++) {
+            // every row's live cells are needed before any row can be updated
+#pragma omp for schedule(static)
+            for (uint32_t y = 0; y < world->height; y++) {
+                buildAliveRow(world, y, topology);
+            }
+
+#pragma omp for schedule(static)
+            for (uint32_t y = 0; y < world->height; y++) {
+                updateRow(world, y, topology, scratch);
+            }
+
+#pragma omp single
+            {
+                uint64_t *tmp = world->planes;
+                world->planes = world->next;
+                world->next = tmp;
+            }
+        }
+        free(scratch);
+    }
+}
+
+void generationsUpdateReference(GenerationsWorld_t *world, LifeTopology_t topology,
+                                uint32_t steps) {
+    uint32_t width = world->width, height = world->height;
+    // a byte per cell, so the update itself doesn't touch the planes
+    uint8_t *cells = malloc(MAX((size_t) width * height, 1));
+    uint8_t *next = malloc(MAX((size_t) width * height, 1));
+    for (uint32_t y = 0; y < height; y++) {
+        generationsGetRow(world, y, &cells[(size_t) width * y]);
+    }
+    for (uint32_t i = 0; i < steps; i++) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t neighbours = 0;
+                for (int64_t dy = -1; dy <= 1; dy++) {
+                    for (int64_t dx = -1; dx <= 1; dx++) {
+                        int64_t nx = x + dx, ny = y + dy;
+                        if (dx == 0 && dy == 0) {
+                            continue;
+                        } else if (topology == LIFE_TOPOLOGY_TORUS) {
+                            nx = (nx + width) % width;
+                            ny = (ny + height) % height;
+                        } else if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                            continue;
+                        }
+                        neighbours += cells[(size_t) width * ny + nx] == 1;
+                    }
+                }
+                uint8_t state = cells[(size_t) width * y + x];
+                uint8_t *out = &next[(size_t) width * y + x];
+                if (state == 0) {
+                    *out = (world->birth >> neighbours) & 1;
+                } else if (state == 1 && (world->survival >> neighbours) & 1) {
+                    *out = 1;
+                } else {
+                    *out = (uint8_t) ((state + 1) % world->states);
+                }
+            }
+        }
+        uint8_t *tmp = cells;
+        cells = next;
+        next = tmp;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        generationsSetRow(world, y, &cells[(size_t) width * y]);
+    }
+    free(cells);
+    free(next);
+}
+
+void generationsClear(GenerationsWorld_t *world) {
+    memset(world->planes, 0, planeIndex(world, world->height, 0) * sizeof(uint64_t));
+}
+
+uint8_t generationsGetCell(const GenerationsWorld_t *world, uint32_t x, uint32_t y) {
+    assert(x < world->width && y < world->height);
+    return getState(world, world->planes, x, y);
+}
+
+void generationsSetCells(GenerationsWorld_t *world, uint32_t x, uint32_t y, uint32_t count,
+                         uint8_t state) {
+    assert(state < world->states);
+    assert(y < world->height && (uint64_t) x + count <= world->width);
+    setStates(world, world->planes, x, y, count, state);
+}
+
+void generationsGetRow(const GenerationsWorld_t *world, uint32_t y, uint8_t *states) {
+    memset(states, 0, world->width);
+    for (uint32_t k = 0; k < world->numPlanes; k++) {
+        const uint64_t *plane = &world->planes[planeIndex(world, y, k)];
+        for (uint32_t x = 0; x < world->width; x++) {
+            states[x] |= (uint8_t) (((plane[x / 64] >> (x % 64)) & 1) << k);
+        }
+    }
+}
+
+void generationsLoadGrid(GenerationsWorld_t *world, const bool *grid) {
+#pragma omp parallel for default(none) shared(world, grid)
+    for (uint32_t y = 0; y < world->height; y++) {
+        const bool *row = &grid[(size_t) world->width * y];
+        for (uint32_t i = 0; i < world->rowWords; i++) {
+            uint64_t alive = 0;
+            uint32_t cells = MIN(64, world->width - 64 * i);
+            for (uint32_t b = 0; b < cells; b++) {
+                alive |= (uint64_t) row[64 * i + b] << b;
+            }
+            uint64_t *first = &world->planes[planeIndex(world, y, 0) + i];
+            uint64_t wasAlive = *first;
+            for (uint32_t k = 1; k < world->numPlanes; k++) {
+                wasAlive &= ~world->planes[planeIndex(world, y, k) + i];
+            }
+            // cells alive in the grid go to state 1, and ones that were alive go to dead first
+            uint64_t reset = alive | wasAlive;
+            for (uint32_t k = 0; k < world->numPlanes; k++) {
+                world->planes[planeIndex(world, y, k) + i] &= ~reset;
+            }
+            *first |= alive;
+        }
+    }
+}
+
+void generationsStoreGrid(const GenerationsWorld_t *world, bool *grid) {
+#pragma omp parallel for default(none) shared(world, grid)
+    for (uint32_t y = 0; y < world->height; y++) {
+        bool *row = &grid[(size_t) world->width * y];
+        for (uint32_t i = 0; i < world->rowWords; i++) {
+            uint64_t alive = world->planes[planeIndex(world, y, 0) + i];
+            for (uint32_t k = 1; k < world->numPlanes; k++) {
+                alive &= ~world->planes[planeIndex(world, y, k) + i];
+            }
+            uint32_t cells = MIN(64, world->width - 64 * i);
+            for (uint32_t b = 0; b < cells; b++) {
+                row[64 * i + b] = (alive >> b) & 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Engine for Generations rules (e.g. Brian's Brain, B2/S/C3), where a cell that stops being alive
+// goes through a number of dying states before it's dead, and only live cells count as neighbours.
+// Cell states are stored in bit planes, 64 cells to a word, so each step is boolean logic over
+// rows of words. Worlds running two-state rules never create one of these, so they don't pay for
+// it. See LifeWorld_t for how it's kept in step with the world's grid.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "life.h"
+
+/// Most bit planes a Generations world can have, enough for LIFE_MAX_STATES states
+#define GENERATIONS_MAX_PLANES 8
+
+typedef struct {
+    uint32_t width, height;
+    /// Number of states cells can be in: 0 is dead, 1 is alive, and the rest are dying
+    uint32_t states;
+    /// Birth and survival masks, as in LifeRule_t
+    uint16_t birth, survival;
+    /// Words per row of a plane, with the bits past the width always 0
+    uint32_t rowWords;
+    /// Number of bit planes, enough to hold states - 1
+    uint32_t numPlanes;
+    /// Bit k of a cell's state is in plane k. Plane k of row y starts at word
+    /// (y * numPlanes + k) * rowWords, so a row's planes are next to each other.
+    uint64_t *planes, *next;
+    /**
+     * Scratch plane of the live cells, worked out at the start of each step, with a padding word
+     * either side of each row (rowWords + 2 words per row). The padding holds the cells beyond the
+     * left and right edges, so neighbours can be counted without any special cases at the edges.
+     */
+    uint64_t *alive;
+    /// Row of rowWords + 2 dead cells, standing in for the rows beyond a bounded grid
+    uint64_t *zeroRow;
+} GenerationsWorld_t;
+
+/**
+ * Initialises a Generations world with every cell dead
+ * @param rule rule to run, which must be a Generations rule (rule->dyingStates > 0)
+ */
+void generationsInit(GenerationsWorld_t *world, uint32_t width, uint32_t height,
+                     const LifeRule_t *rule);
+
+/// Frees memory associated with generationsInit()
+void generationsDestroy(GenerationsWorld_t *world);
+
+/// Changes the rule. If the number of states changes, every cell is reset to dead.
+void generationsSetRule(GenerationsWorld_t *world, const LifeRule_t *rule);
+
+/**
+ * Advances the world by the given number of generations. Rows are split between OpenMP threads,
+ * and every loop is over a row of words so compilers vectorise it.
+ */
+void generationsUpdate(GenerationsWorld_t *world, LifeTopology_t topology, uint32_t steps);
+
+/// Same as generationsUpdate(), but single threaded and a cell at a time straight from the
+/// definition of the rule, for checking it against
+void generationsUpdateReference(GenerationsWorld_t *world, LifeTopology_t topology,
+                                uint32_t steps);
+
+/// Sets every cell to dead
+void generationsClear(GenerationsWorld_t *world);
+
+/// Returns the state of a cell
+uint8_t generationsGetCell(const GenerationsWorld_t *world, uint32_t x, uint32_t y);
+
+/// Sets count cells of row y from x onwards to the given state, which must be less than states
+void generationsSetCells(GenerationsWorld_t *world, uint32_t x, uint32_t y, uint32_t count,
+                         uint8_t state);
+
+/// Gets the states of every cell in row y, one byte each
+void generationsGetRow(const GenerationsWorld_t *world, uint32_t y, uint8_t *states);
+
+/// Sets the states of every cell in row y from one byte each, which must be less than states
+void generationsSetRow(GenerationsWorld_t *world, uint32_t y, const uint8_t *states);
+
+/**
+ * Brings the states into line with a grid of live cells: cells alive in the grid become alive,
+ * live cells that are dead in the grid become dead, and dying cells that are dead in the grid are
+ * left dying.
+ */
+void generationsLoadGrid(GenerationsWorld_t *world, const bool *grid);
+
+/// Writes which cells are alive into a grid of width * height cells
+void generationsStoreGrid(const GenerationsWorld_t *world, bool *grid);
@@ -0,0 +1,643 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "jit.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "utils.h"
+#include "log.h"
+
+/// Most inputs to a rule's boolean function, the 9 cells of an isotropic rule's neighbourhood
+#define JIT_MAX_INPUTS 9
+/// Number of input combinations with JIT_MAX_INPUTS inputs
+#define JIT_MAX_MINTERMS (1 << JIT_MAX_INPUTS)
+/// Inputs to an outer totalistic rule's boolean function: bits 0 to 3 of the 3x3 total, then the
+/// cell's state
+#define JIT_TOTAL_INPUTS 5
+/// Bit of a minterm of an outer totalistic rule's function holding the cell's state
+#define JIT_ALIVE (1 << 4)
+/// Bit of a neighbourhood (see LifeRule_t) holding the cell's state
+#define JIT_CENTRE (1 << 4)
+/// Flags the compiler is run with
+#define JIT_CFLAGS "-O3", "-march=native", "-shared", "-fPIC"
+/// Name of the row update in the generated library
+#define JIT_SYMBOL "golUpdateRow"
+
+/// A product term of a boolean function: the minterms that match value on every input not in mask
+typedef struct {
+    uint16_t value, mask;
+} JitImplicant_t;
+
+/// A set of minterms of a boolean function, bit n set if minterm n is in it
+typedef struct {
+    uint64_t bits[JIT_MAX_MINTERMS / 64];
+} JitTerms_t;
+
+/// A row update already loaded by this process
+typedef struct {
+    uint64_t hash;
+    JitRowKernel_t kernel;
+} JitLoaded_t;
+
+/// Row updates loaded so far, protected by loadedLock
+static JitLoaded_t *loaded = NULL;
+static size_t numLoaded = 0;
+static pthread_mutex_t loadedLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void termsAdd(JitTerms_t *terms, uint32_t minterm) {
+    terms->bits[minterm / 64] |= 1ULL << (minterm % 64);
+}
+
+static inline bool termsHas(const JitTerms_t *terms, uint32_t minterm) {
+    return (terms->bits[minterm / 64] >> (minterm % 64)) & 1;
+}
+
+/// Returns true if an implicant covers a minterm
+static inline bool implicantCovers(JitImplicant_t implicant, uint32_t minterm) {
+    return (minterm & ~implicant.mask) == implicant.value;
+}
+
+/**
+ * Finds the prime implicants of a boolean function with the Quine-McCluskey method: starting from
+ * the minterms, implicants that differ in one input are merged until none can be. Implicants are
+ * kept in a table indexed by their mask and value rather than in lists, so each merge is found with
+ * a lookup, and since merging only ever adds inputs to the mask, one pass over the masks in
+ * increasing order does every round of merging.
+ * @param terms the minterms that are true or don't care
+ * @param numPrimes where to store the number of prime implicants
+ * @return the prime implicants, to be freed by the caller
+ */
+static JitImplicant_t *findPrimeImplicants(uint32_t inputs, const JitTerms_t *terms,
+                                           size_t *numPrimes) {
+    uint32_t minterms = 1U << inputs;
+    // implicant (value, mask) is at mask * minterms + value
+    uint8_t *present = calloc((size_t) minterms * minterms, 1);
+    uint8_t *merged = calloc((size_t) minterms * minterms, 1);
+    for (uint32_t m = 0; m < minterms; m++) {
+        present[m] = termsHas(terms, m);
+    }
+    size_t count = 0;
+    for (uint32_t mask = 0; mask < minterms; mask++) {
+        for (uint32_t value = 0; value < minterms; value++) {
+            size_t i = (size_t) mask * minterms + value;
+            if (!present[i]) {
+                continue;
+            }
+            for (uint32_t bit = 1; bit < minterms; bit <<= 1) {
+                size_t other = i | bit;
+                if (((mask | value) & bit) == 0 && present[other]) {
+                    present[(size_t) (mask | bit) * minterms + value] = true;
+                    merged[i] = merged[other] = true;
+                }
+            }
+            count += !merged[i];
+        }
+    }
+    JitImplicant_t *primes = malloc(MAX(count, 1) * sizeof(JitImplicant_t));
+    *numPrimes = 0;
+    for (size_t i = 0; i < (size_t) minterms * minterms; i++) {
+        if (present[i] && !merged[i]) {
+            primes[(*numPrimes)++] = (JitImplicant_t) {(uint16_t) (i % minterms),
+                                                       (uint16_t) (i / minterms)};
+        }
+    }
+    free(present);
+    free(merged);
+    return primes;
+}
+
+static inline bool termsEmpty(const JitTerms_t *terms) {
+    uint64_t any = 0;
+    for (uint32_t i = 0; i < JIT_MAX_MINTERMS / 64; i++) {
+        any |= terms->bits[i];
+    }
+    return any == 0;
+}
+
+/// Counts the minterms in both sets
+static inline uint32_t countCommonTerms(const JitTerms_t *a, const JitTerms_t *b) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < JIT_MAX_MINTERMS / 64; i++) {
+        count += (uint32_t) __builtin_popcountll(a->bits[i] & b->bits[i]);
+    }
+    return count;
+}
+
+/// Removes the minterms of one set from another
+static inline void removeTerms(JitTerms_t *terms, const JitTerms_t *removed) {
+    for (uint32_t i = 0; i < JIT_MAX_MINTERMS / 64; i++) {
+        terms->bits[i] &= ~removed->bits[i];
+    }
+}
+
+/**
+ * Minimises a boolean function into a sum of products: prime implicants covering every minterm
+ * where it's true, picking the essential ones first, then the ones covering the most minterms still
+ * uncovered.
+ * @param on the minterms where the function is true
+ * @param dontCare the minterms where it doesn't matter, which can be covered or not
+ * @param numCover where to store the number of implicants chosen, 0 if the function is never true
+ * @return the chosen implicants, to be freed by the caller
+ */
+static JitImplicant_t *minimise(uint32_t inputs, const JitTerms_t *on, const JitTerms_t *dontCare,
+                                size_t *numCover) {
+    uint32_t minterms = 1U << inputs;
+    JitTerms_t terms;
+    for (uint32_t i = 0; i < JIT_MAX_MINTERMS / 64; i++) {
+        terms.bits[i] = on->bits[i] | dontCare->bits[i];
+    }
+    size_t numPrimes;
+    JitImplicant_t *primes = findPrimeImplicants(inputs, &terms, &numPrimes);
+    JitTerms_t *covers = calloc(MAX(numPrimes, 1), sizeof(JitTerms_t));
+    for (size_t i = 0; i < numPrimes; i++) {
+        for (uint32_t m = 0; m < minterms; m++) {
+            if (implicantCovers(primes[i], m)) {
+                termsAdd(&covers[i], m);
+            }
+        }
+    }
+
+    bool *chosen = calloc(MAX(numPrimes, 1), sizeof(bool));
+    JitImplicant_t *cover = malloc(MAX(numPrimes, 1) * sizeof(JitImplicant_t));
+    *numCover = 0;
+    JitTerms_t uncovered = *on;
+    // essential prime implicants are the only ones covering some minterm
+    for (uint32_t m = 0; m < minterms; m++) {
+        if (!termsHas(on, m)) {
+            continue;
+        }
+        size_t only = numPrimes, count = 0;
+        for (size_t i = 0; i < numPrimes && count < 2; i++) {
+            if (termsHas(&covers[i], m)) {
+                only = i;
+                count++;
+            }
+        }
+        if (count == 1 && !chosen[only]) {
+            chosen[only] = true;
+            cover[(*numCover)++] = primes[only];
+            removeTerms(&uncovered, &covers[only]);
+        }
+    }
+    while (!termsEmpty(&uncovered)) {
+        size_t best = 0;
+        uint32_t bestCount = 0;
+        for (size_t i = 0; i < numPrimes; i++) {
+            uint32_t count = chosen[i] ? 0 : countCommonTerms(&covers[i], &uncovered);
+            if (count > bestCount) {
+                best = i;
+                bestCount = count;
+            }
+        }
+        chosen[best] = true;
+        cover[(*numCover)++] = primes[best];
+        removeTerms(&uncovered, &covers[best]);
+    }
+    free(primes);
+    free(covers);
+    free(chosen);
+    return cover;
+}
+
+/**
+ * Builds the function of an outer totalistic rule over the bits of the 3x3 total and the cell's
+ * state. Totals that can't happen, since they include the cell itself, are don't cares.
+ */
+static void buildTotalTerms(uint16_t birth, uint16_t survival, JitTerms_t *on,
+                            JitTerms_t *dontCare) {
+    *on = (JitTerms_t) {0};
+    *dontCare = (JitTerms_t) {0};
+    for (uint32_t m = 0; m < (1U << JIT_TOTAL_INPUTS); m++) {
+        uint32_t total = m & 0xF;
+        bool alive = (m & JIT_ALIVE) != 0;
+        if (total > 9 || (alive && total == 0) || (!alive && total == 9)) {
+            termsAdd(dontCare, m);
+        } else if (alive ? survival & (1 << (total - 1)) : birth & (1 << total)) {
+            termsAdd(on, m);
+        }
+    }
+}
+
+/**
+ * Splits an isotropic rule up by the cell's state and number of live neighbours. Most rules treat
+ * some neighbour counts the same whatever the arrangement (e.g. S12 in B2-a/S12), and those are
+ * much simpler over the 3x3 total, so they go in an outer totalistic function. The rest (e.g.
+ * B2-a) are mixed, and need the cells of the neighbourhood.
+ * @param birth, survival where to store the masks of the outer totalistic part
+ * @param mixed where to store the masks of the counts that depend on the arrangement, for dead
+ * cells in [0] and live ones in [1]
+ */
+static void splitIsotropicRule(const LifeRule_t *rule, uint16_t *birth, uint16_t *survival,
+                               uint16_t mixed[2]) {
+    // bit n is set if some cell (dead in [0], alive in [1]) with n live neighbours is alive next
+    // generation, and if some cell isn't
+    uint16_t someOn[2] = {0}, someOff[2] = {0};
+    for (uint32_t n = 0; n < LIFE_NEIGHBOURHOODS; n++) {
+        bool alive = (n & JIT_CENTRE) != 0;
+        int neighbours = __builtin_popcount(n & ~JIT_CENTRE);
+        bool next = (rule->table[n / 64] >> (n % 64)) & 1;
+        someOn[alive] |= (uint16_t) (next << neighbours);
+        someOff[alive] |= (uint16_t) (!next << neighbours);
+    }
+    *birth = someOn[0] & ~someOff[0];
+    *survival = someOn[1] & ~someOff[1];
+    for (int alive = 0; alive < 2; alive++) {
+        mixed[alive] = someOn[alive] & someOff[alive];
+    }
+}
+
+/**
+ * Builds the function over the cells of the neighbourhood for one mixed neighbour count of an
+ * isotropic rule. It's only used once the count is known to match, so every other neighbourhood is
+ * a don't care, which leaves products of just a few cells.
+ */
+static void buildCountTerms(const LifeRule_t *rule, bool alive, int neighbours, JitTerms_t *on,
+                            JitTerms_t *dontCare) {
+    *on = (JitTerms_t) {0};
+    *dontCare = (JitTerms_t) {0};
+    for (uint32_t n = 0; n < LIFE_NEIGHBOURHOODS; n++) {
+        if (((n & JIT_CENTRE) != 0) != alive || __builtin_popcount(n & ~JIT_CENTRE) != neighbours) {
+            termsAdd(dontCare, n);
+        } else if ((rule->table[n / 64] >> (n % 64)) & 1) {
+            termsAdd(on, n);
+        }
+    }
+}
+
+/**
+ * Writes a sum of products as C, e.g. "\n        | (1 & t0 & nt1)"
+ * @param names name of the variable holding each input. Its negation is the name prefixed by n.
+ * @param indent what to start each product's line with
+ */
+static void writeProducts(FILE *out, const JitImplicant_t *cover, size_t numCover, uint32_t inputs,
+                          const char *const *names, const char *indent) {
+    for (size_t i = 0; i < numCover; i++) {
+        fprintf(out, "\n%s| (1", indent);
+        for (uint32_t input = 0; input < inputs; input++) {
+            if (!(cover[i].mask & (1 << input))) {
+                fprintf(out, cover[i].value & (1 << input) ? " & %s" : " & n%s", names[input]);
+            }
+        }
+        fprintf(out, ")");
+    }
+}
+
+/// Names of the inputs of an outer totalistic rule's function in the generated code
+static const char *const totalNames[JIT_TOTAL_INPUTS] = {"t0", "t1", "t2", "t3", "a"};
+
+/**
+ * Names of the cells of a neighbourhood in the generated code, by their bit (see LifeRule_t): the
+ * left, centre and right columns are l, c and r, and the rows above, the cell's and below are 0, 1
+ * and 2
+ */
+static const char *const neighbourhoodNames[JIT_MAX_INPUTS] = {
+    "r0", "r1", "r2", "c0", "c1", "c2", "l0", "l1", "l2",
+};
+
+/// Writes the variables applyRule() needs for the outer totalistic part of a rule, given t and a
+static void writeTotalInputs(FILE *out) {
+    fprintf(out, "    uint8_t t0 = t & 1, t1 = (t >> 1) & 1, t2 = (t >> 2) & 1, t3 = t >> 3;\n"
+                 "    uint8_t nt0 = t0 ^ 1, nt1 = t1 ^ 1, nt2 = t2 ^ 1, nt3 = t3 ^ 1, "
+                 "na = a ^ 1;\n");
+}
+
+/**
+ * Generates the C source of a row update. The rule is a sum of products over the bits of the 3x3
+ * total and the cell's state, and the rest is the same row update as the OpenMP kernel's, with the
+ * topology baked in. For isotropic rules, applyRule() takes the 9 cells of the neighbourhood
+ * instead, and each neighbour count that depends on the arrangement of the neighbours adds a sum of
+ * products over the cells, for when the cell has that many.
+ * @return the source, to be freed by the caller, or NULL if it couldn't be generated
+ */
+static char *generateSource(const LifeRule_t *rule, LifeTopology_t topology) {
+    char *source = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&source, &size);
+    if (out == NULL) {
+        return NULL;
+    }
+    char ruleName[LIFE_MAX_RULE_STRING];
+    lifeFormatRule(rule, ruleName);
+    bool torus = topology == LIFE_TOPOLOGY_TORUS;
+
+    fprintf(out, "// Row update for %s on a %s grid, generated by gameoflife (jit version %d)\n"
+                 "#include <stdint.h>\n\n", ruleName, lifeGetTopologyName(topology), JIT_VERSION);
+    JitTerms_t on, dontCare;
+    uint16_t mixed[2] = {0};
+    if (rule->isotropic) {
+        uint16_t birth, survival;
+        splitIsotropicRule(rule, &birth, &survival, mixed);
+        buildTotalTerms(birth, survival, &on, &dontCare);
+        // big rules aren't inlined otherwise, and the row loop only vectorises if it is
+        fprintf(out, "static inline __attribute__((always_inline)) uint8_t applyRule(\n"
+                     "        uint8_t l0, uint8_t l1, uint8_t l2, uint8_t c0, uint8_t c1, "
+                     "uint8_t c2, uint8_t r0,\n"
+                     "        uint8_t r1, uint8_t r2) {\n"
+                     "    uint8_t t = l0 + l1 + l2 + c0 + c1 + c2 + r0 + r1 + r2, a = c1, "
+                     "count = t - a;\n");
+        writeTotalInputs(out);
+        fprintf(out, "    uint8_t nl0 = l0 ^ 1, nl1 = l1 ^ 1, nl2 = l2 ^ 1, nc0 = c0 ^ 1, "
+                     "nc1 = c1 ^ 1,\n"
+                     "            nc2 = c2 ^ 1, nr0 = r0 ^ 1, nr1 = r1 ^ 1, nr2 = r2 ^ 1;\n"
+                     "    return 0");
+    } else {
+        buildTotalTerms(rule->birth, rule->survival, &on, &dontCare);
+        fprintf(out, "static inline uint8_t applyRule(uint8_t t, uint8_t a) {\n");
+        writeTotalInputs(out);
+        fprintf(out, "    return 0");
+    }
+    size_t numCover;
+    JitImplicant_t *cover = minimise(JIT_TOTAL_INPUTS, &on, &dontCare, &numCover);
+    writeProducts(out, cover, numCover, JIT_TOTAL_INPUTS, totalNames, "        ");
+    free(cover);
+    // then the neighbour counts of isotropic rules that depend on the arrangement of the neighbours
+    for (int alive = 0; alive < 2; alive++) {
+        for (int neighbours = 0; neighbours <= 8; neighbours++) {
+            if (!((mixed[alive] >> neighbours) & 1)) {
+                continue;
+            }
+            buildCountTerms(rule, alive, neighbours, &on, &dontCare);
+            cover = minimise(JIT_MAX_INPUTS, &on, &dontCare, &numCover);
+            fprintf(out, "\n        | (%s & (count == %d) & (0", alive ? "a" : "na", neighbours);
+            writeProducts(out, cover, numCover, JIT_MAX_INPUTS, neighbourhoodNames,
+                          "            ");
+            fprintf(out, "))");
+            free(cover);
+        }
+    }
+    fprintf(out, ";\n}\n\n");
+
+    fprintf(out, "void " JIT_SYMBOL "(const uint8_t *restrict above, const uint8_t *restrict row,\n"
+                 "                  const uint8_t *restrict below, uint8_t *restrict next,\n"
+                 "                  uint32_t w) {\n");
+    if (rule->isotropic) {
+        // the neighbourhood of each cell is passed in a column at a time, left to right
+        fprintf(out, "#define COLUMN(x) above[x], row[x], below[x]\n"
+                     "    uint8_t la = %s, lr = %s, lb = %s;\n"
+                     "    uint8_t ra = %s, rr = %s, rb = %s;\n"
+                     "    if (w == 1) {\n"
+                     "        next[0] = applyRule(la, lr, lb, COLUMN(0), ra, rr, rb);\n"
+                     "        return;\n"
+                     "    }\n"
+                     "    next[0] = applyRule(la, lr, lb, COLUMN(0), COLUMN(1));\n"
+                     "    for (uint32_t x = 1; x < w - 1; x++) {\n"
+                     "        next[x] = applyRule(COLUMN(x - 1), COLUMN(x), COLUMN(x + 1));\n"
+                     "    }\n"
+                     "    next[w - 1] = applyRule(COLUMN(w - 2), COLUMN(w - 1), ra, rr, rb);\n"
+                     "}\n",
+                torus ? "above[w - 1]" : "0", torus ? "row[w - 1]" : "0",
+                torus ? "below[w - 1]" : "0", torus ? "above[0]" : "0", torus ? "row[0]" : "0",
+                torus ? "below[0]" : "0");
+    } else {
+        fprintf(out, "    uint8_t first = above[0] + row[0] + below[0];\n"
+                     "    uint8_t last = above[w - 1] + row[w - 1] + below[w - 1];\n"
+                     "    uint8_t beforeFirst = %s, afterLast = %s;\n"
+                     "    if (w == 1) {\n"
+                     "        next[0] = applyRule(beforeFirst + first + afterLast, row[0]);\n"
+                     "        return;\n"
+                     "    }\n"
+                     "    next[0] = applyRule(beforeFirst + first + above[1] + row[1] + below[1],\n"
+                     "                        row[0]);\n"
+                     "    for (uint32_t x = 1; x < w - 1; x++) {\n"
+                     "        uint8_t t = above[x - 1] + above[x] + above[x + 1]\n"
+                     "                + row[x - 1] + row[x] + row[x + 1]\n"
+                     "                + below[x - 1] + below[x] + below[x + 1];\n"
+                     "        next[x] = applyRule(t, row[x]);\n"
+                     "    }\n"
+                     "    next[w - 1] = applyRule(above[w - 2] + row[w - 2] + below[w - 2] + last\n"
+                     "                            + afterLast, row[w - 1]);\n"
+                     "}\n", torus ? "last" : "0", torus ? "first" : "0");
+    }
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0 || failed) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+/// Starting value of a 64 bit FNV-1a hash
+#define JIT_HASH_BASIS 0xCBF29CE484222325ULL
+
+/// Adds some bytes to a 64 bit FNV-1a hash
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ((const uint8_t *) data)[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/// Adds a string, including its terminator, to a 64 bit FNV-1a hash
+static uint64_t hashString(uint64_t hash, const char *s) {
+    return hashBytes(hash, s, strlen(s) + 1);
+}
+
+/**
+ * Adds the instruction set extensions of the CPU we're running on to a hash. Libraries are compiled
+ * with -march=native, so one built on another machine sharing the cache (e.g. through an NFS home
+ * directory) may use instructions this one doesn't have. On x86 these are the cpuid leaves listing
+ * extensions, and the register state the OS saves (AVX and AVX-512 need both). Elsewhere they're
+ * the lines of /proc/cpuinfo describing the CPU.
+ */
+static uint64_t hashTarget(uint64_t hash) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t regs[4];
+    // vendor, then signature and features (leaf 1's ebx is left out, since it varies per core)
+    __cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+    uint32_t maxLeaf = regs[0];
+    hash = hashBytes(hash, regs, sizeof(regs));
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+    bool osxsave = (regs[2] >> 27) & 1;
+    regs[1] = 0;
+    hash = hashBytes(hash, regs, sizeof(regs));
+    if (maxLeaf >= 7) {
+        __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+        hash = hashBytes(hash, regs, sizeof(regs));
+        __cpuid_count(7, 1, regs[0], regs[1], regs[2], regs[3]);
+        hash = hashBytes(hash, regs, sizeof(regs));
+    }
+    if (__get_cpuid(0x80000001, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        hash = hashBytes(hash, &regs[2], 2 * sizeof(uint32_t));
+    }
+    if (osxsave) {
+        uint32_t low, high;
+        __asm__ ("xgetbv" : "=a" (low), "=d" (high) : "c" (0));
+        hash = hashBytes(hash, &low, sizeof(low));
+    }
+#else
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL) {
+        return hash;
+    }
+    static const char *const keys[] = {"Features", "flags", "isa", "CPU implementer",
+                                       "CPU architecture", "CPU variant", "CPU part", "cpu\t",
+                                       "model name"};
+    char line[4096];
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (strncmp(line, keys[i], strlen(keys[i])) == 0) {
+                hash = hashString(hash, line);
+            }
+        }
+    }
+    fclose(cpuinfo);
+#endif
+    return hash;
+}
+
+/// Creates a directory and any missing parents, returning false if it couldn't be created
+static bool makeDirectories(char *path) {
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+            *p = '/';
+            if (!ok) {
+                return false;
+            }
+        }
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+/// Works out the cache directory, returning false if there's nowhere to put it
+static bool getCacheDirectory(char *dir, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+    if (xdg != NULL && xdg[0] == '/') {
+        length = snprintf(dir, size, "%s/gameoflife", xdg);
+    } else if (home != NULL && home[0] != '\0') {
+        length = snprintf(dir, size, "%s/.cache/gameoflife", home);
+    } else {
+        return false;
+    }
+    return length > 0 && (size_t) length < size;
+}
+
+/**
+ * Compiles the source into a shared library. Both go to temporary files first, and the library is
+ * renamed into place once it's complete, so other processes never load a partly written one.
+ * @return true on success, false (after logging why) on failure
+ */
+static bool compileLibrary(const char *source, const char *library) {
+    const char *cc = getenv("CC");
+    if (cc == NULL || cc[0] == '\0') {
+        cc = "cc";
+    }
+    char sourcePath[4096], tmpPath[4096];
+    snprintf(sourcePath, sizeof(sourcePath), "%s.%d.c", library, getpid());
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", library, getpid());
+
+    FILE *out = fopen(sourcePath, "w");
+    if (out == NULL) {
+        log_error("Failed to write %s: %s", sourcePath, strerror(errno));
+        return false;
+    }
+    bool written = fputs(source, out) >= 0;
+    if (fclose(out) != 0 || !written) {
+        log_error("Failed to write %s: %s", sourcePath, strerror(errno));
+        unlink(sourcePath);
+        return false;
+    }
+
+    double begin = utilsGetTime();
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execlp(cc, cc, JIT_CFLAGS, "-o", tmpPath, sourcePath, (char *) NULL);
+        _exit(127);
+    }
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+    unlink(sourcePath);
+    if (!ok) {
+        log_error("Failed to compile row update with %s (exit status %d)", cc,
+                  WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        unlink(tmpPath);
+        return false;
+    } else if (rename(tmpPath, library) != 0) {
+        log_error("Failed to move %s to %s: %s", tmpPath, library, strerror(errno));
+        unlink(tmpPath);
+        return false;
+    }
+    log_info("Compiled %s in %.1f ms", library, (utilsGetTime() - begin) * 1000.0);
+    return true;
+}
+
+/// Gets a row update with the lock held, see jitGetRowKernel()
+static JitRowKernel_t loadRowKernel(const LifeRule_t *rule, LifeTopology_t topology) {
+    char *source = generateSource(rule, topology);
+    if (source == NULL) {
+        log_error("Failed to generate row update source");
+        return NULL;
+    }
+    // the compiler and CPU are part of the key too, since the library is built by one for the other
+    uint64_t hash = hashString(JIT_HASH_BASIS, source);
+    hash = hashString(hash, getenv("CC") != NULL ? getenv("CC") : "cc");
+    hash = hashTarget(hash);
+    for (size_t i = 0; i < numLoaded; i++) {
+        if (loaded[i].hash == hash) {
+            free(source);
+            return loaded[i].kernel;
+        }
+    }
+
+    // room for the file name after the directory
+    char dir[4096], library[4096 + 64 + LIFE_MAX_RULE_STRING], ruleName[LIFE_MAX_RULE_STRING];
+    if (!getCacheDirectory(dir, sizeof(dir)) || !makeDirectories(dir)) {
+        log_error("Failed to create cache directory for compiled row updates: %s",
+                  strerror(errno));
+        free(source);
+        return NULL;
+    }
+    lifeFormatRule(rule, ruleName);
+    // "/" can't go in a file name
+    for (char *c = ruleName; *c != '\0'; c++) {
+        *c = *c == '/' ? '_' : *c;
+    }
+    snprintf(library, sizeof(library), "%s/%s-%s-%016" PRIx64 ".so", dir, ruleName,
+             lifeGetTopologyName(topology), hash);
+
+    bool ok = access(library, R_OK) == 0 || compileLibrary(source, library);
+    free(source);
+    if (!ok) {
+        return NULL;
+    }
+    void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        log_error("Failed to load %s: %s", library, dlerror());
+        return NULL;
+    }
+    JitRowKernel_t kernel = (JitRowKernel_t) dlsym(handle, JIT_SYMBOL);
+    if (kernel == NULL) {
+        log_error("Failed to find " JIT_SYMBOL " in %s: %s", library, dlerror());
+        dlclose(handle);
+        return NULL;
+    }
+    // libraries stay loaded for the life of the process, since worlds may be using them
+    loaded = realloc(loaded, (numLoaded + 1) * sizeof(JitLoaded_t));
+    loaded[numLoaded++] = (JitLoaded_t) {hash, kernel};
+    log_debug("Loaded row update from %s", library);
+    return kernel;
+}
+
+JitRowKernel_t jitGetRowKernel(const LifeRule_t *rule, LifeTopology_t topology) {
+    pthread_mutex_lock(&loadedLock);
+    JitRowKernel_t kernel = loadRowKernel(rule, topology);
+    pthread_mutex_unlock(&loadedLock);
+    return kernel;
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Row updates generated and compiled at runtime, for rules without a specialised kernel. The rule
+// is turned into a minimised boolean circuit over the bits of each cell's neighbourhood total (and
+// for isotropic rules, the cells of its neighbourhood), written out as C, compiled with the system
+// C compiler into a shared library, and loaded with dlopen. Libraries are cached, so each rule is
+// only compiled once per machine.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "life.h"
+
+/// Version of the generated code, part of the cache key so old libraries aren't loaded
+#define JIT_VERSION 2
+
+/**
+ * Row update compiled at runtime. Works out the next generation of a row of width cells (one byte
+ * each) into next, given the rows above and below it.
+ */
+typedef void (*JitRowKernel_t)(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                               uint8_t *next, uint32_t width);
+
+/**
+ * Gets the row update for a rule and topology, generating and compiling it if it isn't already
+ * cached. The compiler is $CC, or cc if that isn't set, and libraries are cached in
+ * $XDG_CACHE_HOME/gameoflife (or ~/.cache/gameoflife) under a hash of their source, the compiler
+ * and the CPU's instruction set extensions. Safe to call from several threads at once, and each
+ * row update is only loaded once per process.
+ * @return the row update, or NULL (after logging why) if it couldn't be compiled or loaded
+ */
+JitRowKernel_t jitGetRowKernel(const LifeRule_t *rule, LifeTopology_t topology);
@@ -4,37 +4,257 @@
 // If a copy of the MPL was not distributed with this file, You can obtain one at
 // http://mozilla.org/MPL/2.0/.
 #include "life.h"
+#include "defines.h"
 #include "log.h"
 #include "utils.h"
+#include "trace.h"
+#include "stream.h"
+#include "jit.h"
+#include "generations.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
-/// Game of Life field. Stored as a 1D array, although it's actually 2D. True if cell is active,
-/// false if it's dead.
-static bool *grid = NULL;
-/// Field copy, used for updating
-static bool *nextGrid = NULL;
-/// Pixel data for SDL
-static uint32_t *pixelData = NULL;
-/// Field width and height in cells
-static uint32_t gridWidth = 0, gridHeight = 0;
-/// Current generation we are on
-static uint64_t generations = 0;
+/// Works out the next generation of one row of a world into nextGrid. zeroRow is a row of dead
+/// cells the width of the grid, standing in for the rows above and below a bounded grid.
+typedef void (*LifeRowKernel_t)(LifeWorld_t *world, uint32_t y, const bool *zeroRow);
+
+/// Everything about one simulation, so that any number of them can run at once
+struct LifeWorld {
+    /// Game of Life field. Stored as a 1D array, although it's actually 2D. True if cell is
+    /// active, false if it's dead.
+    bool *grid;
+    /// Field copy, used for updating
+    bool *nextGrid;
+    /// Field width and height in cells
+    uint32_t width, height;
+    /// Current generation we are on
+    uint64_t generations;
+    /// How the edges of the grid behave
+    LifeTopology_t topology;
+    /// Kernel used by lifeWorldUpdate() and lifeWorldUpdateMulti()
+    LifeKernel_t kernel;
+    /// Rule the world runs
+    LifeRule_t rule;
+    /// Row update used by the OpenMP kernel, specialised for the rule and topology
+    LifeRowKernel_t rowKernel;
+    /// Row update compiled at runtime for the JIT kernel, or NULL if it hasn't been loaded yet
+    JitRowKernel_t jitRowKernel;
+    /// True if the JIT kernel couldn't compile a row update for the rule, so it uses rowKernel
+    /// instead and compiling isn't tried every update
+    bool jitFailed;
+    /**
+     * Cell states for Generations rules, NULL for two-state rules. The states are what get updated,
+     * and the grid is rewritten with just the live cells after each update, so everything that
+     * only cares about live cells (population, exports, snapshots) works as for any other rule.
+     */
+    GenerationsWorld_t *states;
+    /// True if the grid has been written to since the states were last brought into line with it,
+    /// e.g. by loading a pattern, so they have to be before the next update
+    bool statesStale;
+};
+
+/// World used by the functions that don't take one, created by lifeInit()
+static LifeWorld_t *defaultWorld = NULL;
+/// Kernel and topology lifeInit() gives the default world, so they can be chosen beforehand
+static LifeKernel_t defaultKernel = LIFE_KERNEL_OMP;
+static LifeTopology_t defaultTopology = LIFE_TOPOLOGY_BOUNDED;
+/// Rule lifeInit() gives the default world, LIFE_RULE unless lifeSetRule() says otherwise
+static LifeRule_t defaultRule = {.birth = 1 << 3, .survival = (1 << 2) | (1 << 3)};
 
 typedef struct {
     uint32_t x, y;
 } Point_t;
 
+/// A chunk of the body of an RLE file, decoded independently of the others
+typedef struct {
+    /// Bytes making up the chunk
+    const char *begin, *end;
+    /// Rows advanced by "$" tags in the chunk
+    uint64_t rows;
+    /// Cells after the last "$" in the chunk, or all cells in the chunk if it has no "$"
+    uint64_t tailCells;
+    /// Position in the grid the chunk starts decoding at
+    uint64_t startX, startY;
+    /// Run length read at the end of the chunk whose tag is in the next chunk, 0 if none. Only
+    /// happens when decoding a stream block by block, since parallel chunks are split after tags.
+    uint64_t count;
+    /// First letter of a multi-state tag (e.g. the "p" of "pA") read at the end of the chunk, 0 if
+    /// none. As with count, only happens when decoding a stream block by block.
+    char prefix;
+    /// True if the chunk contains the "!" that ends the pattern
+    bool finished;
+    /// Where decoding failed, or NULL if it succeeded
+    const char *error;
+    /// Reason decoding failed
+    const char *errorReason;
+} RLEChunk_t;
+
+/// Pattern file formats that can be loaded
 typedef enum {
-    /// Accept a number
-    PARSE_NUM = 0,
-    /// Accept a tag: b, o, $
-    PARSE_TAG,
-} RLEParseState_t;
+    PATTERN_PLAINTEXT = 0,
+    PATTERN_RLE,
+    PATTERN_MACROCELL
+} PatternFormat_t;
+
+typedef struct {
+    /// Name used to select the kernel on the command line
+    const char *name;
+    /// Advances the grid by the given number of generations
+    void (*update)(LifeWorld_t *world, uint32_t steps);
+} LifeKernelInfo_t;
+
+/// Header at the start of a snapshot file. Fields are stored in native (little endian) byte order.
+typedef struct {
+    /// SNAPSHOT_MAGIC, including the null terminator
+    char magic[8];
+    /// LIFE_SNAPSHOT_VERSION
+    uint32_t version;
+    /// Size of this header in bytes, i.e. the offset of the payload
+    uint32_t headerSize;
+    /// Grid size in cells
+    uint32_t width, height;
+    /// Generation the snapshot was taken on
+    uint64_t generations;
+    /// Rule in B/S notation, null terminated. Empty if it doesn't fit, in which case the rule
+    /// follows the header instead (see getSnapshotRule()), and older versions reject it as unknown.
+    char rule[32];
+    /// LifeTopology_t
+    uint32_t topology;
+    /// Bytes per row in the payload. Cells are packed 8 to a byte, least significant bit first.
+    uint32_t rowBytes;
+    /**
+     * Size of the payload in bytes. The payload is a bit plane per bit of the cells' states (see
+     * snapshotPlanes()), one after the other, each rowBytes * height bytes. Plane k holds bit k of
+     * each cell's state, so two-state rules have one plane of the live cells. Version 1 snapshots
+     * always have one plane, even for Generations rules.
+     */
+    uint64_t payloadSize;
+} SnapshotHeader_t;
+_Static_assert(sizeof(SnapshotHeader_t) == 80, "snapshot header must not contain padding");
+
+/// Magic number identifying a snapshot file
+#define SNAPSHOT_MAGIC "GOLSNAP"
+
+/**
+ * Finds the rule of a snapshot, which is in the header unless it's too long (e.g. an isotropic
+ * rule with lots of letters), in which case it's stored between the header and the payload
+ * @param data contents of the file, which must be at least the size of its header
+ * @return the null terminated rule, or NULL if it isn't terminated
+ */
+static const char *getSnapshotRule(const char *data) {
+    const SnapshotHeader_t *header = (const SnapshotHeader_t *) data;
+    const char *rule = header->rule;
+    size_t length = sizeof(header->rule);
+    if (header->rule[0] == '\0') {
+        rule = data + sizeof(SnapshotHeader_t);
+        length = header->headerSize - sizeof(SnapshotHeader_t);
+    }
+    return memchr(rule, '\0', length) == NULL ? NULL : rule;
+}
+
+/// A node of a macrocell quadtree
+typedef struct {
+    /// The node covers 2^level by 2^level cells, leaves are level 3 (8x8)
+    uint32_t level;
+    /// Child nodes (nw, ne, sw, se) of non-leaf nodes, 0 for an all-dead child
+    uint32_t children[4];
+    /// Cells of leaf nodes, cell (x,y) is bit x + 8y
+    uint64_t cells;
+    /// Bounding box of the live cells, relative to the top left of the node
+    uint64_t minX, minY, maxX, maxY;
+    /// True if the node has no live cells
+    bool empty;
+} MacrocellNode_t;
+
+/// A macrocell quadtree, stored as a table of nodes numbered as in the file, with the root last.
+/// Identical subtrees are stored once and referred to by number wherever they appear.
+typedef struct {
+    MacrocellNode_t *nodes;
+    uint32_t count, capacity;
+} MacrocellTree_t;
+
+/// A pattern file opened by lifeOpenPattern(), which has read as much of it as it takes to size it
+struct LifePattern {
+    /// The file, left open at the body for RLE patterns and closed once the others are read
+    Stream_t stream;
+    /// Name of the file, for error messages
+    const char *filename;
+    PatternFormat_t format;
+    /// Size of the pattern in cells, if sized is true
+    uint32_t width, height;
+    bool sized;
+    /// True once the pattern has been inserted, since an RLE pattern's body can only be read once
+    bool inserted;
+    /// Macrocell patterns: the whole tree, which had to be parsed to find the size
+    MacrocellTree_t tree;
+    /// Plain text patterns: every row, packed 8 cells to a byte with each row starting on a new
+    /// byte, since all the lines had to be read to find the size
+    uint8_t *packed;
+    size_t packedSize, packedCapacity;
+    /// Plain text patterns: length of each row in cells
+    uint32_t *rowLengths;
+    uint32_t rowCapacity;
+};
+
+/// Entry in the hash table used to share identical nodes when exporting a macrocell file
+typedef struct {
+    /// Same as MacrocellNode_t
+    uint32_t level;
+    uint32_t children[4];
+    uint64_t cells;
+    /// Number of the node in the file, or 0 if the slot is free
+    uint32_t index;
+} MacrocellEntry_t;
+
+/// Buffered output for exporting patterns
+typedef struct {
+    /// File being written
+    int fd;
+    /// Output not yet written to the file
+    char *buffer;
+    /// Bytes used in the buffer
+    size_t used;
+    /// Characters written to the current line, for wrapping RLE output
+    uint32_t column;
+    /// True if writing to the file has failed
+    bool failed;
+} ExportWriter_t;
+
+/// Size of the export output buffer
+#define EXPORT_BUFFER_SIZE (1024 * 1024)
+/// RLE lines are wrapped at this many characters
+#define RLE_LINE_LENGTH 70
+
+/// Deepest macrocell node we accept, so node sizes and offsets fit in 64 bits
+#define MACROCELL_MAX_LEVEL 62
+/// Macrocell nodes at least this level are painted into the grid as separate OpenMP tasks
+#define MACROCELL_TASK_LEVEL 8
+
+/// RLE bodies at least this big are decoded in parallel
+#define RLE_PARALLEL_MIN_BYTES (1024 * 1024)
+
+/// Soup cells are generated 4 at a time, 16 random bits each, from one 64 bit random number
+#define SOUP_CELLS_PER_WORD 4
+/// Number of distinct soup densities, i.e. the range of each cell's random number
+#define SOUP_DENSITY_STEPS 65536.0
+/// Step between splitmix64 states (the golden ratio)
+#define SOUP_GAMMA 0x9E3779B97F4A7C15ULL
+
+/// Bit of a neighbourhood (see LifeRule_t) holding the cell at column c and row r of it
+#define NEIGHBOURHOOD_BIT(c, r) (3 * (2 - (c)) + (r))
 
 #define NUM_DIRECTIONS 8
 static const Point_t directions[NUM_DIRECTIONS] = {{-1, -1},
@@ -47,6 +267,30 @@ static const Point_t directions[NUM_DIRECTIONS] = {{-1, -1},
                                                    {1,  1}
 };
 
+/// A letter of Hensel notation, which tells apart the different arrangements of a number of live
+/// neighbours, up to rotation and reflection
+typedef struct {
+    /// Number of live neighbours, from 1 to 4. Arrangements of 5 to 7 have the letter of their
+    /// complement.
+    uint32_t count;
+    char letter;
+    /// One of the arrangements with the letter. Bits 0 to 7 are the neighbours going clockwise from
+    /// the one above: N, NE, E, SE, S, SW, W, NW.
+    uint8_t neighbours;
+} HenselLetter_t;
+
+/// Every Hensel notation letter, as in https://conwaylife.com/wiki/Isotropic_non-totalistic_rule
+static const HenselLetter_t henselLetters[] = {
+    {1, 'c', 0x02}, {1, 'e', 0x01},
+    {2, 'a', 0x03}, {2, 'c', 0x0A}, {2, 'e', 0x05}, {2, 'i', 0x11}, {2, 'k', 0x09}, {2, 'n', 0x22},
+    {3, 'a', 0x07}, {3, 'c', 0x2A}, {3, 'e', 0x15}, {3, 'i', 0x83}, {3, 'j', 0x43}, {3, 'k', 0x25},
+    {3, 'n', 0x0B}, {3, 'q', 0x23}, {3, 'r', 0x13}, {3, 'y', 0x29},
+    {4, 'a', 0x0F}, {4, 'c', 0xAA}, {4, 'e', 0x55}, {4, 'i', 0x1B}, {4, 'j', 0x53}, {4, 'k', 0x4B},
+    {4, 'n', 0x8B}, {4, 'q', 0x27}, {4, 'r', 0x17}, {4, 't', 0x93}, {4, 'w', 0x63}, {4, 'y', 0x2B},
+    {4, 'z', 0x33},
+};
+#define NUM_HENSEL_LETTERS (sizeof(henselLetters) / sizeof(henselLetters[0]))
+
 /**
  * Sets a cell in Game of Life, accounting for out of bounds
  * @param gridPtr pointer to grid to update
@@ -55,284 +299,2860 @@ static const Point_t directions[NUM_DIRECTIONS] = {{-1, -1},
  * @param value true if cell alive, false if cell dead
  * @return true if the cell could be set successfully, else false
  */
-static inline bool setCell(bool *gridPtr, uint32_t x, uint32_t y, bool value) {
-    if (x < 0 || y < 0 || x >= gridWidth || y >= gridHeight) {
+static inline bool setCell(const LifeWorld_t *world, bool *gridPtr, uint32_t x, uint32_t y,
+                           bool value) {
+    if (x < 0 || y < 0 || x >= world->width || y >= world->height) {
         // out of bounds
         return false;
     }
-    gridPtr[x + gridWidth * y] = value;
+    gridPtr[x + world->width * y] = value;
     return true;
 }
 
 /// Gets a cell from the GoL field, accounting for wrapping
-static inline bool getCell(uint32_t x, uint32_t y) {
-    if (x < 0 || y < 0 || x >= gridWidth || y >= gridHeight) {
+static inline bool getCell(const LifeWorld_t *world, uint32_t x, uint32_t y) {
+    if (world->topology == LIFE_TOPOLOGY_TORUS) {
+        // neighbours are at most one cell off the grid, and one cell off the left or top edge has
+        // wrapped round to UINT32_MAX
+        x = x == UINT32_MAX ? world->width - 1 : x == world->width ? 0 : x;
+        y = y == UINT32_MAX ? world->height - 1 : y == world->height ? 0 : y;
+        return world->grid[x + (size_t) world->width * y];
+    }
+    if (x < 0 || y < 0 || x >= world->width || y >= world->height) {
         // out of bounds
         return 0;
     }
-    return grid[x + gridWidth * y];
+    return world->grid[x + world->width * y];
 }
 
 /// Like getCell but does not do any bounds checking
-static inline bool getCellUnsafe(uint32_t x, uint32_t y) {
-    return grid[x + gridWidth * y];
+static inline bool getCellUnsafe(const LifeWorld_t *world, uint32_t x, uint32_t y) {
+    return world->grid[x + world->width * y];
 }
 
 /// Like setCelll but does not do any bounds checking
-static inline void setCellUnsafe(bool *gridPtr, uint32_t x, uint32_t y, bool value) {
-    gridPtr[x + gridWidth * y] = value;
+static inline void setCellUnsafe(const LifeWorld_t *world, bool *gridPtr, uint32_t x, uint32_t y,
+                                 bool value) {
+    gridPtr[x + world->width * y] = value;
 }
 
 /**
- * Insert multiple cells into the grid.
+ * Insert a run of cells into a row of the grid. The bounds are checked once for the whole run,
+ * then the cells are written in bulk.
  * @param gridPtr pointer to the grid to update
- * @param x pointer to the current x position in the grid
+ * @param x pointer to the current x position in the grid, advanced past the run
  * @param y current y position in the grid
  * @param count how many cells to insert
  * @param value true if cell
+ * @return true if the cells could be set, false if the run is out of bounds
  */
-static void setCellMultiple(bool *gridPtr, uint32_t *x, uint32_t y, uint32_t count, bool value) {
-    log_trace("Emitting %u %s cells starting at %u,%u", count, value ? "alive" : "dead", *x, y);
-    for (uint32_t i = 0; i < count; i++) {
-        if (!setCell(gridPtr, (*x)++, y, value)) {
-            log_error("Failed to insert cell for RLE at %u,%u", *(x) - 1, y);
-            log_error("Please check the current grid size of %ux%u is large enough to hold the "
-                      "pattern.", gridWidth, gridHeight);
-            exit(1);
-        }
+static inline bool setCellMultiple(const LifeWorld_t *world, bool *gridPtr, uint64_t *x,
+                                   uint64_t y, uint64_t count, bool value) {
+    if (y >= world->height || *x + count > world->width) {
+        return false;
+    }
+    memset(&gridPtr[*x + (size_t) world->width * y], value, count * sizeof(bool));
+    *x += count;
+    return true;
+}
+
+/**
+ * Allocates a zeroed grid of cells. Grids are mapped directly (rather than calloc'd) so that they
+ * can be backed by transparent huge pages, which cuts the page faults taken when loading big
+ * patterns and the TLB misses taken when updating big grids.
+ * @return the grid, or NULL (after logging why) if it couldn't be allocated
+ */
+static bool *allocGrid(size_t cells) {
+    size_t size = MAX(cells, 1) * sizeof(bool);
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        log_error("Failed to allocate grid of %zu cells: %s", cells, strerror(errno));
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    return mem;
+}
+
+/// Frees a grid allocated with allocGrid()
+static void freeGrid(bool *gridPtr, size_t cells) {
+    if (gridPtr != NULL) {
+        munmap(gridPtr, MAX(cells, 1) * sizeof(bool));
+    }
+}
+
+/**
+ * Notes that the grid has been written to, so a Generations world's states have to be brought into
+ * line with it before the next update (see LifeWorld_t)
+ * @param replaced true if the whole grid was replaced, so any dying cells are gone as well
+ */
+static void invalidateStates(LifeWorld_t *world, bool replaced) {
+    if (replaced && world->states != NULL) {
+        generationsClear(world->states);
     }
+    world->statesStale = true;
 }
 
 /// Calculates the sum of the neighbours of a cell in the GoL field
-static inline uint8_t sumNeighbours(uint32_t x, uint32_t y) {
+static inline uint8_t sumNeighbours(const LifeWorld_t *world, uint32_t x, uint32_t y) {
     uint8_t count = 0;
     for (int i = 0; i < NUM_DIRECTIONS; i++) {
         uint32_t dx = directions[i].x;
         uint32_t dy = directions[i].y;
         // need to use bounds checked getCell here because neighbours could be out of the grid
-        if (getCell(x + dx, y + dy)) {
+        if (getCell(world, x + dx, y + dy)) {
             count++;
         }
     }
     return count;
 }
 
-void lifeInit(uint32_t width, uint32_t height) {
-    if (width < 0 || height < 0) {
-        log_error("Invalid grid size %dx%d", width, height);
-        exit(1);
+/// Swaps grid and nextGrid after a generation has been computed into nextGrid
+static inline void swapGrids(LifeWorld_t *world) {
+    // optimisation: swap the buffers instead of copying nextGrid back into grid, since every
+    // cell of nextGrid gets overwritten on the next step anyway
+    bool *tmp = world->grid;
+    world->grid = world->nextGrid;
+    world->nextGrid = tmp;
+    world->generations++;
+}
+
+/// Looks up the next state of a cell with the given neighbourhood in an isotropic rule's table
+static inline bool lookupNeighbourhood(const LifeRule_t *rule, uint32_t neighbourhood) {
+    return (rule->table[neighbourhood / 64] >> (neighbourhood % 64)) & 1;
+}
+
+/// Gets the neighbourhood of a cell (see LifeRule_t), accounting for wrapping
+static inline uint32_t getCellNeighbourhood(const LifeWorld_t *world, uint32_t x, uint32_t y) {
+    uint32_t neighbourhood = 0;
+    for (uint32_t c = 0; c < 3; c++) {
+        for (uint32_t r = 0; r < 3; r++) {
+            // as in sumNeighbours, x - 1 and y - 1 wrap round to UINT32_MAX off the top left
+            neighbourhood |= (uint32_t) getCell(world, x + c - 1, y + r - 1)
+                    << NEIGHBOURHOOD_BIT(c, r);
+        }
     }
-    grid = calloc(width * height, sizeof(bool));
-    nextGrid = calloc(width * height, sizeof(bool));
-    pixelData = calloc(width * height, sizeof(uint32_t));
-    gridWidth = width;
-    gridHeight = height;
-    log_info("Initialised %ux%u grid", width, height);
+    return neighbourhood;
 }
 
-void lifeUpdate(void) {
-    // 1. Calculate neighbours
-    // optimisation: do step 1 and 2 in the same loop
-#pragma omp parallel for default(none) shared(gridHeight, gridWidth, nextGrid)
-    for (uint32_t y = 0; y < gridHeight; y++) {
-        for (uint32_t x = 0; x < gridWidth; x++) {
-            // get neighbour count
-            uint8_t neighbours = sumNeighbours(x, y);
-            bool alive = getCellUnsafe(x, y);
+/// Reference kernel: single threaded and straight from the definition. Slow, but obviously correct,
+/// so this is what the other kernels get checked against.
+static void updateReference(LifeWorld_t *world, uint32_t steps) {
+    for (uint32_t i = 0; i < steps; i++) {
+        for (uint32_t y = 0; y < world->height; y++) {
+            for (uint32_t x = 0; x < world->width; x++) {
+                bool next;
+                if (world->rule.isotropic) {
+                    next = lookupNeighbourhood(&world->rule, getCellNeighbourhood(world, x, y));
+                } else {
+                    uint8_t neighbours = sumNeighbours(world, x, y);
+                    bool alive = getCellUnsafe(world, x, y);
+                    uint16_t counts = alive ? world->rule.survival : world->rule.birth;
+                    next = (counts >> neighbours) & 1;
+                }
+                setCellUnsafe(world, world->nextGrid, x, y, next);
+            }
+        }
+        swapGrids(world);
+    }
+}
 
-            // 2. Apply Game of Life rules
-            // GoL rules condensed into one line! (via Rosetta Code)
-            // We know this cell can't be out of bounds because bouds are set in the loop
-            setCellUnsafe(nextGrid, x, y, neighbours == 3 || (neighbours == 2 && alive));
+/**
+ * Works out a cell's next state from the total of its 3x3 neighbourhood (including itself).
+ * @param born bit n is set if a dead cell with total n is born
+ * @param kept bit n is set if a live cell with total n survives
+ * @param constantRule true if born and kept are compile time constants. Then the rule is applied
+ * with a comparison per total it uses, which the unrolled loop folds down to just those, and which
+ * vectorise. Otherwise the masks are shifted by the total, so there are no branches on them. That
+ * needs variable shifts of each cell, which only vectorise with AVX-512BW, so with AVX2 the row
+ * update does most of the row with updateCellsGeneric32() instead.
+ */
+static inline __attribute__((always_inline)) uint8_t applyRule(uint8_t total, uint8_t alive,
+                                                               uint16_t born, uint16_t kept,
+                                                               bool constantRule) {
+    if (!constantRule) {
+        uint16_t counts = (kept & -(uint16_t) alive) | (born & ((uint16_t) alive - 1));
+        return (counts >> total) & 1;
+    }
+    uint8_t next = 0;
+    for (uint8_t t = 0; t <= 9; t++) {
+        uint8_t match = total == t;
+        if (born & (1 << t)) {
+            next |= match & (alive ^ 1);
+        }
+        if (kept & (1 << t)) {
+            next |= match & alive;
         }
     }
+    return next;
+}
 
-    // 3. Update grid
-    memcpy(grid, nextGrid, gridWidth * gridHeight * sizeof(bool));
-    generations++;
+/// Adds up one column of the 3x3 neighbourhood
+static inline uint8_t columnSum(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                                uint32_t x) {
+    return above[x] + row[x] + below[x];
 }
 
-void lifeInsertPatternPlainText(const char *filename, uint32_t oX, uint32_t oY) {
-    FILE *f = fopen(filename, "r");
-    if (f == NULL) {
-        log_error("Failed to open file %s for reading: %s", filename, strerror(errno));
-        exit(1);
-    }
-    log_info("Reading plain text pattern %s", filename);
-    uint32_t y = 0;
-    size_t unused = 0;
-
-    while (true) {
-        char *line = NULL;
-        // go over each line in the file
-        // note we just assume the output of getline is null terminated (which it should be?) so
-        // we ignore the "n" parameter
-        if (getline(&line, &unused, f) == -1) {
-            // got EOF, exit our reading loop
-            free(line);
-            break;
+#ifdef __AVX2__
+/// Loads 16 bytes into both halves of an AVX2 register, for byte shuffles to look up
+static inline __m256i broadcastTable(const uint8_t *table) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table));
+}
+
+/**
+ * Updates the cells of a row from x onwards, 32 at a time, with birth and survival masks that
+ * aren't known at compile time. Each mask is turned into a table of the next state by total, and
+ * since totals are under 16, one byte shuffle looks up 32 cells' totals in it at once.
+ * @param end cells from end onwards are left alone, since their right neighbours may be off the row
+ * @param born bit n is set if a dead cell with total n is born
+ * @param kept bit n is set if a live cell with total n survives
+ * @return the first cell not updated
+ */
+static inline uint32_t updateCellsGeneric32(const uint8_t *above, const uint8_t *row,
+                                            const uint8_t *below, uint8_t *next, uint32_t x,
+                                            uint32_t end, uint16_t born, uint16_t kept) {
+    uint8_t bornTable[16], keptTable[16];
+    for (int t = 0; t < 16; t++) {
+        bornTable[t] = (born >> t) & 1;
+        keptTable[t] = (kept >> t) & 1;
+    }
+    const __m256i bornStates = broadcastTable(bornTable);
+    const __m256i keptStates = broadcastTable(keptTable);
+    for (; x + 32 <= end; x += 32) {
+        __m256i total = _mm256_loadu_si256((const __m256i *) &row[x]);
+        // blends go by the top bit of each byte, and cells are 0 or 1, so shifting 16 bit lanes
+        // puts each cell there without carrying into the next byte
+        __m256i alive = _mm256_slli_epi16(total, 7);
+        for (int i = -1; i <= 1; i++) {
+            total = _mm256_add_epi8(total, _mm256_loadu_si256((const __m256i *) &above[x + i]));
+            total = _mm256_add_epi8(total, _mm256_loadu_si256((const __m256i *) &below[x + i]));
         }
-        // skip comments
-        if (line[0] == '!') {
-            free(line);
-            continue;
+        total = _mm256_add_epi8(total, _mm256_loadu_si256((const __m256i *) &row[x - 1]));
+        total = _mm256_add_epi8(total, _mm256_loadu_si256((const __m256i *) &row[x + 1]));
+        __m256i states = _mm256_blendv_epi8(_mm256_shuffle_epi8(bornStates, total),
+                                            _mm256_shuffle_epi8(keptStates, total), alive);
+        _mm256_storeu_si256((__m256i *) &next[x], states);
+    }
+    return x;
+}
+#endif
+
+/**
+ * Finds row y of the grid and the rows above and below it, which wrap round on a torus and are
+ * zeroRow beyond the edges of a bounded grid. Cells are read as bytes, since compilers won't
+ * vectorise arithmetic on bools.
+ */
+static inline __attribute__((always_inline)) void getRows(const LifeWorld_t *world, uint32_t y,
+                                                          const bool *zeroRow,
+                                                          LifeTopology_t topology,
+                                                          const uint8_t **above,
+                                                          const uint8_t **row,
+                                                          const uint8_t **below) {
+    uint32_t w = world->width, h = world->height;
+    const uint8_t *grid = (const uint8_t *) world->grid;
+    *row = &grid[(size_t) w * y];
+    if (topology == LIFE_TOPOLOGY_TORUS) {
+        *above = &grid[(size_t) w * (y == 0 ? h - 1 : y - 1)];
+        *below = &grid[(size_t) w * (y == h - 1 ? 0 : y + 1)];
+    } else {
+        *above = y == 0 ? (const uint8_t *) zeroRow : *row - w;
+        *below = y == h - 1 ? (const uint8_t *) zeroRow : *row + w;
+    }
+}
+
+/**
+ * Template for the specialised row updates. It's always inlined into the functions stamped out by
+ * DEFINE_ROW_KERNEL, so when the topology and rule are constants every check on them is folded away
+ * at compile time. The topology only affects which rows are above and below, and what's beyond the
+ * first and last columns, so it's dealt with once per row. The cells in between are a straight
+ * line loop over the three rows, with no branches on the configuration.
+ */
+static inline __attribute__((always_inline)) void updateRowTemplate(LifeWorld_t *world, uint32_t y,
+                                                                    const bool *zeroRow,
+                                                                    LifeTopology_t topology,
+                                                                    uint16_t birth,
+                                                                    uint16_t survival,
+                                                                    bool constantRule) {
+    uint32_t w = world->width;
+    const uint8_t *above, *row, *below;
+    getRows(world, y, zeroRow, topology, &above, &row, &below);
+    uint8_t *next = (uint8_t *) &world->nextGrid[(size_t) w * y];
+    // the total includes the cell itself, so a live cell's neighbour counts are shifted up by one
+    uint16_t born = birth, kept = survival << 1;
+
+    // columns beyond the left and right edges
+    uint8_t first = columnSum(above, row, below, 0);
+    uint8_t last = columnSum(above, row, below, w - 1);
+    uint8_t beforeFirst = topology == LIFE_TOPOLOGY_TORUS ? last : 0;
+    uint8_t afterLast = topology == LIFE_TOPOLOGY_TORUS ? first : 0;
+    if (w == 1) {
+        next[0] = applyRule(beforeFirst + first + afterLast, row[0], born, kept, constantRule);
+        return;
+    }
+    next[0] = applyRule(beforeFirst + first + columnSum(above, row, below, 1), row[0], born, kept,
+                        constantRule);
+    uint32_t x = 1;
+#ifdef __AVX2__
+    if (!constantRule) {
+        x = updateCellsGeneric32(above, row, below, next, x, w - 1, born, kept);
+    }
+#endif
+    for (; x < w - 1; x++) {
+        uint8_t total = above[x - 1] + above[x] + above[x + 1]
+                + row[x - 1] + row[x] + row[x + 1]
+                + below[x - 1] + below[x] + below[x + 1];
+        next[x] = applyRule(total, row[x], born, kept, constantRule);
+    }
+    next[w - 1] = applyRule(columnSum(above, row, below, w - 2) + last + afterLast, row[w - 1],
+                            born, kept, constantRule);
+}
+
+/// Stamps out a row update specialised for one topology and rule (birth and survival masks, as in
+/// LifeRule_t)
+#define DEFINE_ROW_KERNEL(name, topology, birth, survival) \
+    static void name(LifeWorld_t *world, uint32_t y, const bool *zeroRow) { \
+        updateRowTemplate(world, y, zeroRow, topology, birth, survival, true); \
+    }
+
+/// Stamps out a row update specialised for one topology, running whatever rule the world has
+#define DEFINE_GENERIC_ROW_KERNEL(name, topology) \
+    static void name(LifeWorld_t *world, uint32_t y, const bool *zeroRow) { \
+        updateRowTemplate(world, y, zeroRow, topology, world->rule.birth, world->rule.survival, \
+                          false); \
+    }
+
+// B3/S23, Conway's Life
+DEFINE_ROW_KERNEL(updateRowLifeBounded, LIFE_TOPOLOGY_BOUNDED, 0x008, 0x00C)
+DEFINE_ROW_KERNEL(updateRowLifeTorus, LIFE_TOPOLOGY_TORUS, 0x008, 0x00C)
+// B36/S23, HighLife
+DEFINE_ROW_KERNEL(updateRowHighLifeBounded, LIFE_TOPOLOGY_BOUNDED, 0x048, 0x00C)
+DEFINE_ROW_KERNEL(updateRowHighLifeTorus, LIFE_TOPOLOGY_TORUS, 0x048, 0x00C)
+// B3678/S34678, Day & Night
+DEFINE_ROW_KERNEL(updateRowDayNightBounded, LIFE_TOPOLOGY_BOUNDED, 0x1C8, 0x1D8)
+DEFINE_ROW_KERNEL(updateRowDayNightTorus, LIFE_TOPOLOGY_TORUS, 0x1C8, 0x1D8)
+// B2/S, Seeds
+DEFINE_ROW_KERNEL(updateRowSeedsBounded, LIFE_TOPOLOGY_BOUNDED, 0x004, 0x000)
+DEFINE_ROW_KERNEL(updateRowSeedsTorus, LIFE_TOPOLOGY_TORUS, 0x004, 0x000)
+// any other rule, with the masks read from the world once per row
+DEFINE_GENERIC_ROW_KERNEL(updateRowGenericBounded, LIFE_TOPOLOGY_BOUNDED)
+DEFINE_GENERIC_ROW_KERNEL(updateRowGenericTorus, LIFE_TOPOLOGY_TORUS)
+
+/// Works out the code of column x of a neighbourhood: the cells above, in and below the row as
+/// bits 0 to 2, so a neighbourhood is its left, centre and right columns' codes (see LifeRule_t)
+static inline uint32_t columnCode(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                                  uint32_t x) {
+    return above[x] | row[x] << 1 | below[x] << 2;
+}
+
+#if defined(__AVX512VBMI__) && defined(__AVX512BW__)
+/// Same as columnCode(), for the 64 columns from x
+static inline __m512i columnCodes64(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                                    uint32_t x) {
+    // cells are 0 or 1, so shifting 16 bit lanes never carries into the next byte
+    __m512i a = _mm512_loadu_si512(&above[x]);
+    __m512i r = _mm512_slli_epi16(_mm512_loadu_si512(&row[x]), 1);
+    __m512i b = _mm512_slli_epi16(_mm512_loadu_si512(&below[x]), 2);
+    return _mm512_or_si512(a, _mm512_or_si512(r, b));
+}
+
+/**
+ * Updates the cells of a row from x onwards, 64 at a time, with an isotropic rule whose 512 bit
+ * table is held in one register. The top 6 bits of each cell's neighbourhood (its left and centre
+ * columns) pick a byte of the table with one byte permute for all 64 cells, and the right column
+ * picks a bit of that byte, so there are no gathers or table lookups through memory.
+ * @param end cells from end onwards are left alone, since their right column may be off the row
+ * @return the first cell not updated
+ */
+static inline uint32_t updateCellsIsotropic64(const uint8_t *above, const uint8_t *row,
+                                              const uint8_t *below, uint8_t *next, uint32_t x,
+                                              uint32_t end, const LifeRule_t *rule) {
+    const __m512i table = _mm512_loadu_si512(rule->table);
+    // bit n of a byte, for n from 0 to 7, to pick out of the byte of the table
+    const __m512i bits = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                                              0, 0, 0, 0, 0, 0, 0, 0));
+    const __m512i ones = _mm512_set1_epi8(1);
+    for (; x + 64 <= end; x += 64) {
+        __m512i left = columnCodes64(above, row, below, x - 1);
+        __m512i centre = columnCodes64(above, row, below, x);
+        __m512i right = columnCodes64(above, row, below, x + 1);
+        __m512i bytes = _mm512_permutexvar_epi8(_mm512_or_si512(_mm512_slli_epi16(left, 3),
+                                                                centre), table);
+        __mmask64 alive = _mm512_test_epi8_mask(bytes, _mm512_shuffle_epi8(bits, right));
+        _mm512_storeu_si512(&next[x], _mm512_maskz_mov_epi8(alive, ones));
+    }
+    return x;
+}
+#endif
+
+#ifdef __AVX2__
+/// Same as columnCode(), for the 32 columns from x
+static inline __m256i columnCodes32(const uint8_t *above, const uint8_t *row, const uint8_t *below,
+                                    uint32_t x) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) &above[x]);
+    __m256i r = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i *) &row[x]), 1);
+    __m256i b = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i *) &below[x]), 2);
+    return _mm256_or_si256(a, _mm256_or_si256(r, b));
+}
+
+/**
+ * Same as updateCellsIsotropic64(), 32 cells at a time with AVX2, whose byte shuffle only looks
+ * up 16 bytes. The table is split into quarters of 16 bytes, and the low 4 bits of each cell's
+ * byte index pick a byte from every quarter at once. The top 2 bits then pick between the
+ * quarters with two blends, and the right column picks a bit of the byte as before.
+ */
+static inline uint32_t updateCellsIsotropic32(const uint8_t *above, const uint8_t *row,
+                                              const uint8_t *below, uint8_t *next, uint32_t x,
+                                              uint32_t end, const LifeRule_t *rule) {
+    const uint8_t *table = (const uint8_t *) rule->table;
+    const __m256i q0 = broadcastTable(&table[0]);
+    const __m256i q1 = broadcastTable(&table[16]);
+    const __m256i q2 = broadcastTable(&table[32]);
+    const __m256i q3 = broadcastTable(&table[48]);
+    const __m256i bits = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                                                   0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i ones = _mm256_set1_epi8(1);
+    for (; x + 32 <= end; x += 32) {
+        __m256i left = columnCodes32(above, row, below, x - 1);
+        __m256i centre = columnCodes32(above, row, below, x);
+        __m256i right = columnCodes32(above, row, below, x + 1);
+        // the index is under 64, so the shuffles only see its low 4 bits
+        __m256i index = _mm256_or_si256(_mm256_slli_epi16(left, 3), centre);
+        // blends go by the top bit of each byte, so move bits 4 and 5 of the index up there (bits
+        // shifted into the bottom of the next byte don't matter)
+        __m256i bit4 = _mm256_slli_epi16(index, 3);
+        __m256i bit5 = _mm256_slli_epi16(index, 2);
+        __m256i lower = _mm256_blendv_epi8(_mm256_shuffle_epi8(q0, index),
+                                           _mm256_shuffle_epi8(q1, index), bit4);
+        __m256i upper = _mm256_blendv_epi8(_mm256_shuffle_epi8(q2, index),
+                                           _mm256_shuffle_epi8(q3, index), bit4);
+        __m256i bytes = _mm256_blendv_epi8(lower, upper, bit5);
+        __m256i alive = _mm256_and_si256(bytes, _mm256_shuffle_epi8(bits, right));
+        _mm256_storeu_si256((__m256i *) &next[x], _mm256_min_epu8(alive, ones));
+    }
+    return x;
+}
+#endif
+
+/**
+ * Template for the isotropic row updates, which look up each cell's neighbourhood in the rule's
+ * table. As in updateRowTemplate, the topology only affects the first and last cells. In between, a
+ * window of three column codes slides along the row, so each column's code is only worked out
+ * once. With AVX-512 VBMI, the cells are done 64 at a time by updateCellsIsotropic64() first, and
+ * with AVX2 (what's left of them) 32 at a time by updateCellsIsotropic32().
+ */
+static inline __attribute__((always_inline)) void updateRowIsotropicTemplate(
+        LifeWorld_t *world, uint32_t y, const bool *zeroRow, LifeTopology_t topology) {
+    uint32_t w = world->width;
+    const uint8_t *above, *row, *below;
+    getRows(world, y, zeroRow, topology, &above, &row, &below);
+    uint8_t *next = (uint8_t *) &world->nextGrid[(size_t) w * y];
+    const LifeRule_t *rule = &world->rule;
+
+    // columns beyond the left and right edges
+    uint32_t first = columnCode(above, row, below, 0);
+    uint32_t last = columnCode(above, row, below, w - 1);
+    uint32_t beforeFirst = topology == LIFE_TOPOLOGY_TORUS ? last : 0;
+    uint32_t afterLast = topology == LIFE_TOPOLOGY_TORUS ? first : 0;
+    if (w == 1) {
+        next[0] = lookupNeighbourhood(rule, beforeFirst << 6 | first << 3 | afterLast);
+        return;
+    }
+    uint32_t centre = columnCode(above, row, below, 1);
+    next[0] = lookupNeighbourhood(rule, beforeFirst << 6 | first << 3 | centre);
+    uint32_t x = 1;
+#if defined(__AVX512VBMI__) && defined(__AVX512BW__)
+    x = updateCellsIsotropic64(above, row, below, next, x, w - 1, rule);
+#endif
+#ifdef __AVX2__
+    x = updateCellsIsotropic32(above, row, below, next, x, w - 1, rule);
+    centre = columnCode(above, row, below, x);
+#endif
+    uint32_t left = columnCode(above, row, below, x - 1);
+    for (; x < w - 1; x++) {
+        uint32_t right = columnCode(above, row, below, x + 1);
+        next[x] = lookupNeighbourhood(rule, left << 6 | centre << 3 | right);
+        left = centre;
+        centre = right;
+    }
+    next[w - 1] = lookupNeighbourhood(rule, left << 6 | centre << 3 | afterLast);
+}
+
+/// Stamps out an isotropic row update specialised for one topology
+#define DEFINE_ISOTROPIC_ROW_KERNEL(name, topology) \
+    static void name(LifeWorld_t *world, uint32_t y, const bool *zeroRow) { \
+        updateRowIsotropicTemplate(world, y, zeroRow, topology); \
+    }
+
+// isotropic non-totalistic rules
+DEFINE_ISOTROPIC_ROW_KERNEL(updateRowIsotropicBounded, LIFE_TOPOLOGY_BOUNDED)
+DEFINE_ISOTROPIC_ROW_KERNEL(updateRowIsotropicTorus, LIFE_TOPOLOGY_TORUS)
+
+/// A rule with its own specialised row updates
+typedef struct {
+    LifeRule_t rule;
+    /// Row updates, indexed by LifeTopology_t
+    LifeRowKernel_t rows[LIFE_TOPOLOGY_COUNT];
+} LifeRowKernels_t;
+
+/// Rules with specialised row updates
+static const LifeRowKernels_t specialisedRowKernels[] = {
+    {{.birth = 0x008, .survival = 0x00C}, {updateRowLifeBounded, updateRowLifeTorus}},
+    {{.birth = 0x048, .survival = 0x00C}, {updateRowHighLifeBounded, updateRowHighLifeTorus}},
+    {{.birth = 0x1C8, .survival = 0x1D8}, {updateRowDayNightBounded, updateRowDayNightTorus}},
+    {{.birth = 0x004, .survival = 0x000}, {updateRowSeedsBounded, updateRowSeedsTorus}},
+};
+#define NUM_SPECIALISED_RULES (sizeof(specialisedRowKernels) / sizeof(specialisedRowKernels[0]))
+
+/// Row updates for rules without specialised ones, indexed by LifeTopology_t
+static const LifeRowKernel_t genericRowKernels[LIFE_TOPOLOGY_COUNT] = {
+    [LIFE_TOPOLOGY_BOUNDED] = updateRowGenericBounded,
+    [LIFE_TOPOLOGY_TORUS] = updateRowGenericTorus,
+};
+
+/// Row updates for isotropic rules, indexed by LifeTopology_t
+static const LifeRowKernel_t isotropicRowKernels[LIFE_TOPOLOGY_COUNT] = {
+    [LIFE_TOPOLOGY_BOUNDED] = updateRowIsotropicBounded,
+    [LIFE_TOPOLOGY_TORUS] = updateRowIsotropicTorus,
+};
+
+/// Picks the row update for the world's rule and topology. Called whenever either changes, so the
+/// update itself never has to look at them.
+static void selectRowKernel(LifeWorld_t *world) {
+    // the JIT kernel's row update is only compiled when it's first used, so that setting the
+    // kernel, topology and rule one after the other doesn't compile one for each
+    world->jitRowKernel = NULL;
+    world->jitFailed = false;
+    if (world->rule.isotropic) {
+        world->rowKernel = isotropicRowKernels[world->topology];
+        return;
+    }
+    world->rowKernel = genericRowKernels[world->topology];
+    for (size_t i = 0; i < NUM_SPECIALISED_RULES; i++) {
+        const LifeRule_t *rule = &specialisedRowKernels[i].rule;
+        if (rule->birth == world->rule.birth && rule->survival == world->rule.survival) {
+            world->rowKernel = specialisedRowKernels[i].rows[world->topology];
+            return;
         }
-        // iterate over each char in the line to get our x coordinates and set cells
-        // note that in the plain text format, the "O" character means a cell is alive
-        for (uint32_t x = 0; x < strlen(line); x++) {
-            // if we failed to set the cell, raise an error
-            if (!setCell(grid, oX + x, oY + y, line[x] == 'O')) {
-                log_error("Failed to set cell at %u,%u for line: %s",oX + x, oY + y, line);
-                log_error("Please check the current grid size of %ux%u can hold the pattern.",
-                          gridWidth, gridHeight);
-                exit(1);
-            }
+    }
+}
+
+/// Updates a row with the row update compiled at runtime
+static void updateRowJIT(LifeWorld_t *world, uint32_t y, const bool *zeroRow) {
+    const uint8_t *above, *row, *below;
+    getRows(world, y, zeroRow, world->topology, &above, &row, &below);
+    world->jitRowKernel(above, row, below, (uint8_t *) &world->nextGrid[(size_t) world->width * y],
+                        world->width);
+}
+
+/// Runs a row update over every row of the grid, with the rows split across threads
+static void updateRows(LifeWorld_t *world, uint32_t steps, LifeRowKernel_t rowKernel) {
+    bool *zeroRow = calloc(MAX(world->width, 1), sizeof(bool));
+    // a grid with no columns still has rows, but nothing in them to update
+    uint32_t rows = world->width > 0 ? world->height : 0;
+    // optimisation: all the steps share one parallel region, so we only pay the thread team
+    // start-up cost once per batch instead of once per generation
+#pragma omp parallel default(none) shared(world, steps, zeroRow, rowKernel, rows)
+    for (uint32_t i = 0; i < steps; i++) {
+        // the barrier is explicit (rather than implied by omp for) so that the trace shows time
+        // spent waiting for other threads separately from each thread's own chunk
+        traceBegin("lifeUpdate chunk");
+#pragma omp for nowait
+        for (uint32_t y = 0; y < rows; y++) {
+            rowKernel(world, y, zeroRow);
         }
+        traceEnd("lifeUpdate chunk");
+#pragma omp barrier
 
-        y++;
-        free(line);
+#pragma omp single
+        swapGrids(world);
     }
-    fclose(f);
+    free(zeroRow);
 }
 
-void lifeInsertPatternRLE(const char *filename, uint32_t oX, uint32_t oY) {
-    FILE *f = fopen(filename, "r");
-    if (f == NULL) {
-        log_error("Failed to open file %s for reading: %s", filename, strerror(errno));
-        exit(1);
+/// OpenMP kernel: rows are split across threads, and each row is updated by the row kernel
+/// specialised for the world's rule and topology
+static void updateOMP(LifeWorld_t *world, uint32_t steps) {
+    updateRows(world, steps, world->rowKernel);
+}
+
+/// JIT kernel: the OpenMP kernel with a row update compiled at runtime for the world's rule
+static void updateJIT(LifeWorld_t *world, uint32_t steps) {
+    if (world->jitRowKernel == NULL && !world->jitFailed) {
+        world->jitRowKernel = jitGetRowKernel(&world->rule, world->topology);
+        if (world->jitRowKernel == NULL) {
+            log_warn("Falling back to the omp kernel's row update");
+            world->jitFailed = true;
+        }
     }
-    log_info("Reading RLE pattern %s", filename);
-    uint32_t y = 0;
-    uint32_t x = 0;
-    size_t unused = 0;
-
-    // find out when the preamble stops and the actual content of the file starts
-    long contentIdx;
-    while (true) {
-        char *line = NULL;
-        // getline seems to advance the file pointer to the next line, so we need to record where
-        // we are before we get there (to tell the reader to start at the line after the preamble)
-        long posBeforeRead = ftell(f);
-        if (getline(&line, &unused, f) == -1) {
-            // no content yet, file is just header data somehow
-            log_error("Unexpected EOF while skipping RLE header");
-            free(line);
-            exit(1);
-        }
-
-        if (line[0] == '#' || utilsStartsWith("x = ", line)) {
-            // starts with a hash or the prefix line, ignore
-            free(line);
-            continue;
-        } else {
-            // found first content line, mark our position and rewind
-            contentIdx = posBeforeRead;
-            log_trace("Reached RLE content at idx %zu", contentIdx);
-            fseek(f, 0, SEEK_SET);
-            free(line);
-            break;
+    updateRows(world, steps, world->jitFailed ? world->rowKernel : updateRowJIT);
+}
+
+/// Update kernels, indexed by LifeKernel_t
+static const LifeKernelInfo_t kernels[LIFE_KERNEL_COUNT] = {
+    [LIFE_KERNEL_REFERENCE] = {"reference", updateReference},
+    [LIFE_KERNEL_OMP] = {"omp", updateOMP},
+    [LIFE_KERNEL_JIT] = {"jit", updateJIT},
+};
+
+LifeWorld_t *lifeWorldCreate(uint32_t width, uint32_t height) {
+    LifeWorld_t *world = calloc(1, sizeof(LifeWorld_t));
+    if (world == NULL) {
+        log_error("Failed to allocate %ux%u world", width, height);
+        return NULL;
+    }
+    world->width = width;
+    world->height = height;
+    world->grid = allocGrid((size_t) width * height);
+    world->nextGrid = allocGrid((size_t) width * height);
+    if (world->grid == NULL || world->nextGrid == NULL) {
+        lifeWorldDestroy(world);
+        return NULL;
+    }
+    world->topology = LIFE_TOPOLOGY_BOUNDED;
+    world->kernel = LIFE_KERNEL_OMP;
+    lifeParseRule(LIFE_RULE, &world->rule);
+    selectRowKernel(world);
+    log_info("Initialised %ux%u grid", width, height);
+    return world;
+}
+
+void lifeWorldUpdate(LifeWorld_t *world) {
+    lifeWorldUpdateMulti(world, 1);
+}
+
+/// Advances a world running a Generations rule, whose kernel only picks the reference version of
+/// the engine or the vectorised one
+static void updateGenerations(LifeWorld_t *world, uint32_t steps) {
+    if (world->statesStale) {
+        generationsLoadGrid(world->states, world->grid);
+        world->statesStale = false;
+    }
+    if (world->kernel == LIFE_KERNEL_REFERENCE) {
+        generationsUpdateReference(world->states, world->topology, steps);
+    } else {
+        generationsUpdate(world->states, world->topology, steps);
+    }
+    generationsStoreGrid(world->states, world->grid);
+    world->generations += steps;
+}
+
+void lifeWorldUpdateMulti(LifeWorld_t *world, uint32_t steps) {
+    // two-state rules only pay for this one branch per batch of steps
+    if (world->states != NULL) {
+        updateGenerations(world, steps);
+        return;
+    }
+    kernels[world->kernel].update(world, steps);
+}
+
+void lifeWorldSetKernel(LifeWorld_t *world, LifeKernel_t kernel) {
+    assert(kernel < LIFE_KERNEL_COUNT);
+    world->kernel = kernel;
+}
+
+LifeKernel_t lifeWorldGetKernel(const LifeWorld_t *world) {
+    return world->kernel;
+}
+
+const char *lifeGetKernelName(LifeKernel_t kernel) {
+    assert(kernel < LIFE_KERNEL_COUNT);
+    return kernels[kernel].name;
+}
+
+LifeKernel_t lifeFindKernel(const char *name) {
+    for (LifeKernel_t kernel = 0; kernel < LIFE_KERNEL_COUNT; kernel++) {
+        if (strcasecmp(kernels[kernel].name, name) == 0) {
+            return kernel;
         }
     }
+    return LIFE_KERNEL_COUNT;
+}
 
-    // jump to content, we're now reading one char at a time
-    fseek(f, contentIdx, SEEK_SET);
+/// Topology names, indexed by LifeTopology_t
+static const char *const topologyNames[LIFE_TOPOLOGY_COUNT] = {
+    [LIFE_TOPOLOGY_BOUNDED] = "bounded",
+    [LIFE_TOPOLOGY_TORUS] = "torus",
+};
 
-    char numBuf[32] = {0};
-    int numBufIdx = 0;
-    uint32_t tagCount = 1; // if no number is specified, we have one by default
-    RLEParseState_t state = PARSE_NUM;
-    while (true) {
-        char c = (char) fgetc(f);
-        if (feof(f) || c == '!') {
-            // finish reading on EOF or !
-            break;
-        } else if (c == '\n' || c == '\r' || c == '\t' || c == ' ') {
-            // skip whitespace
+void lifeWorldSetTopology(LifeWorld_t *world, LifeTopology_t topology) {
+    assert(topology < LIFE_TOPOLOGY_COUNT);
+    world->topology = topology;
+    selectRowKernel(world);
+}
+
+LifeTopology_t lifeWorldGetTopology(const LifeWorld_t *world) {
+    return world->topology;
+}
+
+void lifeWorldSetRule(LifeWorld_t *world, const LifeRule_t *rule) {
+    world->rule = *rule;
+    selectRowKernel(world);
+    if (rule->dyingStates == 0 && world->states != NULL) {
+        generationsDestroy(world->states);
+        free(world->states);
+        world->states = NULL;
+    } else if (rule->dyingStates > 0 && world->states == NULL) {
+        world->states = malloc(sizeof(GenerationsWorld_t));
+        generationsInit(world->states, world->width, world->height, rule);
+    } else if (rule->dyingStates > 0) {
+        generationsSetRule(world->states, rule);
+    }
+    // the live cells are still in the grid, even if the states have just been created or reset
+    world->statesStale = true;
+}
+
+LifeRule_t lifeWorldGetRule(const LifeWorld_t *world) {
+    return world->rule;
+}
+
+uint32_t lifeWorldGetWidth(const LifeWorld_t *world) {
+    return world->width;
+}
+
+uint32_t lifeWorldGetHeight(const LifeWorld_t *world) {
+    return world->height;
+}
+
+const char *lifeGetTopologyName(LifeTopology_t t) {
+    assert(t < LIFE_TOPOLOGY_COUNT);
+    return topologyNames[t];
+}
+
+LifeTopology_t lifeFindTopology(const char *name) {
+    for (LifeTopology_t t = 0; t < LIFE_TOPOLOGY_COUNT; t++) {
+        if (strcasecmp(topologyNames[t], name) == 0) {
+            return t;
+        }
+    }
+    return LIFE_TOPOLOGY_COUNT;
+}
+
+/// Rotates an arrangement of neighbours (see HenselLetter_t) a quarter turn clockwise
+static inline uint8_t rotateNeighbours(uint8_t neighbours) {
+    return (uint8_t) ((neighbours << 2) | (neighbours >> 6));
+}
+
+/// Reflects an arrangement of neighbours (see HenselLetter_t) left to right
+static inline uint8_t reflectNeighbours(uint8_t neighbours) {
+    uint8_t reflected = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        reflected |= ((neighbours >> i) & 1) << ((8 - i) % 8);
+    }
+    return reflected;
+}
+
+/**
+ * Finds the Hensel notation letter of an arrangement of live neighbours, i.e. which of the ones in
+ * henselLetters it's a rotation or reflection of.
+ * @return the letter, or 0 for no live neighbours or 8, which don't have letters
+ */
+static char getHenselLetter(uint8_t neighbours) {
+    uint32_t count = __builtin_popcount(neighbours);
+    if (count > 4) {
+        // arrangements of more than 4 have the letter of their complement
+        neighbours = (uint8_t) ~neighbours;
+        count = 8 - count;
+    }
+    for (size_t i = 0; i < NUM_HENSEL_LETTERS; i++) {
+        if (henselLetters[i].count != count) {
             continue;
         }
+        // try all 8 symmetries: 4 rotations, then the reflection and its 4 rotations
+        uint8_t symmetry = henselLetters[i].neighbours;
+        for (uint32_t s = 0; s < 8; s++) {
+            if (symmetry == neighbours) {
+                return henselLetters[i].letter;
+            }
+            symmetry = s == 3 ? reflectNeighbours(symmetry) : rotateNeighbours(symmetry);
+        }
+    }
+    return 0;
+}
+
+/// Returns a bit mask of the letters (bit 0 for a) that some arrangement of count neighbours has
+static uint32_t getHenselLetters(uint32_t count) {
+    uint32_t letters = 0;
+    for (size_t i = 0; i < NUM_HENSEL_LETTERS; i++) {
+        if (henselLetters[i].count == MIN(count, 8 - count)) {
+            letters |= 1U << (henselLetters[i].letter - 'a');
+        }
+    }
+    return letters;
+}
 
-        if (state == PARSE_NUM) {
-            if (isdigit(c)) {
-                // continue reading number
-                numBuf[numBufIdx++] = c;
-                continue;
-            } else {
-                // end of number, parse the number and say that we're now reading a tag
-                char *endptr = NULL;
-                tagCount = strtol(numBuf, &endptr, 10);
-                if (strlen(endptr) > 0) {
-                    log_error("Unexpected non-digit character(s) parsing RLE: %s", endptr);
-                    exit(1);
-                } else if (tagCount == 0) {
-                    // if we did not parse a digit, set it to 1 by default
-                    log_trace("Setting 0 tag count to default 1");
-                    tagCount = 1;
-                }
-                // seek back one char to re-read the tag type
-                fseek(f, -1, SEEK_CUR);
-                state = PARSE_TAG;
-                log_trace("Read number %u", tagCount);
+/**
+ * Parses one half of a rule, e.g. "23" or "2-a3ce", into the set of arrangements of live neighbours
+ * it includes: bit n of arrangements (bit n % 64 of word n / 64) for arrangement n (see
+ * HenselLetter_t).
+ * @return true on success, false if it isn't valid
+ */
+static bool parseRuleHalf(const char *string, size_t length, uint64_t arrangements[4]) {
+    memset(arrangements, 0, 4 * sizeof(uint64_t));
+    size_t i = 0;
+    while (i < length) {
+        if (string[i] < '0' || string[i] > '8') {
+            return false;
+        }
+        uint32_t count = string[i++] - '0';
+        bool negated = i < length && string[i] == '-';
+        i += negated;
+        uint32_t letters = 0;
+        for (; i < length && isalpha((unsigned char) string[i]); i++) {
+            letters |= 1U << (tolower((unsigned char) string[i]) - 'a');
+        }
+        if ((negated && letters == 0) || (letters & ~getHenselLetters(count)) != 0) {
+            return false;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            if (__builtin_popcount(n) != count) {
                 continue;
             }
-        } else /* state == PARSE_TAG */ {
-            if (c == 'b') {
-                // insert dead cells
-                setCellMultiple(grid, &x, y, tagCount, false);
-            } else if (c == 'o') {
-                // insert alive cells
-                setCellMultiple(grid, &x, y, tagCount, true);
-            } else if (c == '$') {
-                // go to next line(s)
-                y += tagCount;
-                x = 0;
-                log_trace("End of line. Position is now %u,%u", y, x);
-            } else {
-                log_error("Illegal RLE tag: %c", c);
-                exit(1);
+            if (letters == 0 || ((letters >> (getHenselLetter(n) - 'a')) & 1) != negated) {
+                arrangements[n / 64] |= 1ULL << (n % 64);
             }
-            // clear previous number and go and get the next number
-            memset(numBuf, 0, 32 * sizeof(char));
-            numBufIdx = 0;
-            tagCount = 1;
-            state = PARSE_NUM;
-            continue;
         }
     }
-    fclose(f);
+    return true;
+}
+
+/// Bit of a neighbourhood (see LifeRule_t) for each bit of an arrangement of neighbours
+static const uint8_t neighbourBits[8] = {
+    NEIGHBOURHOOD_BIT(1, 0), NEIGHBOURHOOD_BIT(2, 0), NEIGHBOURHOOD_BIT(2, 1),
+    NEIGHBOURHOOD_BIT(2, 2), NEIGHBOURHOOD_BIT(1, 2), NEIGHBOURHOOD_BIT(0, 2),
+    NEIGHBOURHOOD_BIT(0, 1), NEIGHBOURHOOD_BIT(0, 0),
+};
+
+/// Returns the neighbourhood of a cell in the given state with the given arrangement of neighbours
+static uint32_t getNeighbourhood(uint8_t neighbours, bool alive) {
+    uint32_t neighbourhood = (uint32_t) alive << NEIGHBOURHOOD_BIT(1, 1);
+    for (uint32_t i = 0; i < 8; i++) {
+        neighbourhood |= (uint32_t) ((neighbours >> i) & 1) << neighbourBits[i];
+    }
+    return neighbourhood;
 }
 
-void lifeRenderConsole(void) {
-    for (uint32_t y = 0; y < gridHeight; y++) {
-        for (uint32_t x = 0; x < gridWidth; x++) {
-            bool alive = getCell(x, y);
-            if (alive) {
-                printf("O");
-            } else {
-                printf(".");
-            }
-        }
-        printf("\n");
+/**
+ * Makes a rule from the arrangements of neighbours (as from parseRuleHalf()) that a dead cell is
+ * born with and a live cell survives with. If every arrangement of each count is treated the same,
+ * it's stored as an outer totalistic rule, otherwise as an isotropic one.
+ */
+static void makeRule(const uint64_t born[4], const uint64_t kept[4], LifeRule_t *rule) {
+    *rule = (LifeRule_t) {0};
+    // counts with some and with all of their arrangements included
+    uint16_t someBorn = 0, allBorn = 0x1FF, someKept = 0, allKept = 0x1FF;
+    for (uint32_t n = 0; n < 256; n++) {
+        uint16_t count = 1 << __builtin_popcount(n);
+        bool birth = (born[n / 64] >> (n % 64)) & 1, survival = (kept[n / 64] >> (n % 64)) & 1;
+        someBorn |= birth ? count : 0;
+        allBorn &= birth ? 0x1FF : ~count;
+        someKept |= survival ? count : 0;
+        allKept &= survival ? 0x1FF : ~count;
+        uint32_t dead = getNeighbourhood(n, false), alive = getNeighbourhood(n, true);
+        rule->table[dead / 64] |= (uint64_t) birth << (dead % 64);
+        rule->table[alive / 64] |= (uint64_t) survival << (alive % 64);
+    }
+    rule->isotropic = someBorn != allBorn || someKept != allKept;
+    if (!rule->isotropic) {
+        rule->birth = someBorn;
+        rule->survival = someKept;
+        memset(rule->table, 0, sizeof(rule->table));
     }
 }
 
-void lifeRenderSDL(SDL_Texture *texture) {
-    // copy over grid data
-#pragma omp parallel for default(none) shared(gridHeight, gridWidth, pixelData)
-    for (uint32_t y = 0; y < gridHeight; y++) {
-        for (uint32_t x = 0; x < gridWidth; x++) {
-            bool alive = getCellUnsafe(x, y);
-            pixelData[x + gridWidth * y] = alive ? 0xFFFFFF : 0;
+/**
+ * Parses the number of states of a Generations rule, e.g. "C3" or "3"
+ * @return the number of states, or 0 if it isn't valid
+ */
+static uint32_t parseRuleStates(const char *string) {
+    if (*string == 'C' || *string == 'c') {
+        string++;
+    }
+    uint32_t states = 0;
+    for (const char *p = string; *p != '\0'; p++) {
+        if (!isdigit((unsigned char) *p) || p - string >= 3) {
+            return 0;
         }
+        states = states * 10 + (*p - '0');
     }
-    SDL_UpdateTexture(texture, NULL, pixelData, gridWidth * sizeof(uint32_t));
+    return states >= 2 && states <= LIFE_MAX_STATES ? states : 0;
 }
 
-void lifeDestroy(void) {
-    free(pixelData);
-    free(grid);
-    free(nextGrid);
+bool lifeParseRule(const char *string, LifeRule_t *rule) {
+    const char *slash = strchr(string, '/');
+    if (slash == NULL) {
+        return false;
+    }
+    const char *first = string, *second = slash + 1;
+    size_t firstLength = slash - string, secondLength = strlen(second);
+    // Generations rules have a third part, the number of states
+    const char *third = strchr(second, '/');
+    uint32_t states = 2;
+    if (third != NULL) {
+        secondLength = third - second;
+        states = parseRuleStates(third + 1);
+        if (states == 0) {
+            return false;
+        }
+    }
+    uint64_t born[4], kept[4];
+    if (firstLength > 0 && (*first == 'B' || *first == 'b')) {
+        // B/S notation
+        if (secondLength == 0 || (*second != 'S' && *second != 's')
+            || !parseRuleHalf(first + 1, firstLength - 1, born)
+            || !parseRuleHalf(second + 1, secondLength - 1, kept)) {
+            return false;
+        }
+    } else if (!parseRuleHalf(first, firstLength, kept)
+               || !parseRuleHalf(second, secondLength, born)) {
+        // S/B notation
+        return false;
+    }
+    LifeRule_t parsed;
+    makeRule(born, kept, &parsed);
+    if (parsed.isotropic && states > 2) {
+        // the Generations engine only counts live neighbours
+        return false;
+    }
+    parsed.dyingStates = states - 2;
+    *rule = parsed;
+    return true;
 }
 
-uint64_t lifeGetGenerations(void) {
-    return generations;
-}
\ No newline at end of file
+/// Writes one half of an isotropic rule, e.g. "2-a3ce", returning the number of characters written
+static size_t formatRuleHalf(const LifeRule_t *rule, bool alive, char *buf) {
+    size_t length = 0;
+    for (uint32_t count = 0; count <= 8; count++) {
+        // which letters the rule includes, and which it doesn't
+        uint32_t included = 0, excluded = 0;
+        for (uint32_t n = 0; n < 256; n++) {
+            if (__builtin_popcount(n) != count) {
+                continue;
+            }
+            // the count itself for 0 and 8 neighbours, which don't have letters
+            char letter = getHenselLetter(n);
+            uint32_t bit = letter == 0 ? 1 : 1U << (letter - 'a');
+            if (lookupNeighbourhood(rule, getNeighbourhood(n, alive))) {
+                included |= bit;
+            } else {
+                excluded |= bit;
+            }
+        }
+        if (included == 0) {
+            continue;
+        }
+        buf[length++] = (char) ('0' + count);
+        if (excluded == 0) {
+            continue;
+        }
+        uint32_t letters = included;
+        if (__builtin_popcount(excluded) < __builtin_popcount(included)) {
+            buf[length++] = '-';
+            letters = excluded;
+        }
+        for (uint32_t letter = 0; letter < 26; letter++) {
+            if (letters & (1U << letter)) {
+                buf[length++] = (char) ('a' + letter);
+            }
+        }
+    }
+    return length;
+}
+
+/// Writes the neighbour counts in a mask, e.g. "23", returning the number of characters written
+static size_t formatRuleCounts(uint16_t counts, char *buf) {
+    size_t length = 0;
+    for (int n = 0; n <= 8; n++) {
+        if (counts & (1 << n)) {
+            buf[length++] = (char) ('0' + n);
+        }
+    }
+    return length;
+}
+
+void lifeFormatRule(const LifeRule_t *rule, char *buf) {
+    size_t length = 0;
+    buf[length++] = 'B';
+    length += rule->isotropic ? formatRuleHalf(rule, false, &buf[length])
+                              : formatRuleCounts(rule->birth, &buf[length]);
+    buf[length++] = '/';
+    buf[length++] = 'S';
+    length += rule->isotropic ? formatRuleHalf(rule, true, &buf[length])
+                              : formatRuleCounts(rule->survival, &buf[length]);
+    if (rule->dyingStates > 0) {
+        length += sprintf(&buf[length], "/C%u", rule->dyingStates + 2);
+    }
+    buf[length] = '\0';
+}
+
+/// Fills in the expansion of every possible packed byte (least significant bit first) into 8 cells,
+/// so that packed cells can be unpacked with one load and one 8 byte store per byte
+static void buildUnpackTable(uint64_t table[256]) {
+    for (uint32_t b = 0; b < 256; b++) {
+        table[b] = 0;
+        for (uint32_t i = 0; i < 8; i++) {
+            table[b] |= (uint64_t) ((b >> i) & 1) << (8 * i);
+        }
+    }
+}
+
+/// Frees a tree loaded by parseMacrocell()
+static void freeMacrocell(MacrocellTree_t *tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->count = tree->capacity = 0;
+}
+
+/**
+ * Parses an unsigned decimal number from a line
+ * @param p pointer to the current position in the line, advanced past the number
+ * @param end end of the line
+ * @param value where to store the number
+ * @return false if there's no number, or it's too big
+ */
+static bool parseUInt(const char **p, const char *end, uint64_t *value) {
+    while (*p < end && **p == ' ') {
+        (*p)++;
+    }
+    if (*p == end || !isdigit(**p)) {
+        return false;
+    }
+    *value = 0;
+    for (; *p < end && isdigit(**p); (*p)++) {
+        if (*value > UINT32_MAX) {
+            return false;
+        }
+        *value = *value * 10 + (**p - '0');
+    }
+    return true;
+}
+
+/// Parses one line of a macrocell file into a node, returning NULL on success or why it failed
+static const char *parseMacrocellNode(const MacrocellTree_t *tree, const char *line,
+                                      const char *end, MacrocellNode_t *node) {
+    *node = (MacrocellNode_t) {0};
+    if (*line == '.' || *line == '*' || *line == '$') {
+        // 8x8 leaf: rows of '.' (dead) and '*' (alive) ending in '$', with trailing dead cells
+        // and trailing empty rows left out
+        node->level = 3;
+        uint32_t x = 0, y = 0;
+        for (; line < end; line++) {
+            if (*line == '$') {
+                x = 0;
+                y++;
+            } else if (*line == '.' || *line == '*') {
+                if (x >= 8 || y >= 8) {
+                    return "leaf node is bigger than 8x8";
+                }
+                node->cells |= (uint64_t) (*line == '*') << (x + 8 * y);
+                x++;
+            } else if (!isspace(*line)) {
+                return "illegal character in leaf node";
+            }
+        }
+        return NULL;
+    }
+
+    uint64_t level = 0;
+    if (!parseUInt(&line, end, &level)) {
+        return "illegal node";
+    } else if (level == 1) {
+        return "level 1 nodes are only used by multi-state rules, which aren't supported";
+    } else if (level < 4 || level > MACROCELL_MAX_LEVEL) {
+        return "node level out of range";
+    }
+    node->level = (uint32_t) level;
+    for (int i = 0; i < 4; i++) {
+        uint64_t child = 0;
+        if (!parseUInt(&line, end, &child)) {
+            return "node has fewer than 4 children";
+        } else if (child >= tree->count) {
+            // children always come before their parents, so this also rules out cycles
+            return "child node hasn't been defined yet";
+        } else if (child != 0 && tree->nodes[child].level != level - 1) {
+            return "child node has the wrong level";
+        }
+        node->children[i] = (uint32_t) child;
+    }
+    return NULL;
+}
+
+/// Works out the bounding box of a node's live cells from its cells or its children's boxes
+static void boundMacrocellNode(const MacrocellTree_t *tree, MacrocellNode_t *node) {
+    node->empty = true;
+    if (node->level == 3) {
+        for (uint32_t i = 0; i < 64; i++) {
+            if ((node->cells >> i) & 1) {
+                uint64_t x = i % 8, y = i / 8;
+                node->minX = node->empty ? x : MIN(node->minX, x);
+                node->minY = node->empty ? y : MIN(node->minY, y);
+                node->maxX = node->empty ? x : MAX(node->maxX, x);
+                node->maxY = node->empty ? y : MAX(node->maxY, y);
+                node->empty = false;
+            }
+        }
+        return;
+    }
+    uint64_t half = 1ULL << (node->level - 1);
+    for (int i = 0; i < 4; i++) {
+        const MacrocellNode_t *child = &tree->nodes[node->children[i]];
+        if (child->empty) {
+            continue;
+        }
+        uint64_t dx = (i & 1) * half, dy = (i >> 1) * half;
+        node->minX = node->empty ? child->minX + dx : MIN(node->minX, child->minX + dx);
+        node->minY = node->empty ? child->minY + dy : MIN(node->minY, child->minY + dy);
+        node->maxX = node->empty ? child->maxX + dx : MAX(node->maxX, child->maxX + dx);
+        node->maxY = node->empty ? child->maxY + dy : MAX(node->maxY, child->maxY + dy);
+        node->empty = false;
+    }
+}
+
+/**
+ * Parses a macrocell file into a node table. Each node's bounding box is worked out as it's
+ * parsed, since its children always come first. The root is the last node.
+ * @param stream the file, read one line at a time
+ * @param tree where to store the nodes, must be freed with freeMacrocell() even on error
+ * @param errorLine where to store the line number of the error, if any
+ * @return NULL on success, otherwise the reason parsing failed
+ */
+static const char *parseMacrocell(Stream_t *stream, MacrocellTree_t *tree, uint64_t *errorLine) {
+    *tree = (MacrocellTree_t) {0};
+    *errorLine = 1;
+    const char *line = NULL;
+    size_t length = 0;
+    if (!streamReadLine(stream, &line, &length) || length < 4 || memcmp(line, "[M2]", 4) != 0) {
+        return "missing [M2] header, not a macrocell file";
+    }
+    // node 0 is the empty node that stands in for any all-dead child
+    tree->capacity = 1024;
+    tree->nodes = calloc(tree->capacity, sizeof(MacrocellNode_t));
+    tree->nodes[0].empty = true;
+    tree->count = 1;
+
+    while (streamReadLine(stream, &line, &length)) {
+        (*errorLine)++;
+        if (length == 0 || *line == '#') {
+            // blank line or comment ("#R" rule, "#G" generation, etc)
+            continue;
+        }
+        if (tree->count == tree->capacity) {
+            if (tree->capacity >= UINT32_MAX / 2) {
+                return "too many nodes";
+            }
+            tree->capacity *= 2;
+            MacrocellNode_t *nodes = realloc(tree->nodes, tree->capacity * sizeof(MacrocellNode_t));
+            if (nodes == NULL) {
+                return "out of memory";
+            }
+            tree->nodes = nodes;
+        }
+        MacrocellNode_t *node = &tree->nodes[tree->count];
+        const char *error = parseMacrocellNode(tree, line, line + length, node);
+        if (error != NULL) {
+            return error;
+        }
+        boundMacrocellNode(tree, node);
+        tree->count++;
+    }
+    if (streamError(stream) != NULL) {
+        return streamError(stream);
+    } else if (tree->count == 1) {
+        return "no nodes";
+    }
+    return NULL;
+}
+
+/// Works out the size of a macrocell tree's live cells, returning false if it's too big
+static bool getMacrocellSize(const MacrocellTree_t *tree, uint32_t *width, uint32_t *height) {
+    const MacrocellNode_t *root = &tree->nodes[tree->count - 1];
+    if (root->empty) {
+        *width = *height = 0;
+        return true;
+    } else if (root->maxX - root->minX >= UINT32_MAX || root->maxY - root->minY >= UINT32_MAX) {
+        return false;
+    }
+    *width = (uint32_t) (root->maxX - root->minX + 1);
+    *height = (uint32_t) (root->maxY - root->minY + 1);
+    return true;
+}
+
+/// Opens a pattern file (or stdin) for reading, returning false (after logging why) if it can't
+static bool openPattern(Stream_t *stream, const char *filename) {
+    if (!streamOpen(stream, filename)) {
+        log_error("Failed to open file %s for reading: %s", filename, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/// Returns false (after logging why) if reading a pattern failed part way through, e.g. because a
+/// .gz file is truncated
+static bool checkPatternRead(const Stream_t *stream) {
+    if (streamError(stream) != NULL) {
+        log_error("Failed to read %s: %s", stream->filename, streamError(stream));
+        return false;
+    }
+    return true;
+}
+
+/// Logs how much of a pattern was read, and how fast
+static void logPatternRead(const Stream_t *stream, double begin) {
+    double size = streamOffset(stream, stream->pos) / 1048576.0;
+    double elapsed = utilsGetTime() - begin;
+    log_info("Read %.2f MiB in %.1f ms (%.1f MiB/s)", size, elapsed * 1000.0,
+             elapsed > 0 ? size / elapsed : 0.0);
+}
+
+/**
+ * Works out the format of a pattern from its file extension (ignoring any compression extension).
+ * Patterns read from stdin have no extension, so the first line that isn't an RLE comment is
+ * looked at instead: "[M2]" starts a macrocell file and "x = ..." an RLE header. The line is
+ * pushed back afterwards, so nothing the loaders need is consumed.
+ */
+static PatternFormat_t getPatternFormat(Stream_t *stream) {
+    char name[4096];
+    streamBaseName(stream->filename, name, sizeof(name));
+    if (utilsEndsWith(".rle", name)) {
+        return PATTERN_RLE;
+    } else if (utilsEndsWith(".mc", name)) {
+        return PATTERN_MACROCELL;
+    } else if (strcmp(name, "-") != 0) {
+        return PATTERN_PLAINTEXT;
+    }
+    const char *line = NULL;
+    size_t length = 0;
+    while (streamReadLine(stream, &line, &length)) {
+        if (length > 0 && *line == '#') {
+            continue;
+        }
+        streamUnreadLine(stream);
+        if (length >= 4 && memcmp(line, "[M2]", 4) == 0) {
+            return PATTERN_MACROCELL;
+        }
+        return length > 0 && *line == 'x' ? PATTERN_RLE : PATTERN_PLAINTEXT;
+    }
+    return PATTERN_PLAINTEXT;
+}
+
+bool lifeGetPatternSize(const char *filename, uint32_t *width, uint32_t *height) {
+    LifePattern_t *pattern = lifeOpenPattern(filename);
+    bool sized = pattern != NULL && lifePatternGetSize(pattern, width, height);
+    lifeClosePattern(pattern);
+    return sized;
+}
+
+/**
+ * Reads every row of a plain text pattern into its packed rows, working out its size on the way
+ * @return false (after logging why) if reading failed
+ */
+static bool packPlainText(LifePattern_t *pattern) {
+    Stream_t *stream = &pattern->stream;
+    const char *line = NULL;
+    size_t length = 0;
+    while (streamReadLine(stream, &line, &length)) {
+        // skip comments
+        if (length > 0 && *line == '!') {
+            continue;
+        } else if (length > UINT32_MAX || pattern->height == UINT32_MAX) {
+            log_error("Plain text pattern %s is too big", pattern->filename);
+            return false;
+        }
+        if (pattern->height == pattern->rowCapacity) {
+            pattern->rowCapacity = MAX(pattern->rowCapacity * 2, 64);
+            pattern->rowLengths = realloc(pattern->rowLengths,
+                                          pattern->rowCapacity * sizeof(uint32_t));
+        }
+        size_t bytes = (length + 7) / 8;
+        if (pattern->packedSize + bytes > pattern->packedCapacity) {
+            pattern->packedCapacity = MAX(pattern->packedCapacity * 2, pattern->packedSize + bytes);
+            pattern->packed = realloc(pattern->packed, pattern->packedCapacity);
+        }
+        uint8_t *packed = &pattern->packed[pattern->packedSize];
+        memset(packed, 0, bytes);
+        for (size_t x = 0; x < length; x++) {
+            packed[x / 8] |= (uint8_t) ((line[x] == 'O') << (x % 8));
+        }
+        pattern->packedSize += bytes;
+        pattern->rowLengths[pattern->height++] = (uint32_t) length;
+        pattern->width = MAX(pattern->width, (uint32_t) length);
+    }
+    return checkPatternRead(stream);
+}
+
+LifePattern_t *lifeOpenPattern(const char *filename) {
+    double begin = utilsGetTime();
+    LifePattern_t *pattern = calloc(1, sizeof(LifePattern_t));
+    pattern->filename = filename;
+    if (!openPattern(&pattern->stream, filename)) {
+        free(pattern);
+        return NULL;
+    }
+    Stream_t *stream = &pattern->stream;
+    pattern->format = getPatternFormat(stream);
+    bool read = true;
+    if (pattern->format == PATTERN_RLE) {
+        // RLE: the "x = 123, y = 456" header line comes after any comments. It's pushed back, and
+        // the body is left to be decoded straight from the file when the pattern is inserted.
+        const char *line = NULL;
+        size_t length = 0;
+        while (streamReadLine(stream, &line, &length)) {
+            if (length == 0 || *line != '#') {
+                // copy the line out, since it isn't null terminated
+                char header[256] = {0};
+                memcpy(header, line, MIN(length, sizeof(header) - 1));
+                pattern->sized = sscanf(header, " x = %u , y = %u", &pattern->width,
+                                        &pattern->height) == 2;
+                streamUnreadLine(stream);
+                break;
+            }
+        }
+        read = checkPatternRead(stream);
+    } else if (pattern->format == PATTERN_MACROCELL) {
+        // macrocell: the size comes from the bounding box of the root node, so parse the whole
+        // tree, and keep it to paint into the grid
+        log_info("Reading macrocell pattern %s", filename);
+        uint64_t errorLine = 0;
+        const char *error = parseMacrocell(stream, &pattern->tree, &errorLine);
+        if (error != NULL) {
+            log_error("Failed to decode macrocell file at line %lu: %s", errorLine, error);
+            read = false;
+        } else {
+            pattern->sized = getMacrocellSize(&pattern->tree, &pattern->width, &pattern->height);
+            log_info("Read %u nodes (%.2f MiB) in %.1f ms", pattern->tree.count - 1,
+                     streamOffset(stream, stream->pos) / 1048576.0,
+                     (utilsGetTime() - begin) * 1000.0);
+        }
+        streamClose(stream);
+    } else {
+        // plain text: one line per row, one char per cell, so every line has to be read
+        log_info("Reading plain text pattern %s", filename);
+        read = packPlainText(pattern);
+        pattern->sized = pattern->height > 0;
+        if (read) {
+            logPatternRead(stream, begin);
+        }
+        streamClose(stream);
+    }
+    if (!read) {
+        lifeClosePattern(pattern);
+        return NULL;
+    }
+    return pattern;
+}
+
+bool lifePatternGetSize(const LifePattern_t *pattern, uint32_t *width, uint32_t *height) {
+    *width = pattern->sized ? pattern->width : 0;
+    *height = pattern->sized ? pattern->height : 0;
+    return pattern->sized;
+}
+
+void lifeClosePattern(LifePattern_t *pattern) {
+    if (pattern == NULL) {
+        return;
+    }
+    streamClose(&pattern->stream);
+    freeMacrocell(&pattern->tree);
+    free(pattern->packed);
+    free(pattern->rowLengths);
+    free(pattern);
+}
+
+/// Inserts a plain text pattern from an open stream, see lifeInsertPatternPlainText()
+static bool insertPatternPlainText(LifeWorld_t *world, Stream_t *stream, uint32_t oX,
+                                   uint32_t oY) {
+    double begin = utilsGetTime();
+    log_info("Reading plain text pattern %s", stream->filename);
+    invalidateStates(world, false);
+    uint32_t y = oY;
+    const char *line = NULL;
+    size_t length = 0;
+
+    // go over each line in the file, straight out of the stream's blocks so there's nothing to copy
+    while (streamReadLine(stream, &line, &length)) {
+        // skip comments
+        if (length > 0 && *line == '!') {
+            continue;
+        }
+        // check the bounds once for the whole row
+        if (y >= world->height || oX + (uint64_t) length > world->width) {
+            log_error("Failed to insert row of %zu cells at %u,%u", length, oX, y);
+            log_error("Please check the current grid size of %ux%u can hold the pattern.",
+                      world->width, world->height);
+            return false;
+        }
+        // write the whole row at once; note that in the plain text format, the "O" character
+        // means a cell is alive. This loop is branchless, so the compiler can vectorise it.
+        bool *row = &world->grid[oX + (size_t) world->width * y];
+        for (size_t x = 0; x < length; x++) {
+            row[x] = line[x] == 'O';
+        }
+        y++;
+    }
+    if (!checkPatternRead(stream)) {
+        return false;
+    }
+    logPatternRead(stream, begin);
+    return true;
+}
+
+bool lifeWorldInsertPatternPlainText(LifeWorld_t *world, const char *filename, uint32_t oX,
+                                     uint32_t oY) {
+    Stream_t stream;
+    if (!openPattern(&stream, filename)) {
+        return false;
+    }
+    bool inserted = insertPatternPlainText(world, &stream, oX, oY);
+    streamClose(&stream);
+    return inserted;
+}
+
+/**
+ * Decodes a chunk of the body of an RLE file. Used for both passes of the parallel decoder: in
+ * the counting pass nothing is written and the chunk's row and cell counts are calculated, then in
+ * the writing pass the cells are inserted starting at the chunk's start position.
+ * @param world world to write cells into
+ * @param chunk chunk to decode
+ * @param write true to write cells into the grid, false to only count rows and cells
+ * @param oX x coordinate of the left edge of the pattern in the grid
+ */
+static void decodeRLEChunk(LifeWorld_t *world, RLEChunk_t *chunk, bool write, uint64_t oX) {
+    uint64_t x = chunk->startX;
+    uint64_t y = chunk->startY;
+    uint64_t rows = 0;
+    uint64_t tailCells = 0;
+    uint64_t count = chunk->count; // 0 means no number was specified, which means a run of one
+    char prefix = chunk->prefix;
+
+    for (const char *p = chunk->begin; p < chunk->end; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') {
+            count = count * 10 + (c - '0');
+            if (count > UINT32_MAX) {
+                chunk->error = p;
+                chunk->errorReason = "run length too long";
+                return;
+            }
+            continue;
+        } else if (c == '\n' || c == '\r' || c == '\t' || c == ' ') {
+            // skip whitespace
+            continue;
+        } else if (c >= 'p' && c <= 'y' && prefix == 0) {
+            // first letter of a multi-state tag for states from 25 onwards
+            prefix = c;
+            continue;
+        } else if (prefix != 0 && (c < 'A' || c > 'X')) {
+            chunk->error = p;
+            chunk->errorReason = "illegal RLE tag";
+            return;
+        }
+
+        uint64_t run = count == 0 ? 1 : count;
+        count = 0;
+        if (c == 'b' || c == 'o' || c == '.' || (c >= 'A' && c <= 'X')) {
+            // insert a run of cells, with multi-state tags "." for dead and "A", "B", ... (with
+            // "p" to "y" in front for 24 more states each) for states from 1 onwards
+            uint32_t state = c == 'o';
+            if (c >= 'A' && c <= 'X') {
+                state = (prefix == 0 ? 0 : 24 * (prefix - 'o')) + (c - 'A' + 1);
+                prefix = 0;
+            }
+            if (state > world->rule.dyingStates + 1) {
+                chunk->error = p;
+                chunk->errorReason = "state is beyond the rule's number of states";
+                return;
+            }
+            uint64_t first = x;
+            if (write && !setCellMultiple(world, world->grid, &x, y, run, state == 1)) {
+                chunk->error = p;
+                chunk->errorReason = "pattern does not fit in the grid";
+                return;
+            }
+            if (write && world->states != NULL) {
+                generationsSetCells(world->states, first, y, run, state);
+            }
+            tailCells += run;
+        } else if (c == '$') {
+            // go to next line(s)
+            y += run;
+            x = oX;
+            rows += run;
+            tailCells = 0;
+        } else if (c == '!') {
+            // end of pattern
+            chunk->finished = true;
+            break;
+        } else {
+            chunk->error = p;
+            chunk->errorReason = "illegal RLE tag";
+            return;
+        }
+    }
+    chunk->rows = rows;
+    chunk->tailCells = tailCells;
+    chunk->count = count;
+    chunk->prefix = prefix;
+}
+
+/// Returns true if the character ends an RLE item, so a chunk can start straight after it. The
+/// first letter of a multi-state tag doesn't, since the second has to be in the same chunk.
+static inline bool isRLETag(char c) {
+    return !(c >= '0' && c <= '9') && !(c >= 'p' && c <= 'y') && c != '\n' && c != '\r'
+           && c != '\t' && c != ' ';
+}
+
+/**
+ * Decodes the body of an RLE file in parallel, in two passes. First the body is split into one
+ * chunk per thread (on item boundaries, so no run length is split), and each thread counts the
+ * rows ("$" tags, including multi-row "N$" ones) and trailing cells in its chunk. A prefix sum
+ * over the chunks then gives the position each chunk starts at, and in the second pass each
+ * thread writes its chunk straight into the grid. Chunks only ever write disjoint cells.
+ * @return the chunk that failed to decode, or NULL on success
+ */
+static RLEChunk_t *decodeRLEParallel(LifeWorld_t *world, RLEChunk_t *chunks, int numChunks,
+                                     const char *begin, const char *end, uint32_t oX,
+                                     uint32_t oY) {
+    size_t chunkSize = (end - begin) / numChunks;
+    const char *chunkBegin = begin;
+    for (int i = 0; i < numChunks; i++) {
+        const char *chunkEnd = begin + chunkSize * (i + 1);
+        chunkEnd = i == numChunks - 1 ? end : MAX(chunkBegin, chunkEnd);
+        // move the split forward until it's just after a tag, so it doesn't split a run length
+        while (chunkEnd < end && chunkEnd > begin && !isRLETag(chunkEnd[-1])) {
+            chunkEnd++;
+        }
+        chunks[i] = (RLEChunk_t) {.begin = chunkBegin, .end = chunkEnd};
+        chunkBegin = chunkEnd;
+    }
+
+    // pass 1: count rows and cells in each chunk
+#pragma omp parallel for default(none) shared(world, chunks, numChunks, oX) schedule(static, 1)
+    for (int i = 0; i < numChunks; i++) {
+        traceBegin("RLE count chunk");
+        decodeRLEChunk(world, &chunks[i], false, oX);
+        traceEnd("RLE count chunk");
+    }
+
+    // prefix sum to work out where each chunk starts
+    uint64_t x = oX, y = oY;
+    bool finished = false;
+    for (int i = 0; i < numChunks; i++) {
+        if (finished) {
+            // chunks after the end of the pattern are ignored
+            chunks[i].end = chunks[i].begin;
+            continue;
+        } else if (chunks[i].error != NULL) {
+            return &chunks[i];
+        }
+        chunks[i].startX = x;
+        chunks[i].startY = y;
+        if (chunks[i].rows > 0) {
+            y += chunks[i].rows;
+            x = oX + chunks[i].tailCells;
+        } else {
+            x += chunks[i].tailCells;
+        }
+        finished = chunks[i].finished;
+    }
+
+    // pass 2: decode each chunk into the grid
+#pragma omp parallel for default(none) shared(world, chunks, numChunks, oX) schedule(static, 1)
+    for (int i = 0; i < numChunks; i++) {
+        traceBegin("RLE decode chunk");
+        decodeRLEChunk(world, &chunks[i], true, oX);
+        traceEnd("RLE decode chunk");
+    }
+    for (int i = 0; i < numChunks; i++) {
+        if (chunks[i].error != NULL) {
+            return &chunks[i];
+        }
+    }
+    return NULL;
+}
+
+/// Inserts an RLE pattern from an open stream, see lifeInsertPatternRLE()
+static bool insertPatternRLE(LifeWorld_t *world, Stream_t *stream, uint32_t oX, uint32_t oY) {
+    double begin = utilsGetTime();
+    log_info("Reading RLE pattern %s", stream->filename);
+    invalidateStates(world, false);
+    const char *line = NULL;
+    size_t length = 0;
+
+    // skip the preamble: comment lines starting with a hash, and the "x = 123, y = 456" line
+    bool found = false;
+    while (streamReadLine(stream, &line, &length)) {
+        if (length > 0 && *line != '#' && *line != 'x') {
+            streamUnreadLine(stream);
+            found = true;
+            break;
+        }
+    }
+    if (!checkPatternRead(stream)) {
+        return false;
+    } else if (!found) {
+        log_error("Unexpected EOF while skipping RLE header");
+        return false;
+    }
+
+    // compressed files and stdin are decoded a block at a time as the reader thread produces them,
+    // carrying the position and any half read run length over from one block to the next
+    int threads = omp_get_max_threads();
+    RLEChunk_t *failed = NULL;
+    RLEChunk_t chunk = {.startX = oX, .startY = oY};
+    RLEChunk_t *chunks = NULL;
+    const char *data = NULL;
+    size_t size = 0;
+    while (!chunk.finished && streamRead(stream, &data, &size)) {
+        log_trace("Decoding %zu bytes of RLE content at idx %lu", size,
+                  streamOffset(stream, data));
+        // small files aren't worth starting threads for. Generations states are packed 64 cells
+        // to a word, so chunks could write to the same word, and they're decoded on one thread.
+        if (streamIsMapped(stream) && threads > 1 && size >= RLE_PARALLEL_MIN_BYTES
+            && world->states == NULL) {
+            chunks = calloc(threads, sizeof(RLEChunk_t));
+            failed = decodeRLEParallel(world, chunks, threads, data, data + size, oX, oY);
+            break;
+        }
+        chunk.begin = data;
+        chunk.end = data + size;
+        decodeRLEChunk(world, &chunk, true, oX);
+        if (chunk.error != NULL) {
+            failed = &chunk;
+            break;
+        }
+        if (chunk.rows > 0) {
+            chunk.startY += chunk.rows;
+            chunk.startX = oX + chunk.tailCells;
+        } else {
+            chunk.startX += chunk.tailCells;
+        }
+    }
+
+    if (failed != NULL) {
+        log_error("Failed to decode RLE at idx %lu ('%c'): %s",
+                  streamOffset(stream, failed->error), *failed->error, failed->errorReason);
+        log_error("Please check the pattern is valid, and the current grid size of %ux%u is "
+                  "large enough to hold it.", world->width, world->height);
+        free(chunks);
+        return false;
+    }
+    free(chunks);
+    if (!checkPatternRead(stream)) {
+        return false;
+    }
+    logPatternRead(stream, begin);
+    return true;
+}
+
+bool lifeWorldInsertPatternRLE(LifeWorld_t *world, const char *filename, uint32_t oX,
+                               uint32_t oY) {
+    Stream_t stream;
+    if (!openPattern(&stream, filename)) {
+        return false;
+    }
+    bool inserted = insertPatternRLE(world, &stream, oX, oY);
+    streamClose(&stream);
+    return inserted;
+}
+
+/**
+ * Paints a macrocell node into the grid. Only rows with live cells are written, and the live cells
+ * must all be inside the grid, but the rest of the node may hang off the edges.
+ * @param world world to paint into
+ * @param tree the macrocell tree
+ * @param unpack table from buildUnpackTable()
+ * @param index node to paint
+ * @param x grid x-coord of the top left corner of the node, may be negative
+ * @param y grid y-coord of the top left corner of the node, may be negative
+ */
+static void paintMacrocellNode(LifeWorld_t *world, const MacrocellTree_t *tree,
+                               const uint64_t *unpack, uint32_t index, int64_t x, int64_t y) {
+    const MacrocellNode_t *node = &tree->nodes[index];
+    if (node->empty) {
+        return;
+    }
+    if (node->level == 3) {
+        for (int64_t row = 0; row < 8; row++) {
+            uint8_t bits = (uint8_t) (node->cells >> (8 * row));
+            if (bits == 0) {
+                continue;
+            }
+            bool *cells = &world->grid[(size_t) world->width * (y + row)];
+            if (x >= 0 && x + 8 <= world->width) {
+                memcpy(&cells[x], &unpack[bits], sizeof(uint64_t));
+            } else {
+                // leaf hangs off the edge of the grid, so just set its live cells
+                for (int64_t i = 0; i < 8; i++) {
+                    if ((bits >> i) & 1) {
+                        cells[x + i] = true;
+                    }
+                }
+            }
+        }
+        return;
+    }
+    // optimisation: shared subtrees are decoded once, but still have to be painted everywhere they
+    // appear, so paint big subtrees in parallel. The children cover disjoint parts of the grid.
+    int64_t half = (int64_t) 1 << (node->level - 1);
+    for (int i = 0; i < 4; i++) {
+#pragma omp task default(none) firstprivate(world, tree, unpack, node, i, x, y, half) \
+        if(node->level >= MACROCELL_TASK_LEVEL)
+        paintMacrocellNode(world, tree, unpack, node->children[i], x + (i & 1) * half,
+                           y + (i >> 1) * half);
+    }
+}
+
+/// Paints a parsed macrocell tree into the grid, with the top left of the bounding box of its live
+/// cells at (oX, oY). Returns false (after logging why) if it doesn't fit.
+static bool paintMacrocell(LifeWorld_t *world, const MacrocellTree_t *tree, uint32_t oX,
+                           uint32_t oY) {
+    invalidateStates(world, false);
+    uint32_t width = 0, height = 0;
+    if (!getMacrocellSize(tree, &width, &height) || (uint64_t) oX + width > world->width
+            || (uint64_t) oY + height > world->height) {
+        log_error("Macrocell pattern doesn't fit in the grid at (%u,%u)", oX, oY);
+        log_error("Please check the current grid size of %ux%u is large enough to hold the "
+                  "pattern.", world->width, world->height);
+        return false;
+    }
+
+    uint64_t unpack[256];
+    buildUnpackTable(unpack);
+    uint32_t root = tree->count - 1;
+    // place the root so that the top left of its bounding box lands on (oX, oY)
+    int64_t x = (int64_t) oX - (int64_t) tree->nodes[root].minX;
+    int64_t y = (int64_t) oY - (int64_t) tree->nodes[root].minY;
+#pragma omp parallel default(none) shared(world, tree, unpack, root, x, y)
+#pragma omp single
+    paintMacrocellNode(world, tree, unpack, root, x, y);
+    return true;
+}
+
+/// Inserts a macrocell pattern from an open stream, see lifeInsertPatternMacrocell()
+static bool insertPatternMacrocell(LifeWorld_t *world, Stream_t *stream, uint32_t oX,
+                                   uint32_t oY) {
+    double begin = utilsGetTime();
+    log_info("Reading macrocell pattern %s", stream->filename);
+    MacrocellTree_t tree;
+    uint64_t errorLine = 0;
+    const char *error = parseMacrocell(stream, &tree, &errorLine);
+    if (error != NULL) {
+        log_error("Failed to decode macrocell file at line %lu: %s", errorLine, error);
+        freeMacrocell(&tree);
+        return false;
+    }
+    bool inserted = paintMacrocell(world, &tree, oX, oY);
+    if (inserted) {
+        double elapsed = utilsGetTime() - begin;
+        log_info("Read %u nodes (%.2f MiB) in %.1f ms", tree.count - 1,
+                 streamOffset(stream, stream->pos) / 1048576.0, elapsed * 1000.0);
+    }
+    freeMacrocell(&tree);
+    return inserted;
+}
+
+bool lifeWorldInsertPatternMacrocell(LifeWorld_t *world, const char *filename, uint32_t oX,
+                                     uint32_t oY) {
+    Stream_t stream;
+    if (!openPattern(&stream, filename)) {
+        return false;
+    }
+    bool inserted = insertPatternMacrocell(world, &stream, oX, oY);
+    streamClose(&stream);
+    return inserted;
+}
+
+bool lifeWorldInsertPattern(LifeWorld_t *world, const char *filename, uint32_t oX, uint32_t oY) {
+    // open the file once and pick the decoder, so stdin can be sniffed without losing anything
+    Stream_t stream;
+    if (!openPattern(&stream, filename)) {
+        return false;
+    }
+    bool inserted;
+    switch (getPatternFormat(&stream)) {
+        case PATTERN_RLE:
+            inserted = insertPatternRLE(world, &stream, oX, oY);
+            break;
+        case PATTERN_MACROCELL:
+            inserted = insertPatternMacrocell(world, &stream, oX, oY);
+            break;
+        default:
+            inserted = insertPatternPlainText(world, &stream, oX, oY);
+            break;
+    }
+    streamClose(&stream);
+    return inserted;
+}
+
+/// Inserts a plain text pattern from the rows packed by lifeOpenPattern()
+static bool insertPackedPlainText(LifeWorld_t *world, const LifePattern_t *pattern, uint32_t oX,
+                                  uint32_t oY) {
+    invalidateStates(world, false);
+    // the rows were all read when the pattern was opened, so the bounds are checked once
+    if (pattern->height > 0 && ((uint64_t) oX + pattern->width > world->width
+                                || (uint64_t) oY + pattern->height > world->height)) {
+        log_error("Plain text pattern doesn't fit in the grid at (%u,%u)", oX, oY);
+        log_error("Please check the current grid size of %ux%u can hold the pattern.",
+                  world->width, world->height);
+        return false;
+    }
+    uint64_t unpack[256];
+    buildUnpackTable(unpack);
+    const uint8_t *packed = pattern->packed;
+    for (uint32_t y = 0; y < pattern->height; y++) {
+        bool *row = &world->grid[oX + (size_t) world->width * (oY + y)];
+        uint32_t length = pattern->rowLengths[y];
+        uint32_t x = 0;
+        for (; x + 8 <= length; x += 8) {
+            memcpy(&row[x], &unpack[packed[x / 8]], 8);
+        }
+        for (; x < length; x++) {
+            row[x] = (packed[x / 8] >> (x % 8)) & 1;
+        }
+        packed += (length + 7) / 8;
+    }
+    return true;
+}
+
+bool lifeWorldInsertOpenPattern(LifeWorld_t *world, LifePattern_t *pattern, uint32_t oX,
+                                uint32_t oY) {
+    if (pattern->inserted) {
+        log_error("Pattern %s has already been inserted", pattern->filename);
+        return false;
+    }
+    pattern->inserted = true;
+    switch (pattern->format) {
+        case PATTERN_RLE: {
+            bool inserted = insertPatternRLE(world, &pattern->stream, oX, oY);
+            streamClose(&pattern->stream);
+            return inserted;
+        }
+        case PATTERN_MACROCELL:
+            return paintMacrocell(world, &pattern->tree, oX, oY);
+        default:
+            return insertPackedPlainText(world, pattern, oX, oY);
+    }
+}
+
+/**
+ * splitmix64's output function. Applied to seed + n * SOUP_GAMMA it gives the nth number of a
+ * splitmix64 stream directly, so any cell's random number can be worked out from its index alone.
+ */
+static inline uint64_t splitmix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/// Returns the random number threshold below which a soup cell is alive
+static inline uint32_t soupThreshold(double density) {
+    // a density of 1 (threshold 65536) makes every cell alive
+    return (uint32_t) (MAX(0.0, MIN(density, 1.0)) * SOUP_DENSITY_STEPS + 0.5);
+}
+
+/**
+ * Generates row y of a soup. Every random number comes from the cell's position in the soup rather
+ * than from a per-thread generator, so the soup is the same however the rows are split up.
+ * @param row where to write the row's cells
+ * @param key splitmix64 of the seed
+ */
+static inline void generateSoupRow(bool *row, uint32_t y, uint32_t width, uint32_t threshold,
+                                   uint64_t key) {
+    uint64_t wordsPerRow = (width + SOUP_CELLS_PER_WORD - 1) / SOUP_CELLS_PER_WORD;
+    uint64_t counter = (uint64_t) y * wordsPerRow;
+    for (uint32_t x = 0; x < width; x += SOUP_CELLS_PER_WORD) {
+        uint64_t random = splitmix64(key + (++counter) * SOUP_GAMMA);
+        uint32_t cells = MIN(SOUP_CELLS_PER_WORD, width - x);
+        for (uint32_t i = 0; i < cells; i++) {
+            row[x + i] = ((random >> (16 * i)) & 0xFFFF) < threshold;
+        }
+    }
+}
+
+bool lifeWorldInsertSoup(LifeWorld_t *world, uint32_t oX, uint32_t oY, uint32_t width,
+                         uint32_t height, double density, uint64_t seed) {
+    double begin = utilsGetTime();
+    if ((uint64_t) oX + width > world->width || (uint64_t) oY + height > world->height) {
+        log_error("Failed to insert %ux%u soup at %u,%u", width, height, oX, oY);
+        log_error("Please check the current grid size of %ux%u can hold the soup.", world->width,
+                  world->height);
+        return false;
+    }
+    uint32_t threshold = soupThreshold(density);
+    uint64_t key = splitmix64(seed);
+    invalidateStates(world, false);
+
+#pragma omp parallel for default(none) shared(world, oX, oY, width, height, threshold, key) \
+        schedule(static)
+    for (uint32_t y = 0; y < height; y++) {
+        bool *row = &world->grid[oX + (size_t) world->width * (oY + y)];
+        generateSoupRow(row, y, width, threshold, key);
+    }
+
+    double elapsed = utilsGetTime() - begin;
+    log_info("Generated %ux%u soup with density %.3f and seed %lu in %.1f ms", width, height,
+             density, seed, elapsed * 1000.0);
+    return true;
+}
+
+void lifeGenerateSoup(bool *cells, uint32_t width, uint32_t height, double density, uint64_t seed) {
+    uint32_t threshold = soupThreshold(density);
+    uint64_t key = splitmix64(seed);
+    for (uint32_t y = 0; y < height; y++) {
+        generateSoupRow(&cells[(size_t) width * y], y, width, threshold, key);
+    }
+}
+
+void lifeWorldDestroy(LifeWorld_t *world) {
+    if (world == NULL) {
+        return;
+    }
+    freeGrid(world->grid, (size_t) world->width * world->height);
+    freeGrid(world->nextGrid, (size_t) world->width * world->height);
+    if (world->states != NULL) {
+        generationsDestroy(world->states);
+        free(world->states);
+    }
+    free(world);
+}
+
+uint64_t lifeWorldGetGenerations(const LifeWorld_t *world) {
+    return world->generations;
+}
+
+uint64_t lifeWorldGetPopulation(const LifeWorld_t *world) {
+    uint64_t population = 0;
+#pragma omp parallel for default(none) shared(world) reduction(+:population)
+    for (uint32_t y = 0; y < world->height; y++) {
+        for (uint32_t x = 0; x < world->width; x++) {
+            population += getCellUnsafe(world, x, y);
+        }
+    }
+    return population;
+}
+
+const bool *lifeWorldGetGrid(const LifeWorld_t *world) {
+    return world->grid;
+}
+
+void lifeWorldSetGrid(LifeWorld_t *world, const bool *cells) {
+    memcpy(world->grid, cells, (size_t) world->width * world->height * sizeof(bool));
+    invalidateStates(world, true);
+}
+
+void lifeWorldGetStates(const LifeWorld_t *world, uint32_t y, uint8_t *states) {
+    assert(y < world->height);
+    const bool *row = &world->grid[(size_t) world->width * y];
+    if (world->states == NULL) {
+        // bools are 0 or 1, so they're already states
+        memcpy(states, row, world->width);
+        return;
+    }
+    generationsGetRow(world->states, y, states);
+    if (world->statesStale) {
+        // same as generationsLoadGrid(): the grid has the last word on which cells are alive
+        for (uint32_t x = 0; x < world->width; x++) {
+            if (row[x]) {
+                states[x] = 1;
+            } else if (states[x] == 1) {
+                states[x] = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Writes a whole buffer to a file. write() may be cut short (e.g. by a signal), in which case we
+ * carry on from where it got to.
+ * @return true on success, false on error with errno set
+ */
+static bool writeAll(int fd, const void *data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, (const char *) data + written, size - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        } else if (result == -1) {
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+/// Works out the bytes per row of a snapshot's payload
+static inline uint32_t snapshotRowBytes(uint32_t width) {
+    return (uint32_t) (((uint64_t) width + 7) / 8);
+}
+
+/// Works out the number of bit planes in a snapshot's payload, enough to hold every state of
+/// the rule
+static inline uint32_t snapshotPlanes(const LifeRule_t *rule, uint32_t version) {
+    uint32_t maxState = rule->dyingStates + 1;
+    return version == 1 ? 1 : 32 - (uint32_t) __builtin_clz(maxState);
+}
+
+/**
+ * Packs one bit of each cell of a row 8 cells to a byte, least significant bit first
+ * @param cells cells of the row, one byte each (bools or states)
+ * @param bit which bit of each cell to pack
+ */
+static void packRow(const uint8_t *cells, uint32_t width, uint32_t bit, uint8_t *packed) {
+    uint32_t x = 0;
+    // optimisation: pack 8 cells at a time. Once each byte is masked down to the bit we want (0 or
+    // 1), loading them as a (little endian) word and multiplying gathers cell i into bit i of the
+    // top byte
+    for (; x + 8 <= width; x += 8) {
+        uint64_t bits;
+        memcpy(&bits, &cells[x], sizeof(bits));
+        bits = (bits >> bit) & 0x0101010101010101ULL;
+        packed[x / 8] = (uint8_t) ((bits * 0x0102040810204080ULL) >> 56);
+    }
+    if (x < width) {
+        uint8_t last = 0;
+        for (uint32_t i = 0; x + i < width; i++) {
+            last |= (uint8_t) (((cells[x + i] >> bit) & 1) << i);
+        }
+        packed[x / 8] = last;
+    }
+}
+
+/**
+ * Checks a snapshot file is one we can load
+ * @param data contents of the file
+ * @param size size of the file in bytes
+ * @return NULL if it's valid, otherwise the reason it isn't
+ */
+static const char *checkSnapshot(const char *data, size_t size) {
+    const SnapshotHeader_t *header = (const SnapshotHeader_t *) data;
+    if (size < sizeof(SnapshotHeader_t)) {
+        return "snapshot is truncated or corrupt";
+    } else if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a snapshot file";
+    } else if (header->version != 1 && header->version != LIFE_SNAPSHOT_VERSION) {
+        return "unsupported snapshot version";
+    } else if (header->headerSize < sizeof(SnapshotHeader_t)
+               || header->headerSize > size) {
+        return "snapshot is truncated or corrupt";
+    }
+    const char *ruleString = getSnapshotRule(data);
+    LifeRule_t rule;
+    if (ruleString == NULL || !lifeParseRule(ruleString, &rule)) {
+        return "snapshot uses an unknown rule";
+    } else if (header->topology >= LIFE_TOPOLOGY_COUNT) {
+        return "snapshot uses an unknown topology";
+    }
+    uint64_t planeSize = (uint64_t) header->rowBytes * header->height;
+    if (header->rowBytes != snapshotRowBytes(header->width)
+            || header->payloadSize != planeSize * snapshotPlanes(&rule, header->version)
+            || header->headerSize + header->payloadSize > size) {
+        return "snapshot is truncated or corrupt";
+    }
+    return NULL;
+}
+
+bool lifeWorldSaveSnapshot(const LifeWorld_t *world, const char *filename) {
+    double begin = utilsGetTime();
+    uint32_t rowBytes = snapshotRowBytes(world->width);
+    uint32_t planes = snapshotPlanes(&world->rule, LIFE_SNAPSHOT_VERSION);
+    size_t planeSize = (size_t) rowBytes * world->height;
+    SnapshotHeader_t header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = LIFE_SNAPSHOT_VERSION,
+        .headerSize = sizeof(SnapshotHeader_t),
+        .width = world->width,
+        .height = world->height,
+        .generations = world->generations,
+        .topology = world->topology,
+        .rowBytes = rowBytes,
+        .payloadSize = (uint64_t) planeSize * planes,
+    };
+    char rule[LIFE_MAX_RULE_STRING];
+    lifeFormatRule(&world->rule, rule);
+    size_t ruleSize = strlen(rule) + 1;
+    if (ruleSize <= sizeof(header.rule)) {
+        memcpy(header.rule, rule, ruleSize);
+    } else {
+        header.headerSize += ruleSize;
+    }
+    // optimisation: build the whole file in memory, so it goes to the kernel in one big write
+    // rather than lots of small ones
+    size_t size = header.headerSize + header.payloadSize;
+    uint8_t *data = malloc(size);
+    if (data == NULL) {
+        log_error("Failed to allocate %zu bytes for snapshot", size);
+        return false;
+    }
+    memcpy(data, &header, sizeof(header));
+    if (header.rule[0] == '\0') {
+        memcpy(data + sizeof(header), rule, ruleSize);
+    }
+    uint8_t *payload = data + header.headerSize;
+
+#pragma omp parallel default(none) shared(world, payload, rowBytes, planes, planeSize)
+    {
+        // Generations rules save the states rather than the grid, which only has the live cells
+        uint8_t *states = world->states != NULL ? malloc(MAX(world->width, 1)) : NULL;
+#pragma omp for
+        for (uint32_t y = 0; y < world->height; y++) {
+            const uint8_t *row = (const uint8_t *) &world->grid[(size_t) world->width * y];
+            if (states != NULL) {
+                lifeWorldGetStates(world, y, states);
+                row = states;
+            }
+            for (uint32_t k = 0; k < planes; k++) {
+                packRow(row, world->width, k, &payload[planeSize * k + (size_t) rowBytes * y]);
+            }
+        }
+        free(states);
+    }
+
+    // write to a temporary file then rename it, so a crash part way through can't clobber the
+    // previous snapshot
+    char tmpFilename[4096];
+    snprintf(tmpFilename, sizeof(tmpFilename), "%s.tmp", filename);
+    int fd = open(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        log_error("Failed to open file %s for writing: %s", tmpFilename, strerror(errno));
+        free(data);
+        return false;
+    }
+    if (!writeAll(fd, data, size)) {
+        log_error("Failed to write snapshot %s: %s", tmpFilename, strerror(errno));
+        close(fd);
+        unlink(tmpFilename);
+        free(data);
+        return false;
+    }
+    free(data);
+    if (close(fd) == -1 || rename(tmpFilename, filename) == -1) {
+        log_error("Failed to write snapshot %s: %s", filename, strerror(errno));
+        unlink(tmpFilename);
+        return false;
+    }
+
+    double elapsed = utilsGetTime() - begin;
+    log_info("Saved generation %lu to snapshot %s (%.1f MiB) in %.3f ms", world->generations,
+             filename, size / (1024.0 * 1024.0), elapsed * 1000.0);
+    return true;
+}
+
+bool lifeGetSnapshotSize(const char *filename, uint32_t *width, uint32_t *height) {
+    size_t size = 0;
+    const char *data = utilsMapFile(filename, &size);
+    if (data == NULL) {
+        log_error("Failed to open file %s for reading: %s", filename, strerror(errno));
+        return false;
+    }
+    const char *reason = checkSnapshot(data, size);
+    if (reason != NULL) {
+        log_error("Failed to read snapshot %s: %s", filename, reason);
+        utilsUnmapFile(data, size);
+        return false;
+    }
+    const SnapshotHeader_t *header = (const SnapshotHeader_t *) data;
+    *width = header->width;
+    *height = header->height;
+    utilsUnmapFile(data, size);
+    return true;
+}
+
+bool lifeWorldLoadSnapshot(LifeWorld_t *world, const char *filename) {
+    double begin = utilsGetTime();
+    size_t size = 0;
+    const char *data = utilsMapFile(filename, &size);
+    if (data == NULL) {
+        log_error("Failed to open file %s for reading: %s", filename, strerror(errno));
+        return false;
+    }
+    const SnapshotHeader_t *header = (const SnapshotHeader_t *) data;
+    const char *reason = checkSnapshot(data, size);
+    if (reason != NULL) {
+        log_error("Failed to load snapshot %s: %s", filename, reason);
+        utilsUnmapFile(data, size);
+        return false;
+    } else if (header->width != world->width || header->height != world->height) {
+        log_error("Snapshot %s is %ux%u, but the grid is %ux%u", filename, header->width,
+                  header->height, world->width, world->height);
+        utilsUnmapFile(data, size);
+        return false;
+    }
+
+    // the rule goes first, so a Generations rule's states exist to be loaded into
+    world->generations = header->generations;
+    world->topology = (LifeTopology_t) header->topology;
+    LifeRule_t rule;
+    lifeParseRule(getSnapshotRule(data), &rule);
+    lifeWorldSetRule(world, &rule);
+
+    uint64_t expand[256];
+    buildUnpackTable(expand);
+    const uint8_t *payload = (const uint8_t *) data + header->headerSize;
+    uint32_t rowBytes = header->rowBytes;
+    uint32_t planes = snapshotPlanes(&rule, header->version);
+    size_t planeSize = (size_t) rowBytes * world->height;
+    bool invalid = false;
+#pragma omp parallel default(none) shared(world, payload, rowBytes, expand, planes, planeSize) \
+        reduction(||:invalid)
+    {
+        uint8_t *states = world->states != NULL ? malloc(MAX(world->width, 1)) : NULL;
+#pragma omp for
+        for (uint32_t y = 0; y < world->height; y++) {
+            // the states are put together from each plane in turn, or for two-state rules the
+            // one plane is unpacked straight into the grid
+            bool *grid = &world->grid[(size_t) world->width * y];
+            uint8_t *row = states != NULL ? states : (uint8_t *) grid;
+            memset(row, 0, world->width);
+            for (uint32_t k = 0; k < planes; k++) {
+                const uint8_t *packed = &payload[planeSize * k + (size_t) rowBytes * y];
+                uint32_t x = 0;
+                for (; x + 8 <= world->width; x += 8) {
+                    uint64_t cells;
+                    memcpy(&cells, &row[x], sizeof(cells));
+                    cells |= expand[packed[x / 8]] << k;
+                    memcpy(&row[x], &cells, sizeof(cells));
+                }
+                for (uint32_t i = 0; x + i < world->width; i++) {
+                    row[x + i] |= (uint8_t) (((packed[x / 8] >> i) & 1) << k);
+                }
+            }
+            if (states != NULL) {
+                for (uint32_t x = 0; x < world->width; x++) {
+                    // planes can hold states beyond the rule's if the file is corrupt
+                    invalid |= states[x] > world->rule.dyingStates + 1;
+                    states[x] = MIN(states[x], world->rule.dyingStates + 1);
+                    grid[x] = states[x] == 1;
+                }
+                generationsSetRow(world->states, y, states);
+            }
+        }
+        free(states);
+    }
+    if (invalid) {
+        log_error("Failed to load snapshot %s: cell states are beyond the rule's number of states",
+                  filename);
+        utilsUnmapFile(data, size);
+        return false;
+    }
+    // the states were loaded along with the grid (for version 1 snapshots, which only have the
+    // live cells, the dying cells are lost)
+    world->statesStale = false;
+
+    double elapsed = utilsGetTime() - begin;
+    log_info("Resumed generation %lu from snapshot %s in %.3f ms", world->generations, filename,
+             elapsed * 1000.0);
+    utilsUnmapFile(data, size);
+    return true;
+}
+
+/**
+ * Finds where the run of cells with the same state as row[x] ends, checking 8 cells at a time.
+ * @param row row of cells, one byte each: grid bools or Generations states
+ * @param x start of the run
+ * @param end end of the row
+ * @return index of the first cell after the run
+ */
+static inline uint32_t findRunEnd(const uint8_t *row, uint32_t x, uint32_t end) {
+    uint8_t value = row[x];
+    // each cell is one byte, so a run of 8 cells in state 1 is 0x0101010101010101
+    uint64_t run = value * 0x0101010101010101ULL;
+    x++;
+    for (; x + 8 <= end; x += 8) {
+        uint64_t cells;
+        memcpy(&cells, &row[x], sizeof(cells));
+        if (cells != run) {
+            // the lowest differing byte (little endian) is the first cell that breaks the run
+            return x + __builtin_ctzll(cells ^ run) / 8;
+        }
+    }
+    while (x < end && row[x] == value) {
+        x++;
+    }
+    return x;
+}
+
+/**
+ * Finds the last cell in a row that isn't dead, checking 8 cells at a time.
+ * @param row row of cells, one byte each: grid bools or Generations states
+ * @return index of the cell after the last one that isn't dead, or 0 if the row is empty
+ */
+static inline uint32_t findRowEnd(const uint8_t *row, uint32_t width) {
+    uint32_t x = width;
+    for (; x >= 8; x -= 8) {
+        uint64_t cells;
+        memcpy(&cells, &row[x - 8], sizeof(cells));
+        if (cells != 0) {
+            return x - 8 + (63 - __builtin_clzll(cells)) / 8 + 1;
+        }
+    }
+    while (x > 0 && row[x - 1] == 0) {
+        x--;
+    }
+    return x;
+}
+
+/**
+ * Gets a row to export, one byte per cell
+ * @param states NULL to get the row of the grid, or a buffer of world->width bytes to get the
+ * states of its cells (for Generations rules) into
+ */
+static const uint8_t *getExportRow(const LifeWorld_t *world, uint32_t y, uint8_t *states) {
+    if (states == NULL) {
+        return (const uint8_t *) &world->grid[(size_t) world->width * y];
+    }
+    lifeWorldGetStates(world, y, states);
+    return states;
+}
+
+/**
+ * Finds the smallest rectangle containing every live cell, or every cell that isn't dead.
+ * @param states NULL to only look at live cells, or a buffer of world->width bytes to look at the
+ * cells' states with, so dying cells of Generations rules are included too
+ * @return false if there are no such cells
+ */
+static bool findBoundingBox(const LifeWorld_t *world, uint8_t *states, uint32_t *minX,
+                            uint32_t *minY, uint32_t *maxX, uint32_t *maxY) {
+    *minX = UINT32_MAX;
+    *minY = UINT32_MAX;
+    *maxX = *maxY = 0;
+    for (uint32_t y = 0; y < world->height; y++) {
+        const uint8_t *row = getExportRow(world, y, states);
+        uint32_t rowEnd = findRowEnd(row, world->width);
+        if (rowEnd == 0) {
+            continue;
+        }
+        uint32_t rowBegin = row[0] ? 0 : findRunEnd(row, 0, world->width);
+        *minX = MIN(*minX, rowBegin);
+        *maxX = MAX(*maxX, rowEnd - 1);
+        *minY = MIN(*minY, y);
+        *maxY = y;
+    }
+    return *minY != UINT32_MAX;
+}
+
+/// Writes out everything in the export buffer
+static void exportFlush(ExportWriter_t *writer) {
+    if (!writer->failed && !writeAll(writer->fd, writer->buffer, writer->used)) {
+        writer->failed = true;
+    }
+    writer->used = 0;
+}
+
+/// Appends some text to the export buffer, flushing it to the file when it's full
+static void exportWrite(ExportWriter_t *writer, const char *text, size_t length) {
+    while (length > 0) {
+        if (writer->used == EXPORT_BUFFER_SIZE) {
+            exportFlush(writer);
+        }
+        size_t chunk = MIN(length, EXPORT_BUFFER_SIZE - writer->used);
+        memcpy(writer->buffer + writer->used, text, chunk);
+        writer->used += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Formats a number in decimal by hand. This is much faster than snprintf(), which would otherwise
+ * dominate the export time, since there can be one number per cell.
+ * @param end where the number should end
+ * @param value the number
+ * @return where the number begins
+ */
+static inline char *formatUInt(char *end, uint64_t value) {
+    do {
+        *--end = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    return end;
+}
+
+/// Appends an RLE "<count><tag>" item to the export buffer, starting a new line if it won't fit
+static void exportRLEItem(ExportWriter_t *writer, uint64_t count, const char *tag) {
+    char item[32];
+    size_t tagLength = strlen(tag);
+    char *begin = &item[sizeof(item) - tagLength];
+    memcpy(begin, tag, tagLength);
+    if (count > 1) {
+        begin = formatUInt(begin, count);
+    }
+    uint32_t length = (uint32_t) (&item[sizeof(item)] - begin);
+    if (writer->column + length > RLE_LINE_LENGTH) {
+        exportWrite(writer, "\n", 1);
+        writer->column = 0;
+    }
+    exportWrite(writer, begin, length);
+    writer->column += length;
+}
+
+/**
+ * Formats the multi-state RLE tag for a state: "." for dead, "A" to "X" for states 1 to 24, then
+ * "pA" to "pX" for the next 24 and so on up to "y"
+ * @param tag where to write the tag, with room for 3 characters
+ */
+static void formatStateTag(uint32_t state, char *tag) {
+    if (state == 0) {
+        strcpy(tag, ".");
+    } else if (state <= 24) {
+        tag[0] = (char) ('A' + state - 1);
+        tag[1] = '\0';
+    } else {
+        tag[0] = (char) ('o' + (state - 1) / 24);
+        tag[1] = (char) ('A' + (state - 1) % 24);
+        tag[2] = '\0';
+    }
+}
+
+/**
+ * Opens a file for exporting and sets up its buffer
+ * @return true on success, false (after logging why) on failure
+ */
+static bool exportOpen(ExportWriter_t *writer, const char *filename) {
+    *writer = (ExportWriter_t) {.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    if (writer->fd == -1) {
+        log_error("Failed to open file %s for writing: %s", filename, strerror(errno));
+        return false;
+    }
+    writer->buffer = malloc(EXPORT_BUFFER_SIZE);
+    if (writer->buffer == NULL) {
+        log_error("Failed to allocate export buffer");
+        close(writer->fd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Flushes and closes an export file
+ * @return true if the whole file was written successfully, false (after logging why) if not
+ */
+static bool exportClose(const LifeWorld_t *world, ExportWriter_t *writer, const char *filename,
+                        double begin) {
+    exportFlush(writer);
+    // save errno from the failed write, if any, since free() and close() might clobber it
+    int error = errno;
+    free(writer->buffer);
+    if (close(writer->fd) == -1 && !writer->failed) {
+        writer->failed = true;
+        error = errno;
+    }
+    if (writer->failed) {
+        log_error("Failed to export to %s: %s", filename, strerror(error));
+        return false;
+    }
+    log_info("Exported generation %lu to %s in %.3f ms", world->generations, filename,
+             (utilsGetTime() - begin) * 1000.0);
+    return true;
+}
+
+bool lifeWorldExportRLE(const LifeWorld_t *world, const char *filename) {
+    double begin = utilsGetTime();
+    ExportWriter_t writer;
+    if (!exportOpen(&writer, filename)) {
+        return false;
+    }
+    // Generations rules need their dying states, so they're written with multi-state tags
+    uint8_t *states = world->states != NULL ? malloc(MAX(world->width, 1)) : NULL;
+    char tags[LIFE_MAX_STATES][3] = {"b", "o"};
+    for (uint32_t state = 0; states != NULL && state <= world->rule.dyingStates + 1; state++) {
+        formatStateTag(state, tags[state]);
+    }
+    uint32_t minX, minY, maxX, maxY;
+    bool empty = !findBoundingBox(world, states, &minX, &minY, &maxX, &maxY);
+    char rule[LIFE_MAX_RULE_STRING];
+    lifeFormatRule(&world->rule, rule);
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "#C Generation %lu, exported by gameoflife v" VERSION "\n"
+                          "x = %u, y = %u, rule = %s\n", world->generations,
+                          empty ? 0 : maxX - minX + 1, empty ? 0 : maxY - minY + 1, rule);
+    exportWrite(&writer, header, length);
+
+    // "$" tags are held back until the next run of live cells, so that empty rows become one
+    // "N$" item and there's nothing trailing after the last live cell
+    uint64_t pendingRows = 0;
+    for (uint32_t y = minY; !empty && y <= maxY; y++) {
+        const uint8_t *row = getExportRow(world, y, states);
+        // optimisation: trailing dead cells are never written, so stop at the last cell that
+        // isn't dead
+        uint32_t end = findRowEnd(row, maxX + 1);
+        for (uint32_t x = minX; x < end;) {
+            uint32_t runEnd = findRunEnd(row, x, end);
+            if (pendingRows > 0) {
+                exportRLEItem(&writer, pendingRows, "$");
+                pendingRows = 0;
+            }
+            exportRLEItem(&writer, runEnd - x, tags[row[x]]);
+            x = runEnd;
+        }
+        pendingRows++;
+    }
+    free(states);
+    exportRLEItem(&writer, 1, "!");
+    exportWrite(&writer, "\n", 1);
+    return exportClose(world, &writer, filename, begin);
+}
+
+bool lifeWorldExportPlainText(const LifeWorld_t *world, const char *filename) {
+    double begin = utilsGetTime();
+    ExportWriter_t writer;
+    if (!exportOpen(&writer, filename)) {
+        return false;
+    }
+    uint32_t minX, minY, maxX, maxY;
+    bool empty = !findBoundingBox(world, NULL, &minX, &minY, &maxX, &maxY);
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "!Generation %lu, exported by gameoflife v" VERSION "\n",
+                          world->generations);
+    exportWrite(&writer, header, length);
+
+    char *line = malloc(empty ? 1 : (size_t) maxX - minX + 2);
+    for (uint32_t y = minY; !empty && y <= maxY; y++) {
+        const bool *row = &world->grid[(size_t) world->width * y];
+        uint32_t width = maxX - minX + 1;
+        uint32_t x = 0;
+        // optimisation: convert 8 cells at a time. Each bool is 0 or 1, so adding it times
+        // ('O' - '.') to a word of '.' turns each byte into the right character without carries
+        for (; x + 8 <= width; x += 8) {
+            uint64_t cells;
+            memcpy(&cells, &row[minX + x], sizeof(cells));
+            uint64_t chars = 0x2E2E2E2E2E2E2E2EULL + cells * ('O' - '.');
+            memcpy(&line[x], &chars, sizeof(chars));
+        }
+        for (; x < width; x++) {
+            line[x] = row[minX + x] ? 'O' : '.';
+        }
+        line[width] = '\n';
+        exportWrite(&writer, line, width + 1);
+    }
+    free(line);
+    return exportClose(world, &writer, filename, begin);
+}
+
+/// Grid cells covered by the macrocell tree being exported
+typedef struct {
+    /// World being exported
+    const LifeWorld_t *world;
+    /// Top left of the tree, and the end of the live cells in the grid
+    uint64_t x, y, endX, endY;
+    /// Hash table of the nodes written so far, so identical subtrees are only written once
+    MacrocellEntry_t *entries;
+    /// Slots in the hash table (a power of two), and nodes written so far
+    size_t capacity, count;
+    ExportWriter_t *writer;
+} MacrocellBuilder_t;
+
+/// Hashes a macrocell node for MacrocellBuilder_t
+static inline uint64_t hashMacrocellEntry(const MacrocellEntry_t *entry) {
+    uint64_t hash = entry->cells ^ ((uint64_t) entry->level << 56);
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ entry->children[i]) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/// Inserts a node into the hash table, which must have a free slot, without checking if it's there
+static void insertMacrocellEntry(MacrocellBuilder_t *builder, const MacrocellEntry_t *entry) {
+    size_t slot = hashMacrocellEntry(entry) & (builder->capacity - 1);
+    while (builder->entries[slot].index != 0) {
+        slot = (slot + 1) & (builder->capacity - 1);
+    }
+    builder->entries[slot] = *entry;
+}
+
+/// Writes a macrocell node to the file, as its cells for leaves or its children otherwise
+static void writeMacrocellNode(ExportWriter_t *writer, const MacrocellEntry_t *entry) {
+    char line[128];
+    char *end = &line[sizeof(line)];
+    if (entry->level == 3) {
+        // rows of '.' and '*', each ending in '$', leaving out trailing dead cells and empty rows
+        char *p = line;
+        uint32_t rows = 8 - __builtin_clzll(entry->cells) / 8;
+        for (uint32_t y = 0; y < rows; y++) {
+            uint8_t bits = (uint8_t) (entry->cells >> (8 * y));
+            for (uint32_t x = 0; bits >> x != 0; x++) {
+                *p++ = (bits >> x) & 1 ? '*' : '.';
+            }
+            *p++ = '$';
+        }
+        *p++ = '\n';
+        exportWrite(writer, line, p - line);
+        return;
+    }
+    char *begin = end;
+    *--begin = '\n';
+    for (int i = 3; i >= 0; i--) {
+        begin = formatUInt(begin, entry->children[i]);
+        *--begin = ' ';
+    }
+    begin = formatUInt(begin, entry->level);
+    exportWrite(writer, begin, end - begin);
+}
+
+/**
+ * Looks up a node in the hash table, writing it to the file and adding it if it's new
+ * @return number of the node in the file
+ */
+static uint32_t internMacrocellNode(MacrocellBuilder_t *builder, const MacrocellEntry_t *entry) {
+    size_t slot = hashMacrocellEntry(entry) & (builder->capacity - 1);
+    for (; builder->entries[slot].index != 0; slot = (slot + 1) & (builder->capacity - 1)) {
+        const MacrocellEntry_t *other = &builder->entries[slot];
+        if (other->level == entry->level && other->cells == entry->cells
+                && memcmp(other->children, entry->children, sizeof(entry->children)) == 0) {
+            return other->index;
+        }
+    }
+    MacrocellEntry_t added = *entry;
+    added.index = (uint32_t) ++builder->count;
+    writeMacrocellNode(builder->writer, &added);
+    builder->entries[slot] = added;
+
+    if (builder->count * 2 > builder->capacity) {
+        // keep the load factor under 1/2, so probes stay short
+        MacrocellEntry_t *old = builder->entries;
+        size_t oldCapacity = builder->capacity;
+        builder->capacity *= 2;
+        builder->entries = calloc(builder->capacity, sizeof(MacrocellEntry_t));
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i].index != 0) {
+                insertMacrocellEntry(builder, &old[i]);
+            }
+        }
+        free(old);
+    }
+    return added.index;
+}
+
+/**
+ * Builds the macrocell node for part of the grid, writing out any new nodes (children first)
+ * @param level size of the node is 2^level cells
+ * @param x x-coord of the node relative to the top left of the tree
+ * @param y y-coord of the node relative to the top left of the tree
+ * @return number of the node in the file, or 0 if it has no live cells
+ */
+static uint32_t buildMacrocellNode(MacrocellBuilder_t *builder, uint32_t level, uint64_t x,
+                                   uint64_t y) {
+    const LifeWorld_t *world = builder->world;
+    x += builder->x;
+    y += builder->y;
+    if (x >= builder->endX || y >= builder->endY) {
+        // past the last live cell
+        return 0;
+    }
+    MacrocellEntry_t entry = {.level = level};
+    if (level == 3) {
+        for (uint64_t row = 0; row < 8 && y + row < builder->endY; row++) {
+            const bool *cells = &world->grid[(size_t) world->width * (y + row) + x];
+            uint64_t bits = 0;
+            if (x + 8 <= world->width) {
+                // same trick as lifeSaveSnapshot() to pack 8 cells into a byte
+                uint64_t word;
+                memcpy(&word, cells, sizeof(word));
+                bits = (word * 0x0102040810204080ULL) >> 56;
+            } else {
+                for (uint64_t i = 0; x + i < world->width; i++) {
+                    bits |= (uint64_t) cells[i] << i;
+                }
+            }
+            entry.cells |= bits << (8 * row);
+        }
+        return entry.cells == 0 ? 0 : internMacrocellNode(builder, &entry);
+    }
+    uint64_t half = 1ULL << (level - 1);
+    bool empty = true;
+    for (int i = 0; i < 4; i++) {
+        entry.children[i] = buildMacrocellNode(builder, level - 1, x - builder->x + (i & 1) * half,
+                                               y - builder->y + (i >> 1) * half);
+        empty &= entry.children[i] == 0;
+    }
+    return empty ? 0 : internMacrocellNode(builder, &entry);
+}
+
+bool lifeWorldExportMacrocell(const LifeWorld_t *world, const char *filename) {
+    double begin = utilsGetTime();
+    ExportWriter_t writer;
+    if (!exportOpen(&writer, filename)) {
+        return false;
+    }
+    char rule[LIFE_MAX_RULE_STRING];
+    lifeFormatRule(&world->rule, rule);
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "[M2] (gameoflife v" VERSION ")\n#R %s\n#G %lu\n", rule,
+                          world->generations);
+    exportWrite(&writer, header, length);
+
+    uint32_t minX, minY, maxX, maxY;
+    if (findBoundingBox(world, NULL, &minX, &minY, &maxX, &maxY)) {
+        MacrocellBuilder_t builder = {
+            .world = world,
+            .x = minX,
+            .y = minY,
+            .endX = (uint64_t) maxX + 1,
+            .endY = (uint64_t) maxY + 1,
+            .capacity = 1024,
+            .writer = &writer,
+        };
+        builder.entries = calloc(builder.capacity, sizeof(MacrocellEntry_t));
+        // smallest square with a power of two side that holds the live cells
+        uint32_t level = 3;
+        while ((1ULL << level) < MAX(maxX - minX + 1, maxY - minY + 1)) {
+            level++;
+        }
+        buildMacrocellNode(&builder, level, 0, 0);
+        free(builder.entries);
+    } else {
+        // no live cells, so the tree is a single empty leaf
+        exportWrite(&writer, "$\n", 2);
+    }
+    return exportClose(world, &writer, filename, begin);
+}
+
+bool lifeWorldExportPattern(const LifeWorld_t *world, const char *filename) {
+    if (utilsEndsWith(".rle", filename)) {
+        return lifeWorldExportRLE(world, filename);
+    } else if (utilsEndsWith(".mc", filename)) {
+        return lifeWorldExportMacrocell(world, filename);
+    }
+    return lifeWorldExportPlainText(world, filename);
+}
+
+// Functions acting on the default world, kept so that single simulation front ends don't need to
+// pass a world around. Each one forwards to its lifeWorld equivalent.
+
+bool lifeInit(uint32_t width, uint32_t height) {
+    lifeWorldDestroy(defaultWorld);
+    defaultWorld = lifeWorldCreate(width, height);
+    if (defaultWorld == NULL) {
+        return false;
+    }
+    lifeWorldSetKernel(defaultWorld, defaultKernel);
+    lifeWorldSetTopology(defaultWorld, defaultTopology);
+    lifeWorldSetRule(defaultWorld, &defaultRule);
+    return true;
+}
+
+void lifeDestroy(void) {
+    lifeWorldDestroy(defaultWorld);
+    defaultWorld = NULL;
+}
+
+LifeWorld_t *lifeGetWorld(void) {
+    return defaultWorld;
+}
+
+void lifeUpdate(void) {
+    lifeWorldUpdate(defaultWorld);
+}
+
+void lifeUpdateMulti(uint32_t steps) {
+    lifeWorldUpdateMulti(defaultWorld, steps);
+}
+
+void lifeSetKernel(LifeKernel_t kernel) {
+    assert(kernel < LIFE_KERNEL_COUNT);
+    defaultKernel = kernel;
+    if (defaultWorld != NULL) {
+        lifeWorldSetKernel(defaultWorld, kernel);
+    }
+}
+
+LifeKernel_t lifeGetKernel(void) {
+    return defaultWorld != NULL ? lifeWorldGetKernel(defaultWorld) : defaultKernel;
+}
+
+void lifeSetTopology(LifeTopology_t topology) {
+    assert(topology < LIFE_TOPOLOGY_COUNT);
+    defaultTopology = topology;
+    if (defaultWorld != NULL) {
+        lifeWorldSetTopology(defaultWorld, topology);
+    }
+}
+
+LifeTopology_t lifeGetTopology(void) {
+    return defaultWorld != NULL ? lifeWorldGetTopology(defaultWorld) : defaultTopology;
+}
+
+void lifeSetRule(const LifeRule_t *rule) {
+    defaultRule = *rule;
+    if (defaultWorld != NULL) {
+        lifeWorldSetRule(defaultWorld, rule);
+    }
+}
+
+LifeRule_t lifeGetRule(void) {
+    return defaultWorld != NULL ? lifeWorldGetRule(defaultWorld) : defaultRule;
+}
+
+bool lifeInsertPatternPlainText(const char *filename, uint32_t oX, uint32_t oY) {
+    return lifeWorldInsertPatternPlainText(defaultWorld, filename, oX, oY);
+}
+
+bool lifeInsertPatternRLE(const char *filename, uint32_t oX, uint32_t oY) {
+    return lifeWorldInsertPatternRLE(defaultWorld, filename, oX, oY);
+}
+
+bool lifeInsertPatternMacrocell(const char *filename, uint32_t oX, uint32_t oY) {
+    return lifeWorldInsertPatternMacrocell(defaultWorld, filename, oX, oY);
+}
+
+bool lifeInsertPattern(const char *filename, uint32_t oX, uint32_t oY) {
+    return lifeWorldInsertPattern(defaultWorld, filename, oX, oY);
+}
+
+bool lifeInsertOpenPattern(LifePattern_t *pattern, uint32_t oX, uint32_t oY) {
+    return lifeWorldInsertOpenPattern(defaultWorld, pattern, oX, oY);
+}
+
+bool lifeInsertSoup(uint32_t oX, uint32_t oY, uint32_t width, uint32_t height, double density,
+                    uint64_t seed) {
+    return lifeWorldInsertSoup(defaultWorld, oX, oY, width, height, density, seed);
+}
+
+uint64_t lifeGetGenerations(void) {
+    return lifeWorldGetGenerations(defaultWorld);
+}
+
+uint64_t lifeGetPopulation(void) {
+    return lifeWorldGetPopulation(defaultWorld);
+}
+
+const bool *lifeGetGrid(void) {
+    return lifeWorldGetGrid(defaultWorld);
+}
+
+void lifeSetGrid(const bool *cells) {
+    lifeWorldSetGrid(defaultWorld, cells);
+}
+
+bool lifeSaveSnapshot(const char *filename) {
+    return lifeWorldSaveSnapshot(defaultWorld, filename);
+}
+
+bool lifeLoadSnapshot(const char *filename) {
+    if (!lifeWorldLoadSnapshot(defaultWorld, filename)) {
+        return false;
+    }
+    // the snapshot's topology and rule stick if the world is recreated later
+    defaultTopology = lifeWorldGetTopology(defaultWorld);
+    defaultRule = lifeWorldGetRule(defaultWorld);
+    return true;
+}
+
+bool lifeExportRLE(const char *filename) {
+    return lifeWorldExportRLE(defaultWorld, filename);
+}
+
+bool lifeExportPlainText(const char *filename) {
+    return lifeWorldExportPlainText(defaultWorld, filename);
+}
+
+bool lifeExportMacrocell(const char *filename) {
+    return lifeWorldExportMacrocell(defaultWorld, filename);
+}
+
+bool lifeExportPattern(const char *filename) {
+    return lifeWorldExportPattern(defaultWorld, filename);
+}
@@ -7,28 +7,217 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Grid update implementations
+typedef enum {
+    /// Single threaded reference implementation, used to check the other kernels
+    LIFE_KERNEL_REFERENCE = 0,
+    /// Multi-threaded implementation using OpenMP (default)
+    LIFE_KERNEL_OMP,
+    /// The OpenMP kernel, with its row update generated for the rule and compiled at runtime (see
+    /// jit.h). Falls back to the OpenMP kernel's own row update if it can't be compiled.
+    LIFE_KERNEL_JIT,
+    /// Number of kernels, also used to indicate an invalid kernel
+    LIFE_KERNEL_COUNT,
+} LifeKernel_t;
+
+/// How the edges of the grid behave
+typedef enum {
+    /// Cells outside the grid are always dead
+    LIFE_TOPOLOGY_BOUNDED = 0,
+    /// The left and right edges wrap round to each other, as do the top and bottom
+    LIFE_TOPOLOGY_TORUS,
+    /// Number of topologies, also used to indicate an invalid topology
+    LIFE_TOPOLOGY_COUNT,
+} LifeTopology_t;
+
+/// Rule worlds run unless told otherwise, in B/S notation
+#define LIFE_RULE "B3/S23"
+/// Longest rule string written by lifeFormatRule(), including the terminator
+#define LIFE_MAX_RULE_STRING 80
+/// Number of possible 3x3 neighbourhoods, i.e. entries in an isotropic rule's table
+#define LIFE_NEIGHBOURHOODS 512
+/// Most states a cell can have in a Generations rule
+#define LIFE_MAX_STATES 256
+
+/**
+ * A rule, i.e. how a cell's next state depends on its 3x3 neighbourhood. Outer totalistic rules
+ * only depend on the cell's state and its number of live neighbours, and are stored as birth and
+ * survival masks. Isotropic non-totalistic rules also depend on how the neighbours are arranged
+ * (up to rotation and reflection), and are stored as a table with an entry per neighbourhood.
+ * Generations rules are outer totalistic rules where a cell that stops being alive goes through a
+ * number of dying states before it's dead. Dying cells don't count as live neighbours, and can't
+ * be born until they're dead.
+ */
+typedef struct {
+    /// Bit n is set if a dead cell with n live neighbours is born. 0 for isotropic rules.
+    uint16_t birth;
+    /// Bit n is set if a live cell with n live neighbours survives. 0 for isotropic rules.
+    uint16_t survival;
+    /// True if the rule isn't outer totalistic, so it's given by table rather than the masks
+    bool isotropic;
+    /**
+     * For isotropic rules, bit i (bit i % 64 of word i / 64) is the next state of a cell whose
+     * neighbourhood is i. The cell in column c and row r of the neighbourhood (counting from 0 at
+     * the top left) is bit 3 * (2 - c) + r of i, so the centre is bit 4, and the neighbourhood of
+     * the next cell along is the low 6 bits of this one's shifted up by 3, plus its right column.
+     */
+    uint64_t table[LIFE_NEIGHBOURHOODS / 64];
+    /// Number of dying states for Generations rules, i.e. their number of states minus 2. 0 for
+    /// two-state rules.
+    uint32_t dyingStates;
+} LifeRule_t;
+/// Version of the snapshot format written by lifeSaveSnapshot(). Version 2 added the states of
+/// Generations rules' cells, and version 1 snapshots can still be loaded.
+#define LIFE_SNAPSHOT_VERSION 2
+
+/**
+ * One simulation: a grid, its generation count, topology and kernel. Worlds share nothing, so any
+ * number of them can be created and each driven from its own thread. The lifeWorld functions act on
+ * a given world, and the rest act on the default world created by lifeInit(), for front ends that
+ * only run one simulation.
+ */
+typedef struct LifeWorld LifeWorld_t;
 
 /**
  * Initialises the Game of Life
  * @param width width of play field in cells
  * @param height height of play field in cells
+ * @return true on success, false (after logging why) if the grid couldn't be allocated
  */
-void lifeInit(uint32_t width, uint32_t height);
+bool lifeInit(uint32_t width, uint32_t height);
 
 /// Frees memory associated with lifeInit()
 void lifeDestroy(void);
 
+/// Returns the default world created by lifeInit(), or NULL if there isn't one
+LifeWorld_t *lifeGetWorld(void);
+
 
 /// Increments the world by one tick
 void lifeUpdate(void);
 
+/**
+ * Increments the world by the given number of ticks in one batch. This is faster than calling
+ * lifeUpdate() in a loop, since the worker threads are only started once for the whole batch.
+ * @param steps number of generations to advance
+ */
+void lifeUpdateMulti(uint32_t steps);
+
+/// Selects the kernel used by lifeUpdate() and lifeUpdateMulti()
+void lifeSetKernel(LifeKernel_t kernel);
+
+/// Returns the kernel currently used by lifeUpdate() and lifeUpdateMulti()
+LifeKernel_t lifeGetKernel(void);
+
+/// Returns the command line name of the given kernel
+const char *lifeGetKernelName(LifeKernel_t kernel);
+
+/// Looks up a kernel by its name (case insensitive), returns LIFE_KERNEL_COUNT if there is no such kernel
+LifeKernel_t lifeFindKernel(const char *name);
+
+/// Selects how the edges of the grid behave. Defaults to LIFE_TOPOLOGY_BOUNDED.
+void lifeSetTopology(LifeTopology_t topology);
+
+/// Returns how the edges of the grid behave
+LifeTopology_t lifeGetTopology(void);
+
+/// Returns the command line name of the given topology
+const char *lifeGetTopologyName(LifeTopology_t topology);
+
+/// Looks up a topology by its name (case insensitive), returns LIFE_TOPOLOGY_COUNT if there is no
+/// such topology
+LifeTopology_t lifeFindTopology(const char *name);
+
+/**
+ * Selects the rule the world runs. Defaults to LIFE_RULE. Common rules (B3/S23, B36/S23,
+ * B3678/S34678 and B2/S) have their own kernels specialised for the rule at compile time, and any
+ * other outer totalistic rule runs on a generic kernel. Isotropic rules run on a kernel that looks
+ * up each cell's neighbourhood in the rule's table. The JIT kernel compiles its own row update for
+ * either kind. Generations rules run on their own engine, which stores cell states in bit planes
+ * (the reference kernel has its own version of it), and the grid only holds which cells are alive.
+ */
+void lifeSetRule(const LifeRule_t *rule);
+
+/// Returns the rule the world runs
+LifeRule_t lifeGetRule(void);
+
+
+/**
+ * Parses a rule in B/S notation (e.g. "B3/S23", case insensitive), or in the older S/B notation
+ * (e.g. "23/3"). Each neighbour count may be followed by Hensel notation letters, giving an
+ * isotropic non-totalistic rule: "B2a" means born with 2 live neighbours arranged as letter a, and
+ * "B2-a" means any arrangement of 2 but a. Rules that turn out to be outer totalistic (e.g. every
+ * letter of a count given) are stored as such. Letters are as in
+ * https://conwaylife.com/wiki/Isotropic_non-totalistic_rule
+ *
+ * Outer totalistic rules may also have a number of states, giving a Generations rule: "B2/S/C3"
+ * in B/S notation, or "/2/3" (survival/birth/states) in the older notation. 2 states is the same
+ * as leaving it out, and there can be at most LIFE_MAX_STATES.
+ * @param string rule to parse
+ * @param rule where to store the rule
+ * @return true on success, false if the string isn't a valid rule
+ */
+bool lifeParseRule(const char *string, LifeRule_t *rule);
+
+/// Writes a rule in B/S notation, e.g. "B3/S23", "B2-a/S12" or "B2/S/C3", into buf (at least
+/// LIFE_MAX_RULE_STRING long). Letters are written alphabetically, negated if that's shorter.
+void lifeFormatRule(const LifeRule_t *rule, char *buf);
 
-/// Renders the current grid to the console.
-void lifeRenderConsole(void);
 
-/// Renders the current grid to an SDL renderer and texture.
-void lifeRenderSDL(SDL_Texture *texture);
+/**
+ * Works out the size of a pattern in cells without loading it, from the "x = 123, y = 456" header
+ * line for RLE files (.rle), from the bounding box of the live cells for macrocell files (.mc), or
+ * from the number and length of lines for plain text files. This reads the file, so a pattern that
+ * is going to be loaded into a grid of its size should be opened with lifeOpenPattern() instead,
+ * which only reads it once (and is the only way to do both with stdin).
+ * @param filename path to the pattern file
+ * @param width where to store the width of the pattern
+ * @param height where to store the height of the pattern
+ * @return true if the size was determined, false if the file can't be opened, has no RLE
+ * header or no content, or is an invalid macrocell file
+ */
+bool lifeGetPatternSize(const char *filename, uint32_t *width, uint32_t *height);
+
+/// A pattern file opened by lifeOpenPattern()
+typedef struct LifePattern LifePattern_t;
+
+/**
+ * Opens a pattern file (in any format lifeInsertPattern() can load) and works out its size, so the
+ * grid can be sized to fit it before it's inserted with lifeInsertOpenPattern(). Only as much of
+ * the file is read as that takes, and nothing is read twice: RLE files are read up to the header
+ * line, and their body is decoded straight from the file when inserted. Macrocell and plain text
+ * files have to be read whole to be sized, so the macrocell tree, or the plain text rows packed 8
+ * cells to a byte, are kept until the pattern is inserted.
+ * @param filename path to the pattern file, or "-" for stdin
+ * @return the pattern, or NULL (after logging why) if the file can't be opened, read or parsed.
+ * Close it with lifeClosePattern().
+ */
+LifePattern_t *lifeOpenPattern(const char *filename);
+
+/**
+ * Gets the size of an opened pattern, see lifeGetPatternSize().
+ * @return true if the size is known, false if it isn't (e.g. an RLE file with no header), in which
+ * case the width and height are set to 0
+ */
+bool lifePatternGetSize(const LifePattern_t *pattern, uint32_t *width, uint32_t *height);
+
+/**
+ * Inserts an opened pattern into the grid, like lifeInsertPattern(). A pattern can only be inserted
+ * once.
+ * @param pattern pattern opened by lifeOpenPattern()
+ * @param oX where to insert the pattern on the current grid: x-coord
+ * @param oY where to insert the pattern on the current grid: y-coord
+ * @return true if the pattern was inserted, false (after logging why) if it wasn't
+ */
+bool lifeInsertOpenPattern(LifePattern_t *pattern, uint32_t oX, uint32_t oY);
+
+/// Closes a pattern opened by lifeOpenPattern() and frees its memory. NULL is ignored.
+void lifeClosePattern(LifePattern_t *pattern);
 
 /**
  * Inserts a pattern, encoded in plain text format, into the grid. The (x,y) parameters are where the
@@ -37,23 +226,261 @@ void lifeRenderSDL(SDL_Texture *texture);
  *
  * See documentation for this format here: https://conwaylife.com/wiki/Plaintext
  *
- * Errors: This function will cause an assertion failure if the current grid is too small to hold
- * the requested pattern, if the pattern file cannot be opened, if the coordinates are invalid,
- * and other such errors.
+ * All the pattern loaders read their input forward only, so the file may also be gzip compressed
+ * (.gz), zstd compressed (.zst, if built with zstd), or "-" to read it from stdin.
+ *
+ * Errors: Nothing is ever fatal, so a program can load patterns it doesn't trust. If the pattern
+ * file can't be opened or read, is invalid, or doesn't fit in the grid at the given coordinates,
+ * the reason is logged and false is returned, by which point the grid may be partly written.
  * @param filename path to plain text grid file
  * @param oX where to insert the pattern on the current grid: x-coord
  * @param oY where to insert the pattern on the current grid: y-coord
+ * @return true if the pattern was inserted, false (after logging why) if it wasn't
  */
-void lifeInsertPatternPlainText(const char *filename, uint32_t oX, uint32_t oY);
+bool lifeInsertPatternPlainText(const char *filename, uint32_t oX, uint32_t oY);
 
 /**
  * Same as `lifeInsertPatternPlainText` but imports run length encoded (RLE) patterns.
- * See `lifeInsertPatternPlainText` for more info.
+ * See `lifeInsertPatternPlainText` for more info. Multi-state patterns, with "." for dead cells and
+ * "A" to "X", "pA" to "pX", and so on up to "yO" for states 1 to 255, are loaded into the states of
+ * a Generations rule, so the rule has to be set first. States it doesn't have are an error.
  * @param filename path to run length encoded grid file
  * @param oX where to insert the pattern on the current grid: oX-coord
  * @param oY where to insert the pattern on the current grid: oY-coord
+ * @return true if the pattern was inserted, false (after logging why) if it wasn't
+ */
+bool lifeInsertPatternRLE(const char *filename, uint32_t oX, uint32_t oY);
+
+/**
+ * Same as `lifeInsertPatternPlainText` but imports Golly macrocell (.mc) patterns, which store the
+ * pattern as a quadtree with identical subtrees shared. The tree is decoded into a table of nodes,
+ * then painted straight into the grid, so no intermediate text or cell list is ever built. Only
+ * two state rules are supported. The top left of the bounding box of the live cells goes at (x,y).
+ * See documentation for this format here: https://conwaylife.com/wiki/Macrocell
+ * @param filename path to macrocell file
+ * @param oX where to insert the pattern on the current grid: x-coord
+ * @param oY where to insert the pattern on the current grid: y-coord
+ * @return true if the pattern was inserted, false (after logging why) if it wasn't
+ */
+bool lifeInsertPatternMacrocell(const char *filename, uint32_t oX, uint32_t oY);
+
+/**
+ * Inserts a pattern in whichever format its file extension says: RLE for .rle, macrocell for .mc,
+ * otherwise plain text. Compression extensions are ignored, and the format of a pattern read from
+ * stdin is worked out from its first line. See `lifeInsertPatternPlainText` for more info.
+ * @param filename path to the pattern file
+ * @param oX where to insert the pattern on the current grid: x-coord
+ * @param oY where to insert the pattern on the current grid: y-coord
+ * @return true if the pattern was inserted, false (after logging why) if it wasn't
+ */
+bool lifeInsertPattern(const char *filename, uint32_t oX, uint32_t oY);
+
+/**
+ * Fills a region of the grid with a random soup. Each cell is alive with the given probability,
+ * using a counter-based RNG (splitmix64 indexed by the cell's position in the soup), so the same
+ * seed always gives the same soup, whatever the number of threads. Rows are generated in parallel.
+ * @param oX where to insert the soup on the current grid: x-coord
+ * @param oY where to insert the soup on the current grid: y-coord
+ * @param width width of the soup in cells
+ * @param height height of the soup in cells
+ * @param density probability of each cell being alive, from 0 to 1
+ * @param seed random seed
+ * @return true if the soup was inserted, false (after logging why) if it doesn't fit in the grid
+ */
+bool lifeInsertSoup(uint32_t oX, uint32_t oY, uint32_t width, uint32_t height, double density,
+                    uint64_t seed);
+
+/**
+ * Generates the same soup as lifeInsertSoup() into a separate buffer of width*height cells
+ * (row-major), on the calling thread. For callers that run their own universes, such as the census.
  */
-void lifeInsertPatternRLE(const char *filename, uint32_t oX, uint32_t oY);
+void lifeGenerateSoup(bool *cells, uint32_t width, uint32_t height, double density, uint64_t seed);
 
 /// Returns the number of generations that have passed.
-uint64_t lifeGetGenerations(void);
\ No newline at end of file
+uint64_t lifeGetGenerations(void);
+
+/// Returns the number of live cells in the grid.
+uint64_t lifeGetPopulation(void);
+
+/// Returns the current grid, stored row-major as width*height cells. Only valid until the next update.
+const bool *lifeGetGrid(void);
+
+/**
+ * Writes the current grid and generation count to a binary snapshot file, which can be loaded back
+ * with lifeLoadSnapshot(). The file is a fixed size header followed by the grid packed 8 cells to
+ * a byte. For Generations rules, every cell's state is saved (including dying cells), a bit plane
+ * at a time. It is written to a temporary file with a single write, then renamed over the
+ * destination, so an existing snapshot is never left half written.
+ * @param filename path to the snapshot file
+ * @return true if the snapshot was written, false (after logging why) if it wasn't
+ */
+bool lifeSaveSnapshot(const char *filename);
+
+/**
+ * Reads the grid size from a snapshot file's header, so the grid can be initialised to match it.
+ * @param filename path to the snapshot file
+ * @param width where to store the width of the grid
+ * @param height where to store the height of the grid
+ * @return true if the size was determined, false (after logging why) if the file can't be opened or
+ * isn't a snapshot of a compatible version
+ */
+bool lifeGetSnapshotSize(const char *filename, uint32_t *width, uint32_t *height);
+
+/**
+ * Restores the grid, generation count, topology and rule from a snapshot file written by
+ * lifeSaveSnapshot(). The
+ * file is mapped into memory and the payload unpacked straight into the grid, so this takes about
+ * as long as reading the file.
+ *
+ * Errors: The grid must already be initialised to the size of the snapshot (see
+ * lifeGetSnapshotSize()). This function will return false if it isn't, if the file can't be
+ * opened, or if the snapshot is truncated, corrupt, or uses a different version or an unknown rule.
+ * @param filename path to the snapshot file
+ * @return true if the snapshot was loaded, false (after logging why) if it wasn't
+ */
+bool lifeLoadSnapshot(const char *filename);
+
+/**
+ * Exports the live cells in the current grid (cropped to their bounding box) as a run length
+ * encoded (RLE) pattern, with a "rule =" header and lines wrapped at 70 characters. Generations
+ * rules' dying cells are kept too, using multi-state tags ("." for dead, "A" for alive, "B" for
+ * the first dying state and so on). The file can be loaded back with lifeInsertPatternRLE().
+ * @param filename path to the RLE file to write
+ * @return true if the pattern was written, false (after logging why) if it wasn't
+ */
+bool lifeExportRLE(const char *filename);
+
+/**
+ * Same as `lifeExportRLE` but exports in plain text format, one line per row and one character
+ * per cell. The file can be loaded back with lifeInsertPatternPlainText().
+ * @param filename path to the plain text file to write
+ * @return true if the pattern was written, false (after logging why) if it wasn't
+ */
+bool lifeExportPlainText(const char *filename);
+
+/**
+ * Same as `lifeExportRLE` but exports in Golly macrocell format. Identical subtrees of the quadtree
+ * are found with a hash table and only written once. The file can be loaded back with
+ * lifeInsertPatternMacrocell().
+ * @param filename path to the macrocell file to write
+ * @return true if the pattern was written, false (after logging why) if it wasn't
+ */
+bool lifeExportMacrocell(const char *filename);
+
+/**
+ * Exports the pattern in whichever format the file extension says: RLE for .rle, macrocell for
+ * .mc, otherwise plain text.
+ * @param filename path to the pattern file to write
+ * @return true if the pattern was written, false (after logging why) if it wasn't
+ */
+bool lifeExportPattern(const char *filename);
+
+/// Replaces the contents of the current grid with the given width*height cells, stored row-major.
+void lifeSetGrid(const bool *cells);
+
+/**
+ * Creates a world with an empty grid, running LIFE_RULE with the OpenMP kernel on a bounded grid.
+ * The world is independent of the default one and of any others.
+ * @param width width of play field in cells
+ * @param height height of play field in cells
+ * @return the world, to be freed with lifeWorldDestroy(), or NULL (after logging why) if its grid
+ * couldn't be allocated
+ */
+LifeWorld_t *lifeWorldCreate(uint32_t width, uint32_t height);
+
+/// Frees a world created with lifeWorldCreate(). Does nothing if world is NULL.
+void lifeWorldDestroy(LifeWorld_t *world);
+
+/// Same as lifeUpdate(), for the given world
+void lifeWorldUpdate(LifeWorld_t *world);
+
+/// Same as lifeUpdateMulti(), for the given world
+void lifeWorldUpdateMulti(LifeWorld_t *world, uint32_t steps);
+
+/// Same as lifeSetKernel(), for the given world
+void lifeWorldSetKernel(LifeWorld_t *world, LifeKernel_t kernel);
+
+/// Same as lifeGetKernel(), for the given world
+LifeKernel_t lifeWorldGetKernel(const LifeWorld_t *world);
+
+/// Same as lifeSetTopology(), for the given world
+void lifeWorldSetTopology(LifeWorld_t *world, LifeTopology_t topology);
+
+/// Same as lifeGetTopology(), for the given world
+LifeTopology_t lifeWorldGetTopology(const LifeWorld_t *world);
+
+/// Same as lifeSetRule(), for the given world
+void lifeWorldSetRule(LifeWorld_t *world, const LifeRule_t *rule);
+
+/// Same as lifeGetRule(), for the given world
+LifeRule_t lifeWorldGetRule(const LifeWorld_t *world);
+
+/// Returns the width of the world's grid in cells
+uint32_t lifeWorldGetWidth(const LifeWorld_t *world);
+
+/// Returns the height of the world's grid in cells
+uint32_t lifeWorldGetHeight(const LifeWorld_t *world);
+
+/// Same as lifeInsertPatternPlainText(), for the given world
+bool lifeWorldInsertPatternPlainText(LifeWorld_t *world, const char *filename, uint32_t oX,
+                                     uint32_t oY);
+
+/// Same as lifeInsertPatternRLE(), for the given world
+bool lifeWorldInsertPatternRLE(LifeWorld_t *world, const char *filename, uint32_t oX, uint32_t oY);
+
+/// Same as lifeInsertPatternMacrocell(), for the given world
+bool lifeWorldInsertPatternMacrocell(LifeWorld_t *world, const char *filename, uint32_t oX,
+                                     uint32_t oY);
+
+/// Same as lifeInsertPattern(), for the given world
+bool lifeWorldInsertPattern(LifeWorld_t *world, const char *filename, uint32_t oX, uint32_t oY);
+
+/// Same as lifeInsertOpenPattern(), for the given world
+bool lifeWorldInsertOpenPattern(LifeWorld_t *world, LifePattern_t *pattern, uint32_t oX,
+                                uint32_t oY);
+
+/// Same as lifeInsertSoup(), for the given world
+bool lifeWorldInsertSoup(LifeWorld_t *world, uint32_t oX, uint32_t oY, uint32_t width,
+                         uint32_t height, double density, uint64_t seed);
+
+/// Same as lifeGetGenerations(), for the given world
+uint64_t lifeWorldGetGenerations(const LifeWorld_t *world);
+
+/// Same as lifeGetPopulation(), for the given world
+uint64_t lifeWorldGetPopulation(const LifeWorld_t *world);
+
+/// Same as lifeGetGrid(), for the given world
+const bool *lifeWorldGetGrid(const LifeWorld_t *world);
+
+/**
+ * Gets the state of every cell in a row of the world's grid, one byte each: 0 for dead, 1 for
+ * alive, and 2 onwards for the dying states of a Generations rule.
+ * @param y row to get
+ * @param states where to write the row's width states
+ */
+void lifeWorldGetStates(const LifeWorld_t *world, uint32_t y, uint8_t *states);
+
+/// Same as lifeSetGrid(), for the given world
+void lifeWorldSetGrid(LifeWorld_t *world, const bool *cells);
+
+/// Same as lifeSaveSnapshot(), for the given world
+bool lifeWorldSaveSnapshot(const LifeWorld_t *world, const char *filename);
+
+/// Same as lifeLoadSnapshot(), for the given world
+bool lifeWorldLoadSnapshot(LifeWorld_t *world, const char *filename);
+
+/// Same as lifeExportRLE(), for the given world
+bool lifeWorldExportRLE(const LifeWorld_t *world, const char *filename);
+
+/// Same as lifeExportPlainText(), for the given world
+bool lifeWorldExportPlainText(const LifeWorld_t *world, const char *filename);
+
+/// Same as lifeExportMacrocell(), for the given world
+bool lifeWorldExportMacrocell(const LifeWorld_t *world, const char *filename);
+
+/// Same as lifeExportPattern(), for the given world
+bool lifeWorldExportPattern(const LifeWorld_t *world, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
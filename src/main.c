@@ -13,13 +13,81 @@
 #include <string.h>
 #include "perf.h"
 #include "log.h"
-#include <SDL.h>
 #include <assert.h>
 #include "utils.h"
+#include "trace.h"
 #include "argtable3.h"
 #include <omp.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef GOL_HAVE_SDL
+#include <SDL.h>
+#include "render.h"
+#endif
 
+#ifdef GOL_HAVE_SDL
 static PerfCounter_t perf = {0};
+#endif
+
+/// Phases of the main loop that are timed separately
+typedef enum {
+    /// Computing the next generation(s)
+    PHASE_UPDATE = 0,
+    /// Converting the grid to pixels
+    PHASE_RENDER,
+    /// Uploading the pixels to the GPU texture
+    PHASE_UPLOAD,
+    /// Drawing the texture and presenting the frame
+    PHASE_PRESENT,
+    /// All of the above, i.e. the frame time excluding the FPS limiter
+    PHASE_FRAME,
+    NUM_PHASES,
+} Phase_t;
+
+static const char *phaseNames[NUM_PHASES] = {"update", "render", "upload", "present", "frame"};
+static PerfPhase_t phases[NUM_PHASES];
+
+/// Clears the timers for all main loop phases
+static void clearPhases(void) {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        perfPhaseInit(&phases[i], phaseNames[i]);
+    }
+}
+
+/// State for automatically tuning the number of generations computed per frame
+typedef struct {
+    /// Frame time budget in milliseconds
+    double budget;
+    /// Smoothed cost of one generation in milliseconds, or negative if not yet measured
+    double genCost;
+    /// Smoothed cost of everything in the frame other than updating the grid, in milliseconds
+    double overhead;
+} StepTuner_t;
+
+/// State for writing snapshots in the background
+typedef struct {
+    /// Snapshot file to write
+    const char *filename;
+    /// Generations between periodic checkpoints, or 0 to disable them
+    uint64_t interval;
+    /// Generation the next periodic checkpoint is due on
+    uint64_t next;
+    /// Process writing the current snapshot, or -1 if there isn't one
+    pid_t child;
+} Checkpointer_t;
+
+/// Pattern export requested on the command line
+typedef struct {
+    /// Pattern file to write, in RLE format if it ends in .rle, otherwise plain text
+    const char *filename;
+    /// Generation to export on, or -1 for none
+    int64_t generation;
+    /// True if the pattern should be exported on exit
+    bool onExit;
+} Exporter_t;
 
 // Command line options:
 // GoL grid size in cells, format is "[width]x[height]". Defaults to "64x64"
@@ -29,6 +97,7 @@ static PerfCounter_t perf = {0};
 // Coordinates on where to insert initial pattern.
 // Whether to enable graphics or not (for performance testing).
 
+#ifdef GOL_HAVE_SDL
 /// Print runtime SDL version
 static void printSDLVersion(void) {
     SDL_version sdlVersionLinked;
@@ -37,11 +106,6 @@ static void printSDLVersion(void) {
            sdlVersionLinked.patch);
 }
 
-/// Get a high resolution time in SECONDS using SDL_GetPerformanceCounter
-static double getTime(void) {
-    return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
-}
-
 /// Updates the window title for when the game is paused
 static void updatePausedWindowTitle(SDL_Window *window) {
     char buf[256] = {0};
@@ -50,6 +114,209 @@ static void updatePausedWindowTitle(SDL_Window *window) {
     SDL_SetWindowTitle(window, buf);
 }
 
+/**
+ * Picks how many generations to run next frame so that the update plus the rest of the frame
+ * (rendering, etc) fits in the frame budget. Measured costs are smoothed to avoid oscillating.
+ * @param tuner tuner state
+ * @param steps number of generations that were run this frame
+ * @param updateTime time spent updating the grid this frame in milliseconds
+ * @param otherTime time spent on the rest of the frame in milliseconds
+ * @return number of generations to run next frame
+ */
+static uint32_t tuneStepsPerFrame(StepTuner_t *tuner, uint32_t steps, double updateTime,
+                                  double otherTime) {
+    double genCost = updateTime / steps;
+    if (tuner->genCost < 0) {
+        // first measurement, don't smooth
+        tuner->genCost = genCost;
+        tuner->overhead = otherTime;
+    } else {
+        tuner->genCost += AUTO_STEPS_SMOOTHING * (genCost - tuner->genCost);
+        tuner->overhead += AUTO_STEPS_SMOOTHING * (otherTime - tuner->overhead);
+    }
+
+    double available = tuner->budget - tuner->overhead;
+    if (available <= 0 || tuner->genCost <= 0) {
+        // rendering alone blows the budget (or the update was too fast to measure), so fall back
+        // to the minimum or maximum respectively
+        return available <= 0 ? 1 : AUTO_STEPS_MAX;
+    }
+    double next = floor(available / tuner->genCost);
+    return (uint32_t) MAX(1.0, MIN(next, (double) AUTO_STEPS_MAX));
+}
+#endif
+
+/**
+ * Checks if the process writing the last snapshot has finished, and reports how it went.
+ * @param checkpointer checkpointer state
+ * @param block if true, wait for the process to finish, otherwise just check on it
+ */
+static void checkpointReap(Checkpointer_t *checkpointer, bool block) {
+    if (checkpointer->child == -1) {
+        return;
+    }
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(checkpointer->child, &status, block ? 0 : WNOHANG);
+    } while (result == -1 && errno == EINTR);
+    if (result == 0) {
+        // still running
+        return;
+    } else if (result == -1) {
+        log_error("Failed to wait for snapshot writer %d: %s", checkpointer->child,
+                  strerror(errno));
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        log_error("Snapshot writer %d failed, %s may be out of date", checkpointer->child,
+                  checkpointer->filename);
+    }
+    checkpointer->child = -1;
+}
+
+/**
+ * Writes a snapshot of the current generation without stalling the simulation. The process is
+ * forked, and the child writes the snapshot from its copy-on-write image of the grid while the
+ * parent carries on; only pages the parent modifies in the meantime get copied. The child is
+ * reaped later by checkpointReap().
+ * @param checkpointer checkpointer state
+ * @return true if a snapshot is being written, false if the last one is still in progress or the
+ * fork failed
+ */
+static bool checkpointStart(Checkpointer_t *checkpointer) {
+    checkpointReap(checkpointer, false);
+    if (checkpointer->child != -1) {
+        log_warn("Still writing the last snapshot, skipping generation %lu", lifeGetGenerations());
+        return false;
+    }
+    double begin = utilsGetTime();
+    // flush before forking, otherwise anything buffered would be written by both processes
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) {
+        log_error("Failed to fork snapshot writer: %s", strerror(errno));
+        return false;
+    } else if (pid == 0) {
+        // child: only the forking thread exists here, so write the snapshot on this thread alone
+        // rather than starting a new OpenMP team, then leave without running any exit handlers
+        omp_set_num_threads(1);
+        _exit(lifeSaveSnapshot(checkpointer->filename) ? 0 : 1);
+    }
+    checkpointer->child = pid;
+    log_debug("Forked snapshot writer %d for generation %lu in %.3f ms", pid, lifeGetGenerations(),
+              (utilsGetTime() - begin) * 1000.0);
+    return true;
+}
+
+/**
+ * Works out how many generations can be run before the next periodic checkpoint is due.
+ * @param checkpointer checkpointer state
+ * @param steps number of generations that would be run otherwise
+ * @return steps, cut short so the simulation stops on the checkpoint's generation
+ */
+static uint32_t checkpointLimitSteps(const Checkpointer_t *checkpointer, uint32_t steps) {
+    uint64_t generation = lifeGetGenerations();
+    if (checkpointer->interval == 0 || generation >= checkpointer->next) {
+        // nothing due, or already overdue (e.g. after single stepping), so checkpointUpdate()
+        // will catch up after this update
+        return steps;
+    }
+    return (uint32_t) MIN(steps, checkpointer->next - generation);
+}
+
+/// Starts a periodic checkpoint if one is due on the current generation
+static void checkpointUpdate(Checkpointer_t *checkpointer) {
+    if (checkpointer->interval == 0) {
+        return;
+    }
+    checkpointReap(checkpointer, false);
+    if (lifeGetGenerations() >= checkpointer->next) {
+        checkpointStart(checkpointer);
+        checkpointer->next = lifeGetGenerations() + checkpointer->interval;
+    }
+}
+
+/**
+ * Works out how many generations can be run before the pattern export is due.
+ * @param exporter export state
+ * @param steps number of generations that would be run otherwise
+ * @return steps, cut short so the simulation stops on the export's generation
+ */
+static uint32_t exportLimitSteps(const Exporter_t *exporter, uint32_t steps) {
+    uint64_t generation = lifeGetGenerations();
+    if (exporter->generation < 0 || generation >= (uint64_t) exporter->generation) {
+        return steps;
+    }
+    return (uint32_t) MIN(steps, (uint64_t) exporter->generation - generation);
+}
+
+/// Exports the pattern if it's due on the current generation
+static void exportUpdate(Exporter_t *exporter) {
+    if (exporter->generation >= 0 && lifeGetGenerations() == (uint64_t) exporter->generation) {
+        lifeExportPattern(exporter->filename);
+        exporter->generation = -1;
+    }
+}
+
+/**
+ * Runs the simulation without any graphics (SDL is never initialised) as fast as possible until the
+ * target generation is reached, then prints a JSON throughput report to stdout.
+ * @param targetGenerations generation to stop at
+ * @param width grid width in cells
+ * @param height grid height in cells
+ * @param checkpointer periodic checkpoint state
+ * @param exporter pattern export state
+ */
+static void runHeadless(uint64_t targetGenerations, uint32_t width, uint32_t height,
+                        Checkpointer_t *checkpointer, Exporter_t *exporter) {
+    PerfPhase_t *update = &phases[PHASE_UPDATE];
+    // when resuming from a snapshot we start part way through, so only count what we simulate
+    uint64_t startGenerations = lifeGetGenerations();
+    double begin = utilsGetTime();
+    perfPhaseBegin(update);
+    while (lifeGetGenerations() < targetGenerations) {
+        uint64_t remaining = targetGenerations - lifeGetGenerations();
+        uint32_t steps = checkpointLimitSteps(checkpointer, (uint32_t) MIN(remaining, UINT32_MAX));
+        lifeUpdateMulti(exportLimitSteps(exporter, steps));
+        checkpointUpdate(checkpointer);
+        exportUpdate(exporter);
+    }
+    perfPhaseEnd(update);
+    double wallTime = utilsGetTime() - begin;
+    uint64_t gens = lifeGetGenerations() - startGenerations;
+    perfPhaseAddCells(update, gens * width * height);
+
+    double gensPerSec = wallTime > 0 ? gens / wallTime : 0.0;
+    LifeRule_t rule = lifeGetRule();
+    char ruleName[LIFE_MAX_RULE_STRING];
+    lifeFormatRule(&rule, ruleName);
+    printf("{\"generations\": %lu, \"width\": %u, \"height\": %u, \"kernel\": \"%s\", "
+           "\"topology\": \"%s\", \"rule\": \"%s\", \"threads\": %d, \"wall_time_s\": %.6f, "
+           "\"gens_per_sec\": %.3f, \"cells_per_sec\": %.1f, \"population\": %lu",
+           lifeGetGenerations(), width, height, lifeGetKernelName(lifeGetKernel()),
+           lifeGetTopologyName(lifeGetTopology()), ruleName, omp_get_max_threads(), wallTime,
+           gensPerSec, gensPerSec * width * height, lifeGetPopulation());
+    if (perfHwAvailable(PERF_HW_CYCLES) && update->cells > 0) {
+        const uint64_t *hw = update->hw.totals;
+        double cells = (double) update->cells;
+        printf(", \"cycles_per_cell\": %.4f", hw[PERF_HW_CYCLES] / cells);
+        if (perfHwAvailable(PERF_HW_INSTRUCTIONS) && hw[PERF_HW_CYCLES] > 0) {
+            printf(", \"ipc\": %.3f", (double) hw[PERF_HW_INSTRUCTIONS] / hw[PERF_HW_CYCLES]);
+        }
+        if (perfHwAvailable(PERF_HW_LLC_MISSES)) {
+            printf(", \"llc_misses_per_cell\": %.6f", hw[PERF_HW_LLC_MISSES] / cells);
+        }
+        if (perfHwAvailable(PERF_HW_BRANCH_MISSES)) {
+            printf(", \"branch_misses_per_cell\": %.6f", hw[PERF_HW_BRANCH_MISSES] / cells);
+        }
+        if (perfHwAvailable(PERF_HW_DTLB_MISSES)) {
+            printf(", \"dtlb_misses_per_cell\": %.6f", hw[PERF_HW_DTLB_MISSES] / cells);
+        }
+    }
+    printf("}\n");
+}
+
+#ifdef GOL_HAVE_SDL
 static SDL_Rect calculateViewport(int windowWidth, int windowHeight,
                                   uint32_t gameWidth, uint32_t gameHeight) {
     SDL_Rect viewport = {0};
@@ -69,6 +336,7 @@ static SDL_Rect calculateViewport(int windowWidth, int windowHeight,
     log_trace("Game viewport (x,y,w,h): %d,%d,%d,%d", viewport.x, viewport.y, viewport.w, viewport.h);
     return viewport;
 }
+#endif
 
 int main(int argc, char *argv[]) {
     // parse program arguments using argtable3
@@ -76,27 +344,87 @@ int main(int argc, char *argv[]) {
     // TODO add argument for maximum frames per second
     struct arg_lit *argHelp = arg_lit0(NULL, "help", "Display help and exit.");
     struct arg_str *argGrid = arg_str0(NULL, "grid", "[width]x[height]",
-               "Game of Life grid size in cells.  Defaults to 256x256.");
+               "Game of Life grid size in cells. Defaults to the size of the pattern plus the "
+               "margin on each side.");
+    struct arg_int *argMargin = arg_int0(NULL, "margin", "int",
+               "Empty cells around the pattern when sizing the grid automatically. Defaults to "
+               XSTR(DEFAULT_GRID_MARGIN) ".");
     struct arg_str *argWin = arg_str0(NULL, "window","[width]x[height]",
               "Window size. Format is \"[width]x[height]\". Defaults to 1600x900");
     struct arg_lit *argGraphics = arg_lit0(NULL, "no-graphics",
-           "Disable graphical rendering, for performance testing.");
+           "Disable graphics entirely, run until --generations is reached and print a JSON "
+           "throughput report to stdout.");
+    struct arg_int *argGens = arg_int0(NULL, "generations", "int",
+           "Stop at this generation (which includes the generations in the snapshot when "
+           "resuming). Required with --no-graphics, otherwise defaults to running forever.");
     struct arg_int *argFps = arg_int0(NULL, "max-fps", "int",
             "Maximum framerate, or -1 to unlock. Defaults to unlocked");
-
-    struct arg_file *argPattern = arg_file1(NULL, "pattern", "file",
-            "Pattern file, use .rle for RLE encoded files and .txt for plaintext files.");
+    struct arg_lit *argHwCounters = arg_lit0(NULL, "hw-counters",
+            "Count cycles, instructions and cache/branch/TLB misses per phase with perf_event_open "
+            "(Linux only).");
+    struct arg_file *argTrace = arg_file0(NULL, "trace", "file",
+            "Record each frame phase and each thread's share of the update and render to this "
+            "file, in Chrome Trace Event JSON format (for chrome://tracing or ui.perfetto.dev).");
+    struct arg_str *argKernel = arg_str0(NULL, "kernel", "name",
+            "Grid update kernel, one of: reference, omp, jit (compiles the rule at runtime). "
+            "Defaults to omp.");
+    struct arg_str *argTopology = arg_str0(NULL, "topology", "name",
+            "How the edges of the grid behave, one of: bounded (cells outside the grid are dead), "
+            "torus (edges wrap round). Defaults to bounded.");
+    struct arg_str *argRule = arg_str0(NULL, "rule", "rule",
+            "Rule in B/S notation, e.g. B36/S23, or with Hensel notation letters for an isotropic "
+            "non-totalistic rule, e.g. B2-a/S12, or with a number of states for a Generations "
+            "rule, e.g. B2/S/C3 (Brian's Brain). Defaults to " LIFE_RULE ".");
+    struct arg_str *argSteps = arg_str0(NULL, "steps-per-frame", "int|auto",
+            "Generations to compute per rendered frame, or \"auto\" to fit as many as possible in "
+            "the frame time budget. Defaults to 1.");
+
+    struct arg_file *argPattern = arg_file0(NULL, "pattern", "file",
+            "Pattern file, use .rle for RLE encoded files, .mc for macrocell files and .txt for "
+            "plaintext files. Add .gz for gzip (or .zst for zstd) compressed files, or use - to "
+            "read the pattern from stdin.");
+    struct arg_str *argSoup = arg_str0(NULL, "soup", "[width]x[height]",
+            "Start from a random soup of this size instead of loading a pattern.");
+    struct arg_dbl *argDensity = arg_dbl0(NULL, "density", "p",
+            "Probability of each soup cell being alive, from 0 to 1. Defaults to 0.5.");
+    struct arg_str *argSeed = arg_str0(NULL, "seed", "int",
+            "Soup random seed, up to 64 bits. The same seed always gives the same soup. Defaults "
+            "to 1.");
+    struct arg_file *argResume = arg_file0(NULL, "resume", "file",
+            "Resume from a snapshot written by --save, instead of loading a pattern. The grid size "
+            "and generation count come from the snapshot.");
+    struct arg_file *argSave = arg_file0(NULL, "save", "file",
+            "Write a snapshot of the grid to this file on exit, and when S is pressed. Defaults to "
+            "writing " DEFAULT_SNAPSHOT_FILE " when S is pressed, and nothing on exit.");
+    struct arg_file *argExport = arg_file0(NULL, "export", "file",
+            "Export the live cells to this pattern file (.rle for RLE, .mc for macrocell, "
+            "otherwise plain text) on exit, or at --export-at, and when E is pressed. Defaults "
+            "to " DEFAULT_EXPORT_FILE " for E and --export-at.");
+    struct arg_int *argExportAt = arg_int0(NULL, "export-at", "int",
+            "Export the pattern when this generation is reached, instead of on exit.");
+    struct arg_int *argCheckpoint = arg_int0(NULL, "checkpoint-every", "int",
+            "Also write a snapshot every this many generations, from a forked process so the "
+            "simulation doesn't stall. Goes to the --save file, or " DEFAULT_SNAPSHOT_FILE ".");
 
     struct arg_end *argEnd = arg_end(20);
 
-    void *argtable[] = {argHelp, argGrid, argWin, argGraphics, argFps,
-                        argPattern, argEnd};
+    void *argtable[] = {argHelp, argGrid, argMargin, argWin, argGraphics, argGens, argFps,
+                        argKernel, argTopology, argRule, argSteps, argHwCounters, argTrace,
+                        argPattern, argSoup, argDensity, argSeed, argResume, argSave,
+                        argCheckpoint, argExport, argExportAt, argEnd};
     assert(arg_nullcheck(argtable) == 0);
 
     // Set defaults for arg parser
-    *argGrid->sval = (XSTR(DEFAULT_GRID_WIDTH) "x" XSTR(DEFAULT_GRID_HEIGHT));
+    *argMargin->ival = DEFAULT_GRID_MARGIN;
     *argWin->sval = (XSTR(DEFAULT_WINDOW_WIDTH) "x" XSTR(DEFAULT_WINDOW_HEIGHT));
     *argFps->ival = -1;
+    *argGens->ival = -1;
+    *argSteps->sval = "1";
+    *argKernel->sval = "omp";
+    *argDensity->dval = 0.5;
+    *argSeed->sval = "1";
+    *argTopology->sval = "bounded";
+    *argRule->sval = LIFE_RULE;
 
     int nerrors = arg_parse(argc, argv, argtable);
     if (argHelp->count > 0) {
@@ -104,7 +432,8 @@ int main(int argc, char *argv[]) {
         printf("Conway's Game of Life v" VERSION "\n");
         printf("Copyright (c) 2022 Matt Young. Available under the Mozilla Public Licence 2.0.\n");
         printf("Keyboard controls:\n- SPACE to toggle pause\n- RIGHT ARROW to single step "
-               "while paused\n- Q or ESCAPE to quit\n\n");
+               "while paused\n- S to save a snapshot\n- E to export the pattern\n- Q or ESCAPE "
+               "to quit\n\n");
         printf("Usage: gameoflife");
         arg_print_syntax(stdout, argtable, "\n");
         arg_print_glossary(stdout, argtable, "  %-30s %s\n");
@@ -117,26 +446,231 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    bool graphicsDisabled = argGraphics->count > 0;
+    if (graphicsDisabled) {
+        // stdout is reserved for the JSON report in headless mode, and errors go to stderr
+        log_set_level(LOG_ERROR);
+    }
+#ifndef GOL_HAVE_SDL
+    if (!graphicsDisabled) {
+        log_error("Built without SDL, so only headless mode (--no-graphics) is available.");
+        exit(1);
+    }
+#endif
+
     log_info("Conway's Game of Life v" VERSION);
     log_info("Copyright (c) 2022 Matt Young. Available under the Mozilla Public Licence 2.0.");
-    printSDLVersion();
+#ifdef GOL_HAVE_SDL
+    if (!graphicsDisabled) {
+        printSDLVersion();
+    }
+#endif
     log_info("Using up to %d OMP threads", omp_get_max_threads());
-    log_set_level(LOG_DEBUG);
+    if (!graphicsDisabled) {
+        log_set_level(LOG_DEBUG);
+    }
 
     int windowWidth = 0, windowHeight = 0;
     uint32_t gameWidth = 0, gameHeight = 0;
 
     // Store arguments after parsing
-    utilsParseSize(*argGrid->sval, &gameWidth, &gameHeight);
-    utilsParseSize(*argWin->sval, (uint32_t*) &windowWidth, (uint32_t*) &windowHeight);
-    const char *patternFile = *argPattern->filename;
-    bool isPatternRLE = strcasecmp(*argPattern->extension, ".rle") == 0;
-    bool graphicsDisabled = argGraphics->count > 0;
+    if (argPattern->count + argSoup->count + argResume->count != 1) {
+        log_error("Exactly one of --pattern, --soup or --resume must be given.");
+        exit(1);
+    }
+    bool resume = argResume->count > 0;
+    bool soup = argSoup->count > 0;
+    double soupDensity = *argDensity->dval;
+    if (soupDensity < 0.0 || soupDensity > 1.0) {
+        log_error("Soup density must be between 0 and 1.");
+        exit(1);
+    }
+    char *seedEnd = NULL;
+    uint64_t soupSeed = strtoull(*argSeed->sval, &seedEnd, 0);
+    if (strlen(seedEnd) > 0 || **argSeed->sval == '-') {
+        log_error("Soup seed must be a non-negative integer.");
+        exit(1);
+    }
+    const char *patternFile = resume ? *argResume->filename : *argPattern->filename;
+    const char *saveFile = argSave->count > 0 ? *argSave->filename : NULL;
+    if (argCheckpoint->count > 0 && *argCheckpoint->ival <= 0) {
+        log_error("Checkpoint interval must be a positive integer.");
+        exit(1);
+    }
+    Checkpointer_t checkpointer = {
+        .filename = saveFile != NULL ? saveFile : DEFAULT_SNAPSHOT_FILE,
+        .interval = argCheckpoint->count > 0 ? (uint64_t) *argCheckpoint->ival : 0,
+        .child = -1,
+    };
+    if (argExportAt->count > 0 && *argExportAt->ival < 0) {
+        log_error("Export generation must be a non-negative integer.");
+        exit(1);
+    }
+    Exporter_t exporter = {
+        .filename = argExport->count > 0 ? *argExport->filename : DEFAULT_EXPORT_FILE,
+        .generation = argExportAt->count > 0 ? *argExportAt->ival : -1,
+        .onExit = argExport->count > 0 && argExportAt->count == 0,
+    };
+    uint32_t patternWidth = 0, patternHeight = 0;
+    bool patternSizeKnown = false;
+    LifePattern_t *pattern = NULL;
+    if (resume) {
+        if (!lifeGetSnapshotSize(patternFile, &patternWidth, &patternHeight)) {
+            exit(1);
+        }
+        patternSizeKnown = true;
+    } else if (soup) {
+        if (!utilsParseSize(*argSoup->sval, &patternWidth, &patternHeight)) {
+            exit(1);
+        }
+        patternSizeKnown = true;
+    } else {
+        // the pattern is sized from the same read that loads it, once the grid exists
+        pattern = lifeOpenPattern(patternFile);
+        if (pattern == NULL) {
+            exit(1);
+        }
+        patternSizeKnown = lifePatternGetSize(pattern, &patternWidth, &patternHeight);
+    }
+    if (*argMargin->ival < 0) {
+        log_error("Margin must be a non-negative integer.");
+        exit(1);
+    }
+    if (resume) {
+        // snapshots restore the grid exactly as it was, so it can't be resized
+        if (argGrid->count > 0) {
+            log_error("--grid can't be used with --resume, the grid size comes from the snapshot.");
+            exit(1);
+        } else if (argTopology->count > 0) {
+            log_error("--topology can't be used with --resume, the topology comes from the "
+                      "snapshot.");
+            exit(1);
+        } else if (argRule->count > 0) {
+            log_error("--rule can't be used with --resume, the rule comes from the snapshot.");
+            exit(1);
+        }
+        gameWidth = patternWidth;
+        gameHeight = patternHeight;
+    } else if (argGrid->count > 0) {
+        if (!utilsParseSize(*argGrid->sval, &gameWidth, &gameHeight)) {
+            exit(1);
+        }
+        if (patternSizeKnown && (patternWidth > gameWidth || patternHeight > gameHeight)) {
+            log_error("Pattern is %ux%u, which doesn't fit in the %ux%u grid.", patternWidth,
+                      patternHeight, gameWidth, gameHeight);
+            exit(1);
+        }
+    } else if (patternSizeKnown) {
+        uint64_t margin = (uint64_t) *argMargin->ival * 2;
+        gameWidth = (uint32_t) MIN(patternWidth + margin, UINT32_MAX);
+        gameHeight = (uint32_t) MIN(patternHeight + margin, UINT32_MAX);
+        log_info("Sized grid to %ux%u for %ux%u pattern", gameWidth, gameHeight, patternWidth,
+                 patternHeight);
+    } else {
+        log_warn("Could not determine pattern size, using default grid size");
+        gameWidth = DEFAULT_GRID_WIDTH;
+        gameHeight = DEFAULT_GRID_HEIGHT;
+    }
+    // centre the pattern in the grid
+    uint32_t patternX = patternSizeKnown ? (gameWidth - patternWidth) / 2 : 0;
+    uint32_t patternY = patternSizeKnown ? (gameHeight - patternHeight) / 2 : 0;
+    if (!utilsParseSize(*argWin->sval, (uint32_t*) &windowWidth, (uint32_t*) &windowHeight)) {
+        exit(1);
+    }
+    int targetGenerations = *argGens->ival;
+    if (targetGenerations < 0 && targetGenerations != -1) {
+        log_error("Generations must be either -1 to run forever, or a non-negative integer.");
+        exit(1);
+    } else if (graphicsDisabled && targetGenerations == -1) {
+        log_error("--no-graphics requires --generations to be set.");
+        exit(1);
+    }
     int maxFramerate = *argFps->ival;
     if (maxFramerate <= 0 && maxFramerate != -1) {
         log_error("Max framerate must be either -1 to unlock, or a positive integer.");
         exit(1);
     }
+    LifeKernel_t kernel = lifeFindKernel(*argKernel->sval);
+    if (kernel == LIFE_KERNEL_COUNT) {
+        log_error("Unknown kernel: %s", *argKernel->sval);
+        exit(1);
+    }
+    LifeTopology_t topology = lifeFindTopology(*argTopology->sval);
+    if (topology == LIFE_TOPOLOGY_COUNT) {
+        log_error("Unknown topology: %s", *argTopology->sval);
+        exit(1);
+    }
+    LifeRule_t rule;
+    if (!lifeParseRule(*argRule->sval, &rule)) {
+        log_error("Invalid rule: %s", *argRule->sval);
+        exit(1);
+    }
+
+    // initialise game of life
+    if (!lifeInit(gameWidth, gameHeight)) {
+        exit(1);
+    }
+    lifeSetKernel(kernel);
+    lifeSetTopology(topology);
+    lifeSetRule(&rule);
+    clearPhases();
+    if (argHwCounters->count > 0) {
+        perfHwInit();
+    }
+    if (argTrace->count > 0) {
+        traceInit(*argTrace->filename);
+    }
+    bool loaded;
+    if (resume) {
+        loaded = lifeLoadSnapshot(patternFile);
+    } else if (soup) {
+        loaded = lifeInsertSoup(patternX, patternY, patternWidth, patternHeight, soupDensity,
+                                soupSeed);
+    } else {
+        loaded = lifeInsertOpenPattern(pattern, patternX, patternY);
+        lifeClosePattern(pattern);
+    }
+    if (!loaded) {
+        exit(1);
+    }
+    checkpointer.next = lifeGetGenerations() + checkpointer.interval;
+    exportUpdate(&exporter);
+
+    if (graphicsDisabled) {
+        arg_free(argtable);
+        runHeadless(targetGenerations, gameWidth, gameHeight, &checkpointer, &exporter);
+        // let the last checkpoint finish first, since it writes to the same file
+        checkpointReap(&checkpointer, true);
+        if (saveFile != NULL && !lifeSaveSnapshot(saveFile)) {
+            exit(1);
+        }
+        if (exporter.onExit && !lifeExportPattern(exporter.filename)) {
+            exit(1);
+        }
+        perfHwDestroy();
+        traceDestroy();
+        lifeDestroy();
+        return 0;
+    }
+
+#ifdef GOL_HAVE_SDL
+    // the steps per frame only matter when rendering
+    bool autoSteps = strcasecmp(*argSteps->sval, "auto") == 0;
+    uint32_t stepsPerFrame = 1;
+    if (!autoSteps) {
+        char *endptr = NULL;
+        long steps = strtol(*argSteps->sval, &endptr, 10);
+        if (strlen(endptr) > 0 || steps <= 0 || steps > UINT32_MAX) {
+            log_error("Steps per frame must be either \"auto\" or a positive integer.");
+            exit(1);
+        }
+        stepsPerFrame = (uint32_t) steps;
+    }
+    StepTuner_t tuner = {
+        .budget = maxFramerate > 0 ? 1000.0 / maxFramerate : AUTO_STEPS_DEFAULT_BUDGET_MS,
+        .genCost = -1.0,
+        .overhead = 0.0,
+    };
 
     // SDL setup
     if (SDL_Init(SDL_INIT_VIDEO) == -1) {
@@ -161,15 +695,11 @@ int main(int argc, char *argv[]) {
                                                  SDL_TEXTUREACCESS_STREAMING,
                                                  (int) gameWidth, (int) gameHeight);
     assert(gameTexture != NULL);
+    RenderBuffer_t renderBuffer;
+    renderInit(&renderBuffer, gameWidth, gameHeight);
 
-    // initialise game of life
-    lifeInit(gameWidth, gameHeight);
-    if (isPatternRLE) {
-        lifeInsertPatternRLE(patternFile, 0, 0);
-    } else {
-        lifeInsertPatternPlainText(patternFile, 0, 0);
-    }
     perfClear(&perf);
+    clearPhases();
 
     // viewport for game of life
     SDL_Rect viewport = calculateViewport(windowWidth, windowHeight, gameWidth, gameHeight);
@@ -203,8 +733,15 @@ int main(int argc, char *argv[]) {
                         SDL_SetWindowTitle(window, "Game of Life (running)");
                         // reset performance counter after pausing
                         perfClear(&perf);
+                        clearPhases();
                         printTimer = 0.0;
                     }
+                } else if (event.key.keysym.scancode == SDL_SCANCODE_S) {
+                    // press "S" to save a snapshot, in the background like a checkpoint
+                    checkpointStart(&checkpointer);
+                } else if (event.key.keysym.scancode == SDL_SCANCODE_E) {
+                    // press "E" to export the pattern
+                    lifeExportPattern(exporter.filename);
                 }
             } else if (event.type == SDL_KEYDOWN) {
                 if (event.key.keysym.scancode == SDL_SCANCODE_RIGHT && paused) {
@@ -217,26 +754,57 @@ int main(int argc, char *argv[]) {
                 viewport = calculateViewport(windowWidth, windowHeight, gameWidth, gameHeight);
             }
         }
-        double begin = getTime();
+        double begin = utilsGetTime();
+        perfPhaseBegin(&phases[PHASE_FRAME]);
+        perfPhaseBegin(&phases[PHASE_UPDATE]);
 
         // update GoL
         // TODO add zoom
+        uint32_t steps = 0;
         if (!paused) {
-            // if not paused, always update
-            lifeUpdate();
+            // if not paused, always update, but don't overshoot the generation target (if any)
+            steps = stepsPerFrame;
+            if (targetGenerations != -1) {
+                uint64_t target = (uint64_t) targetGenerations;
+                steps = (uint32_t) MIN(steps, target - MIN(target, lifeGetGenerations()));
+                if (steps == 0) {
+                    log_info("Reached target of %d generations", targetGenerations);
+                    break;
+                }
+            }
+            steps = exportLimitSteps(&exporter, checkpointLimitSteps(&checkpointer, steps));
+            lifeUpdateMulti(steps);
+            checkpointUpdate(&checkpointer);
+            exportUpdate(&exporter);
+            perfPhaseAddCells(&phases[PHASE_UPDATE], (uint64_t) steps * gameWidth * gameHeight);
         } else if (advanceOneFrame) {
             // otherwise, if we are paused, we might need to advance one frame
             lifeUpdate();
+            checkpointUpdate(&checkpointer);
+            exportUpdate(&exporter);
             updatePausedWindowTitle(window);
             advanceOneFrame = false;
         }
+        double updateEnd = utilsGetTime();
+        perfPhaseEnd(&phases[PHASE_UPDATE]);
 
         // update graphics
+        perfPhaseBegin(&phases[PHASE_RENDER]);
+        const uint32_t *pixels = renderPixels(&renderBuffer, lifeGetWorld());
+        perfPhaseEnd(&phases[PHASE_RENDER]);
+        perfPhaseAddCells(&phases[PHASE_RENDER], (uint64_t) gameWidth * gameHeight);
+
+        perfPhaseBegin(&phases[PHASE_UPLOAD]);
+        SDL_UpdateTexture(gameTexture, NULL, pixels, (int) (gameWidth * sizeof(uint32_t)));
+        perfPhaseEnd(&phases[PHASE_UPLOAD]);
+
+        perfPhaseBegin(&phases[PHASE_PRESENT]);
         SDL_SetRenderDrawColor(render, 0x80, 0x80, 0x80, 0xFF);
         SDL_RenderClear(render);
-        lifeRenderSDL(gameTexture);
         SDL_RenderCopy(render, gameTexture, NULL, &viewport);
         SDL_RenderPresent(render);
+        perfPhaseEnd(&phases[PHASE_PRESENT]);
+        perfPhaseEnd(&phases[PHASE_FRAME]);
 
         if (paused) {
             // in paused mode just run at 30 fps to save compute; and don't update performance
@@ -246,16 +814,21 @@ int main(int argc, char *argv[]) {
         }
 
         // update performance counters
-        double end = getTime();
+        double end = utilsGetTime();
         double delta = (end - begin) * 1000.0;
 
+        if (autoSteps) {
+            stepsPerFrame = tuneStepsPerFrame(&tuner, steps, (updateEnd - begin) * 1000.0,
+                                              (end - updateEnd) * 1000.0);
+        }
+
         // FPS limiter (if it's enabled): if we spend less than the number of milliseconds
         // maxFramerate is (e.g. 30fps = 33.3ms), then we should delay for the remaining amount of
         // milliseconds to get the required framerate
         if (maxFramerate > 0 && delta < 1000.0 / maxFramerate) {
             SDL_Delay((int) round((1000.0 / maxFramerate) - delta));
             // re-calculate begin/end times after delay
-            end = getTime();
+            end = utilsGetTime();
             delta = (end - begin) * 1000.0;
         }
 
@@ -263,20 +836,39 @@ int main(int argc, char *argv[]) {
         resetTimer += delta;
         if (printTimer >= 1000.0) {
             perfDumpConsole(&perf, "FPS");
+            if (stepsPerFrame > 1 || autoSteps) {
+                log_debug("[Steps] %u generations per frame, %.0f generations/sec", stepsPerFrame,
+                          stepsPerFrame * perf.sum / (double) perf.count);
+            }
+            for (int i = 0; i < NUM_PHASES; i++) {
+                perfPhaseDumpConsole(&phases[i]);
+            }
             printTimer = 0.0;
         }
         if (resetTimer >= 10000.0) {
             perfClear(&perf);
+            clearPhases();
             resetTimer = 0.0;
         }
         perfUpdate(&perf, 1000.0 / delta);
     }
 
+    checkpointReap(&checkpointer, true);
+    if (saveFile != NULL) {
+        lifeSaveSnapshot(saveFile);
+    }
+    if (exporter.onExit) {
+        lifeExportPattern(exporter.filename);
+    }
+    perfHwDestroy();
+    traceDestroy();
     lifeDestroy();
+    renderDestroy(&renderBuffer);
     SDL_DestroyTexture(gameTexture);
     SDL_DestroyRenderer(render);
     SDL_DestroyWindow(window);
     SDL_VideoQuit();
     SDL_Quit();
+#endif
     return 0;
 }
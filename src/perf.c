@@ -5,13 +5,41 @@
 // http://mozilla.org/MPL/2.0/.
 #include "perf.h"
 #include "log.h"
+#include "utils.h"
+#include "trace.h"
 #include <string.h>
+#include <math.h>
+#include <omp.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+/// Maximum number of OMP threads we open hardware counters for
+#define PERF_HW_MAX_THREADS 256
+
+/// Names of hardware events, for printing
+static const char *hwEventNames[PERF_HW_NUM_EVENTS] = {"cycles", "instructions", "LLC misses",
+                                                       "branch misses", "dTLB misses"};
+/// True if perfHwInit() succeeded
+static bool hwEnabled = false;
+/// True if the event could be opened (on the main thread)
+static bool hwAvailable[PERF_HW_NUM_EVENTS] = {false};
+/// Number of threads with open counters
+static int hwNumThreads = 0;
+/// Per thread file descriptors of each event, -1 if it couldn't be opened. The cycle counter is
+/// the group leader.
+static int hwFds[PERF_HW_MAX_THREADS][PERF_HW_NUM_EVENTS];
 
 void perfUpdate(PerfCounter_t *counter, double time) {
     if (time <= counter->min) {
         // new min value
         counter->min = time;
-    } else if (time >= counter->max) {
+    }
+    // not an else if: the first value recorded is both the min and the max
+    if (time >= counter->max) {
         // new max value
         counter->max = time;
     }
@@ -30,4 +58,249 @@ void perfClear(PerfCounter_t *counter) {
 void perfDumpConsole(PerfCounter_t *counter, const char *tag) {
     double avg = counter->sum / (double) counter->count;
     log_debug("[%s] min/max/avg: %.2f/%.2f/%.2f", tag, counter->min, counter->max, avg);
+}
+
+/// Returns the histogram bucket that the value goes in
+static inline size_t histogramBucket(uint64_t value) {
+    if (value < PERF_HIST_SUB_BUCKETS) {
+        // small values are recorded exactly
+        return value;
+    }
+    // index of the most significant bit, then the next PERF_HIST_SUB_BUCKET_BITS bits select the
+    // sub-bucket within that power of two
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - PERF_HIST_SUB_BUCKET_BITS;
+    size_t sub = (value >> shift) & (PERF_HIST_SUB_BUCKETS - 1);
+    return (size_t) (shift + 1) * PERF_HIST_SUB_BUCKETS + sub;
+}
+
+/// Returns the value in the middle of the range covered by the given histogram bucket
+static inline uint64_t histogramBucketMid(size_t bucket) {
+    if (bucket < PERF_HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (int) (bucket / PERF_HIST_SUB_BUCKETS) - 1;
+    uint64_t sub = bucket % PERF_HIST_SUB_BUCKETS;
+    uint64_t lowest = ((uint64_t) PERF_HIST_SUB_BUCKETS | sub) << shift;
+    return lowest + ((1ULL << shift) >> 1);
+}
+
+void perfHistogramRecord(PerfHistogram_t *hist, uint64_t value) {
+    hist->buckets[histogramBucket(value)]++;
+    hist->count++;
+}
+
+uint64_t perfHistogramPercentile(const PerfHistogram_t *hist, double percentile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    // rank of the value we're looking for, counting from 1
+    uint64_t rank = (uint64_t) ceil(percentile / 100.0 * (double) hist->count);
+    rank = MAX(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < PERF_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            return histogramBucketMid(i);
+        }
+    }
+    return histogramBucketMid(PERF_HIST_BUCKETS - 1);
+}
+
+void perfPhaseInit(PerfPhase_t *phase, const char *name) {
+    memset(phase, 0, sizeof(PerfPhase_t));
+    phase->name = name;
+    perfClear(&phase->counter);
+}
+
+#ifdef __linux__
+/// Opens one counter on the calling thread
+static int openHwEvent(PerfHwEvent_t event, int groupFd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+        case PERF_HW_CYCLES:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_HW_INSTRUCTIONS:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_HW_LLC_MISSES:
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_HW_BRANCH_MISSES:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_HW_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            return -1;
+    }
+    attr.disabled = groupFd == -1; // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid 0, cpu -1: count the calling thread on any CPU
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+/// Reads the current value of every hardware event, summed over all threads
+static void readHwCounters(uint64_t values[PERF_HW_NUM_EVENTS]) {
+    memset(values, 0, PERF_HW_NUM_EVENTS * sizeof(uint64_t));
+    for (int t = 0; t < hwNumThreads; t++) {
+        for (int e = 0; e < PERF_HW_NUM_EVENTS; e++) {
+            if (hwFds[t][e] == -1) {
+                continue;
+            }
+            // value, time enabled, time running
+            uint64_t buf[3] = {0};
+            if (read(hwFds[t][e], buf, sizeof(buf)) != sizeof(buf)) {
+                continue;
+            }
+            // scale up if the PMU had to multiplex the counters
+            if (buf[2] > 0 && buf[2] < buf[1]) {
+                buf[0] = (uint64_t) ((double) buf[0] * (double) buf[1] / (double) buf[2]);
+            }
+            values[e] += buf[0];
+        }
+    }
+}
+
+bool perfHwInit(void) {
+    hwNumThreads = MIN(omp_get_max_threads(), PERF_HW_MAX_THREADS);
+    for (int t = 0; t < PERF_HW_MAX_THREADS; t++) {
+        for (int e = 0; e < PERF_HW_NUM_EVENTS; e++) {
+            hwFds[t][e] = -1;
+        }
+    }
+
+    // counters are per thread, so each OMP thread has to open its own
+#pragma omp parallel default(none) shared(hwFds, hwNumThreads) num_threads(hwNumThreads)
+    {
+        int t = omp_get_thread_num();
+        int leader = openHwEvent(PERF_HW_CYCLES, -1);
+        if (leader != -1) {
+            hwFds[t][PERF_HW_CYCLES] = leader;
+            for (int e = PERF_HW_CYCLES + 1; e < PERF_HW_NUM_EVENTS; e++) {
+                // not all CPUs (or VMs) support every event, so missing ones are just skipped
+                hwFds[t][e] = openHwEvent(e, leader);
+            }
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    for (int e = 0; e < PERF_HW_NUM_EVENTS; e++) {
+        hwAvailable[e] = hwFds[0][e] != -1;
+        if (!hwAvailable[e]) {
+            log_warn("Hardware event \"%s\" is not available", hwEventNames[e]);
+        }
+    }
+    hwEnabled = hwAvailable[PERF_HW_CYCLES];
+    if (!hwEnabled) {
+        log_warn("Failed to open hardware performance counters, check perf_event_paranoid");
+        perfHwDestroy();
+    } else {
+        log_info("Opened hardware performance counters on %d threads", hwNumThreads);
+    }
+    return hwEnabled;
+}
+
+bool perfHwAvailable(PerfHwEvent_t event) {
+    return hwEnabled && hwAvailable[event];
+}
+
+void perfHwDestroy(void) {
+    for (int t = 0; t < hwNumThreads; t++) {
+        for (int e = 0; e < PERF_HW_NUM_EVENTS; e++) {
+            if (hwFds[t][e] != -1) {
+                close(hwFds[t][e]);
+                hwFds[t][e] = -1;
+            }
+        }
+    }
+    hwEnabled = false;
+}
+#else
+static void readHwCounters(uint64_t values[PERF_HW_NUM_EVENTS]) {
+    memset(values, 0, PERF_HW_NUM_EVENTS * sizeof(uint64_t));
+}
+
+bool perfHwInit(void) {
+    log_warn("Hardware performance counters are only supported on Linux");
+    return false;
+}
+
+bool perfHwAvailable(PerfHwEvent_t event) {
+    return false;
+}
+
+void perfHwDestroy(void) {
+}
+#endif
+
+void perfPhaseBegin(PerfPhase_t *phase) {
+    traceBegin(phase->name);
+    if (hwEnabled) {
+        readHwCounters(phase->hw.begin);
+    }
+    phase->begin = utilsGetTime();
+}
+
+void perfPhaseEnd(PerfPhase_t *phase) {
+    perfPhaseRecord(phase, (utilsGetTime() - phase->begin) * 1000.0);
+    if (hwEnabled) {
+        uint64_t end[PERF_HW_NUM_EVENTS];
+        readHwCounters(end);
+        for (int e = 0; e < PERF_HW_NUM_EVENTS; e++) {
+            phase->hw.totals[e] += end[e] - phase->hw.begin[e];
+        }
+    }
+    traceEnd(phase->name);
+}
+
+void perfPhaseAddCells(PerfPhase_t *phase, uint64_t cells) {
+    phase->cells += cells;
+}
+
+void perfPhaseRecord(PerfPhase_t *phase, double time) {
+    perfUpdate(&phase->counter, time);
+    perfHistogramRecord(&phase->histogram, (uint64_t) llround(MAX(time, 0.0) * 1e6));
+}
+
+void perfPhaseDumpConsole(PerfPhase_t *phase) {
+    if (phase->counter.count == 0) {
+        return;
+    }
+    const PerfHistogram_t *hist = &phase->histogram;
+    double avg = phase->counter.sum / (double) phase->counter.count;
+    log_debug("[%s] min/max/avg: %.3f/%.3f/%.3f ms, p50/p90/p99/p99.9: %.3f/%.3f/%.3f/%.3f ms",
+              phase->name, phase->counter.min, phase->counter.max, avg,
+              perfHistogramPercentile(hist, 50.0) / 1e6, perfHistogramPercentile(hist, 90.0) / 1e6,
+              perfHistogramPercentile(hist, 99.0) / 1e6, perfHistogramPercentile(hist, 99.9) / 1e6);
+
+    if (hwEnabled) {
+        const uint64_t *totals = phase->hw.totals;
+        char buf[512] = {0};
+        size_t len = 0;
+        if (hwAvailable[PERF_HW_INSTRUCTIONS] && totals[PERF_HW_CYCLES] > 0) {
+            len += snprintf(buf + len, sizeof(buf) - len, ", IPC %.2f",
+                            (double) totals[PERF_HW_INSTRUCTIONS] / (double) totals[PERF_HW_CYCLES]);
+        }
+        // misses per cell if we know how many cells the phase processed, otherwise per frame
+        bool perCell = phase->cells > 0;
+        double divisor = perCell ? (double) phase->cells : (double) phase->counter.count;
+        for (int e = PERF_HW_LLC_MISSES; e < PERF_HW_NUM_EVENTS; e++) {
+            if (hwAvailable[e] && len < sizeof(buf)) {
+                len += snprintf(buf + len, sizeof(buf) - len, ", %s/%s %.4f", hwEventNames[e],
+                                perCell ? "cell" : "frame", (double) totals[e] / divisor);
+            }
+        }
+        log_debug("[%s] cycles/%s %.2f%s", phase->name, perCell ? "cell" : "frame",
+                  (double) totals[PERF_HW_CYCLES] / divisor, buf);
+    }
 }
\ No newline at end of file
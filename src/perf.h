@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 /// Performance timer data structure. All units should be in milliseconds.
 typedef struct {
@@ -21,6 +22,61 @@ typedef struct {
     size_t count;
 } PerfCounter_t;
 
+/// Number of sub-buckets per power of two in a latency histogram, as a power of two. 2^5 = 32
+/// sub-buckets means every recorded value is accurate to within ~3%.
+#define PERF_HIST_SUB_BUCKET_BITS 5
+#define PERF_HIST_SUB_BUCKETS (1 << PERF_HIST_SUB_BUCKET_BITS)
+/// Total number of buckets, enough to cover every 64-bit value
+#define PERF_HIST_BUCKETS ((64 - PERF_HIST_SUB_BUCKET_BITS + 1) * PERF_HIST_SUB_BUCKETS)
+
+/**
+ * Log-linear (HDR-style) latency histogram. Values are recorded in nanoseconds into buckets that
+ * are linear within each power of two, so percentiles have constant relative error no matter
+ * whether a phase takes microseconds or seconds.
+ */
+typedef struct {
+    /// Number of values recorded in each bucket
+    uint64_t buckets[PERF_HIST_BUCKETS];
+    /// Total number of values recorded
+    uint64_t count;
+} PerfHistogram_t;
+
+/// Hardware events that can be counted with perfHwInit()
+typedef enum {
+    PERF_HW_CYCLES = 0,
+    PERF_HW_INSTRUCTIONS,
+    /// Last level cache misses
+    PERF_HW_LLC_MISSES,
+    PERF_HW_BRANCH_MISSES,
+    /// Data TLB (read) misses
+    PERF_HW_DTLB_MISSES,
+    PERF_HW_NUM_EVENTS,
+} PerfHwEvent_t;
+
+/// Hardware event counts for a phase, summed over all OMP threads
+typedef struct {
+    /// Totals of each event over all recorded phases
+    uint64_t totals[PERF_HW_NUM_EVENTS];
+    /// Values of the counters when the phase began
+    uint64_t begin[PERF_HW_NUM_EVENTS];
+} PerfHwCounters_t;
+
+/// Timer for one named phase of the main loop (e.g. update, render). All units are milliseconds.
+typedef struct {
+    /// Name of the phase, used when dumping
+    const char *name;
+    /// Min/max/avg of the phase duration
+    PerfCounter_t counter;
+    /// Distribution of the phase duration, for percentiles
+    PerfHistogram_t histogram;
+    /// Time perfPhaseBegin() was last called, in seconds
+    double begin;
+    /// Hardware counters, only updated if perfHwInit() succeeded
+    PerfHwCounters_t hw;
+    /// Number of cells processed during this phase, used to report hardware events per cell
+    uint64_t cells;
+} PerfPhase_t;
+
 /// Updates the performance counter with the given time in milliseconds
 void perfUpdate(PerfCounter_t *counter, double time);
 
@@ -28,4 +84,51 @@ void perfUpdate(PerfCounter_t *counter, double time);
 void perfClear(PerfCounter_t *counter);
 
 /// Dumps the values of the performance counter to the console
-void perfDumpConsole(PerfCounter_t *counter, const char *tag);
\ No newline at end of file
+void perfDumpConsole(PerfCounter_t *counter, const char *tag);
+
+/// Records a value in nanoseconds in the histogram
+void perfHistogramRecord(PerfHistogram_t *hist, uint64_t value);
+
+/**
+ * Calculates a percentile of the values recorded in a histogram.
+ * @param hist the histogram
+ * @param percentile percentile to calculate, from 0 to 100 (e.g. 99.9)
+ * @return the value at that percentile in nanoseconds (to within the bucket precision), or 0 if
+ * nothing has been recorded
+ */
+uint64_t perfHistogramPercentile(const PerfHistogram_t *hist, double percentile);
+
+/// Initialises (or clears) a phase timer with the given name
+void perfPhaseInit(PerfPhase_t *phase, const char *name);
+
+/// Marks the start of a phase (and begins a trace span, if tracing is enabled)
+void perfPhaseBegin(PerfPhase_t *phase);
+
+/// Marks the end of a phase, records its duration, and ends its trace span
+void perfPhaseEnd(PerfPhase_t *phase);
+
+/// Records a phase duration in milliseconds
+void perfPhaseRecord(PerfPhase_t *phase, double time);
+
+/// Adds to the number of cells processed during a phase (e.g. width*height*generations)
+void perfPhaseAddCells(PerfPhase_t *phase, uint64_t cells);
+
+/// Dumps min/max/avg and p50/p90/p99/p99.9 of a phase timer to the console, as well as the
+/// hardware counters if they're enabled.
+void perfPhaseDumpConsole(PerfPhase_t *phase);
+
+/**
+ * Opens hardware performance counters (Linux perf_event_open) for cycles, instructions, LLC misses,
+ * branch misses and dTLB misses on every OMP thread, so that perfPhaseBegin() and perfPhaseEnd()
+ * attribute them to phases. Only user space events are counted. Must be called from outside a
+ * parallel region, and the OMP thread count must not change afterwards.
+ * @return true if at least the cycle counter could be opened, false if hardware counters are
+ * unavailable (not Linux, no PMU, perf_event_paranoid too high, etc)
+ */
+bool perfHwInit(void);
+
+/// Returns true if hardware counters are enabled and the given event could be opened
+bool perfHwAvailable(PerfHwEvent_t event);
+
+/// Closes the hardware performance counters opened by perfHwInit()
+void perfHwDestroy(void);
\ No newline at end of file
@@ -0,0 +1,101 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "render.h"
+#include <stdio.h>
+#include <assert.h>
+#include <omp.h>
+#include "trace.h"
+
+void renderInit(RenderBuffer_t *buffer, uint32_t width, uint32_t height) {
+    buffer->width = width;
+    buffer->height = height;
+    buffer->pixels = calloc((size_t) width * height, sizeof(uint32_t));
+}
+
+void renderDestroy(RenderBuffer_t *buffer) {
+    free(buffer->pixels);
+    *buffer = (RenderBuffer_t) {0};
+}
+
+void renderConsole(const LifeWorld_t *world) {
+    uint32_t width = lifeWorldGetWidth(world), height = lifeWorldGetHeight(world);
+    uint8_t *states = malloc(width);
+    for (uint32_t y = 0; y < height; y++) {
+        lifeWorldGetStates(world, y, states);
+        for (uint32_t x = 0; x < width; x++) {
+            // dying cells of Generations rules are shown as +
+            printf("%c", states[x] == 0 ? '.' : states[x] == 1 ? 'O' : '+');
+        }
+        printf("\n");
+    }
+    free(states);
+}
+
+/**
+ * Fills in the colour of each state of a Generations rule: dead is black, alive is white, and dying
+ * cells fade from orange to dark red as they get closer to dead.
+ */
+static void buildPalette(uint32_t palette[LIFE_MAX_STATES], uint32_t dyingStates) {
+    palette[0] = 0;
+    palette[1] = 0xFFFFFF;
+    for (uint32_t i = 0; i < dyingStates; i++) {
+        // 0 for the first dying state, 255 for the last
+        uint32_t t = dyingStates > 1 ? i * 255 / (dyingStates - 1) : 0;
+        uint32_t red = 255 - t * 3 / 5, green = 160 - t * 160 / 255;
+        palette[i + 2] = red << 16 | green << 8;
+    }
+}
+
+/// Renders a world running a Generations rule, where each cell's colour comes from its state
+static void renderStates(RenderBuffer_t *buffer, const LifeWorld_t *world, uint32_t dyingStates) {
+    uint32_t palette[LIFE_MAX_STATES];
+    buildPalette(palette, dyingStates);
+#pragma omp parallel default(none) shared(buffer, world, palette)
+    {
+        traceBegin("renderPixels chunk");
+        uint8_t *states = malloc(buffer->width);
+#pragma omp for nowait
+        for (uint32_t y = 0; y < buffer->height; y++) {
+            lifeWorldGetStates(world, y, states);
+            uint32_t *row = &buffer->pixels[(size_t) buffer->width * y];
+            for (uint32_t x = 0; x < buffer->width; x++) {
+                row[x] = palette[states[x]];
+            }
+        }
+        free(states);
+        traceEnd("renderPixels chunk");
+    }
+}
+
+const uint32_t *renderPixels(RenderBuffer_t *buffer, const LifeWorld_t *world) {
+    assert(buffer->width == lifeWorldGetWidth(world));
+    assert(buffer->height == lifeWorldGetHeight(world));
+    uint32_t dyingStates = lifeWorldGetRule(world).dyingStates;
+    if (dyingStates > 0) {
+        renderStates(buffer, world, dyingStates);
+        return buffer->pixels;
+    }
+    const bool *grid = lifeWorldGetGrid(world);
+    // copy over grid data
+#pragma omp parallel default(none) shared(buffer, grid)
+    {
+        traceBegin("renderPixels chunk");
+#pragma omp for nowait
+        for (uint32_t y = 0; y < buffer->height; y++) {
+            for (uint32_t x = 0; x < buffer->width; x++) {
+                size_t i = x + (size_t) buffer->width * y;
+                buffer->pixels[i] = grid[i] ? 0xFFFFFF : 0;
+            }
+        }
+        traceEnd("renderPixels chunk");
+    }
+    return buffer->pixels;
+}
+
+void renderSDL(RenderBuffer_t *buffer, const LifeWorld_t *world, SDL_Texture *texture) {
+    SDL_UpdateTexture(texture, NULL, renderPixels(buffer, world),
+                      (int) (buffer->width * sizeof(uint32_t)));
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Front end rendering of a world's grid, to the console or to SDL. This lives outside the engine
+// so that libgol, and anything linking it, doesn't need SDL.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "life.h"
+
+/// Pixels a grid is rendered into before being uploaded to SDL
+typedef struct {
+    /// RGB888 pixels, width*height of them, row-major
+    uint32_t *pixels;
+    uint32_t width, height;
+} RenderBuffer_t;
+
+/// Allocates a pixel buffer for a grid of the given size
+void renderInit(RenderBuffer_t *buffer, uint32_t width, uint32_t height);
+
+/// Frees memory associated with renderInit()
+void renderDestroy(RenderBuffer_t *buffer);
+
+/// Renders a world's grid to the console, with dying cells of Generations rules as +.
+void renderConsole(const LifeWorld_t *world);
+
+/**
+ * Renders a world's grid to the pixel buffer, which must be the same size as the grid. Rows are
+ * split between OpenMP threads. Under a Generations rule, dying cells fade from orange to dark red.
+ * @return the pixel buffer, valid until renderDestroy()
+ */
+const uint32_t *renderPixels(RenderBuffer_t *buffer, const LifeWorld_t *world);
+
+/// Renders a world's grid to an SDL texture of the same size, via the pixel buffer.
+void renderSDL(RenderBuffer_t *buffer, const LifeWorld_t *world, SDL_Texture *texture);
@@ -0,0 +1,288 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "slice.h"
+#include <string.h>
+#include <assert.h>
+#include <omp.h>
+#include "utils.h"
+#include "log.h"
+
+/// Bits in a population count, enough for any universe that fits in memory
+#define SLICE_COUNTER_BITS 32
+
+static inline size_t sliceIndex(const SliceWorld_t *world, uint32_t x, uint32_t y) {
+    return (size_t) (world->width + 2) * (y + 1) + (x + 1);
+}
+
+/// Rebuilds the list of totals that any universe's rule cares about
+static void buildTotals(SliceWorld_t *world) {
+    world->numTotals = 0;
+    for (uint8_t t = 0; t < 10; t++) {
+        if ((world->born[t] | world->kept[t]) != 0) {
+            world->totals[world->numTotals++] = t;
+        }
+    }
+}
+
+bool sliceInit(SliceWorld_t *world, uint32_t width, uint32_t height, LifeTopology_t topology) {
+    assert(topology < LIFE_TOPOLOGY_COUNT);
+    if (width == 0 || height == 0) {
+        log_error("Invalid universe size %ux%u", width, height);
+        return false;
+    }
+    *world = (SliceWorld_t) {
+        .width = width,
+        .height = height,
+        .topology = topology,
+    };
+    size_t words = (size_t) (width + 2) * (height + 2);
+    world->cells = calloc(words, sizeof(uint64_t));
+    world->next = calloc(words, sizeof(uint64_t));
+    LifeRule_t rule;
+    lifeParseRule(LIFE_RULE, &rule);
+    for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+        sliceSetRule(world, u, &rule);
+    }
+    return true;
+}
+
+void sliceDestroy(SliceWorld_t *world) {
+    free(world->cells);
+    free(world->next);
+    *world = (SliceWorld_t) {0};
+}
+
+void sliceSetRule(SliceWorld_t *world, uint32_t universe, const LifeRule_t *rule) {
+    assert(universe < SLICE_UNIVERSES);
+    assert(!rule->isotropic && rule->dyingStates == 0);
+    uint64_t bit = 1ULL << universe;
+    for (uint32_t t = 0; t < 10; t++) {
+        world->born[t] &= ~bit;
+        world->kept[t] &= ~bit;
+        // a dead cell's total is its neighbour count, a live cell's is one more
+        if (t <= 8 && (rule->birth & (1 << t))) {
+            world->born[t] |= bit;
+        }
+        if (t >= 1 && (rule->survival & (1 << (t - 1)))) {
+            world->kept[t] |= bit;
+        }
+    }
+    buildTotals(world);
+}
+
+void sliceLoad(SliceWorld_t *world, uint32_t universe, const bool *cells) {
+    assert(universe < SLICE_UNIVERSES);
+    uint64_t bit = 1ULL << universe;
+    for (uint32_t y = 0; y < world->height; y++) {
+        uint64_t *row = &world->cells[sliceIndex(world, 0, y)];
+        const bool *in = cells == NULL ? NULL : &cells[(size_t) world->width * y];
+        for (uint32_t x = 0; x < world->width; x++) {
+            row[x] = (row[x] & ~bit) | (in != NULL && in[x] ? bit : 0);
+        }
+    }
+}
+
+void sliceExtract(const SliceWorld_t *world, uint32_t universe, bool *cells) {
+    assert(universe < SLICE_UNIVERSES);
+    for (uint32_t y = 0; y < world->height; y++) {
+        const uint64_t *row = &world->cells[sliceIndex(world, 0, y)];
+        bool *out = &cells[(size_t) world->width * y];
+        for (uint32_t x = 0; x < world->width; x++) {
+            out[x] = (row[x] >> universe) & 1;
+        }
+    }
+}
+
+/// Copies each edge of a torus into the border on the opposite side, so the update doesn't need to
+/// wrap any coordinates
+static void wrapBorder(SliceWorld_t *world) {
+    uint32_t w = world->width, h = world->height;
+    size_t stride = w + 2;
+    uint64_t *cells = world->cells;
+    for (uint32_t y = 1; y <= h; y++) {
+        cells[stride * y] = cells[stride * y + w];
+        cells[stride * y + w + 1] = cells[stride * y + 1];
+    }
+    // whole rows, which takes care of the corners as well
+    memcpy(cells, &cells[stride * h], stride * sizeof(uint64_t));
+    memcpy(&cells[stride * (h + 1)], &cells[stride], stride * sizeof(uint64_t));
+}
+
+/**
+ * Works out the next generation of one row. The 3x3 totals come from adding the horizontal sums of
+ * the row and the rows above and below with full adders, giving 4 bit planes. Then for each total
+ * any rule uses, the cells with that total are picked out and kept or born according to each
+ * universe's rule. Every loop is over a row of words, so compilers vectorise them (4 words at a
+ * time with AVX2).
+ * @param planes scratch space for 4 planes of width words
+ */
+static void updateRow(SliceWorld_t *world, uint32_t y, uint64_t *planes) {
+    uint32_t w = world->width;
+    size_t stride = w + 2;
+    // these start at the left border, so cell x is at x + 1
+    const uint64_t *above = &world->cells[stride * (y - 1)];
+    const uint64_t *row = &world->cells[stride * y];
+    const uint64_t *below = &world->cells[stride * (y + 1)];
+    const uint64_t *alive = &row[1];
+    uint64_t *next = &world->next[stride * y + 1];
+    uint64_t *s0 = planes, *w2 = &planes[w], *w4 = &planes[2 * w], *w8 = &planes[3 * w];
+
+    // total = s0 + 2 * w2 + 4 * w4 + 8 * w8
+    for (uint32_t x = 0; x < w; x++) {
+        // horizontal sums of each row, as 2 bit numbers
+        uint64_t a0 = above[x] ^ above[x + 1] ^ above[x + 2];
+        uint64_t a1 = (above[x] & above[x + 1]) | (above[x + 2] & (above[x] ^ above[x + 1]));
+        uint64_t b0 = row[x] ^ row[x + 1] ^ row[x + 2];
+        uint64_t b1 = (row[x] & row[x + 1]) | (row[x + 2] & (row[x] ^ row[x + 1]));
+        uint64_t c0 = below[x] ^ below[x + 1] ^ below[x + 2];
+        uint64_t c1 = (below[x] & below[x + 1]) | (below[x + 2] & (below[x] ^ below[x + 1]));
+        uint64_t carry = (a0 & b0) | (c0 & (a0 ^ b0));
+        uint64_t u0 = a1 ^ b1 ^ c1;
+        uint64_t u1 = (a1 & b1) | (c1 & (a1 ^ b1));
+        uint64_t k = u0 & carry;
+        s0[x] = a0 ^ b0 ^ c0;
+        w2[x] = u0 ^ carry;
+        w4[x] = u1 ^ k;
+        w8[x] = u1 & k;
+    }
+
+    memset(next, 0, w * sizeof(uint64_t));
+    for (uint32_t i = 0; i < world->numTotals; i++) {
+        uint8_t t = world->totals[i];
+        // flipping the planes whose bit of t is clear means the ones with that total are all ones
+        uint64_t f0 = t & 1 ? 0 : ~0ULL, f1 = t & 2 ? 0 : ~0ULL;
+        uint64_t f2 = t & 4 ? 0 : ~0ULL, f3 = t & 8 ? 0 : ~0ULL;
+        uint64_t born = world->born[t], kept = world->kept[t];
+        for (uint32_t x = 0; x < w; x++) {
+            uint64_t match = (s0[x] ^ f0) & (w2[x] ^ f1) & (w4[x] ^ f2) & (w8[x] ^ f3);
+            next[x] |= match & ((alive[x] & kept) | (~alive[x] & born));
+        }
+    }
+}
+
+/// Swaps the current and next generation once every row has been updated
+static void swapGenerations(SliceWorld_t *world) {
+    uint64_t *tmp = world->cells;
+    world->cells = world->next;
+    world->next = tmp;
+    world->generations++;
+}
+
+void sliceUpdate(SliceWorld_t *world, uint32_t steps) {
+    // one parallel region for all the steps, as in life.c's updateRows(). Each thread keeps its own
+    // planes for the whole batch, and the border wrap and swap are the only serial parts.
+#pragma omp parallel default(none) shared(world, steps)
+    {
+        uint32_t w = world->width, h = world->height;
+        uint64_t *planes = malloc(4 * (size_t) w * sizeof(uint64_t));
+        for (uint32_t i = 0; i < steps; i++) {
+            if (world->topology == LIFE_TOPOLOGY_TORUS) {
+#pragma omp single
+                wrapBorder(world);
+            }
+
+#pragma omp for schedule(static)
+            for (uint32_t y = 1; y <= h; y++) {
+                updateRow(world, y, planes);
+            }
+
+#pragma omp single
+            swapGenerations(world);
+        }
+        free(planes);
+    }
+}
+
+void sliceUpdateSingle(SliceWorld_t *world, uint32_t steps) {
+    // the planes are a fresh allocation rather than kept in the world so the compiler can see
+    // they don't overlap the cells, otherwise it won't vectorise updateRow() (about 2x slower)
+    uint64_t *planes = malloc(4 * (size_t) world->width * sizeof(uint64_t));
+    for (uint32_t i = 0; i < steps; i++) {
+        if (world->topology == LIFE_TOPOLOGY_TORUS) {
+            wrapBorder(world);
+        }
+        for (uint32_t y = 1; y <= world->height; y++) {
+            updateRow(world, y, planes);
+        }
+        swapGenerations(world);
+    }
+    free(planes);
+}
+
+/// Carry save adder: adds three words bitwise, giving the high and low bits of each sum
+static inline void carrySave(uint64_t *high, uint64_t *low, uint64_t a, uint64_t b, uint64_t c) {
+    uint64_t u = a ^ b;
+    *high = (a & b) | (u & c);
+    *low = u ^ c;
+}
+
+/// Adds a word, counting as 2^bit, to bit-sliced counters with a ripple carry
+static inline void addToCounters(uint64_t *counters, uint64_t carry, uint32_t bit) {
+    for (uint32_t i = bit; carry != 0 && i < SLICE_COUNTER_BITS; i++) {
+        uint64_t next = counters[i] & carry;
+        counters[i] ^= carry;
+        carry = next;
+    }
+}
+
+/**
+ * Adds 16 words to the running ones, twos, fours and eights with a tree of carry save adders (as in
+ * the Harley-Seal popcount), and returns the sixteens that carry out of it.
+ */
+static uint64_t addBlock(const uint64_t *block, uint64_t *ones, uint64_t *twos, uint64_t *fours,
+                         uint64_t *eights) {
+    uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB, sixteens;
+    carrySave(&twosA, ones, *ones, block[0], block[1]);
+    carrySave(&twosB, ones, *ones, block[2], block[3]);
+    carrySave(&foursA, twos, *twos, twosA, twosB);
+    carrySave(&twosA, ones, *ones, block[4], block[5]);
+    carrySave(&twosB, ones, *ones, block[6], block[7]);
+    carrySave(&foursB, twos, *twos, twosA, twosB);
+    carrySave(&eightsA, fours, *fours, foursA, foursB);
+    carrySave(&twosA, ones, *ones, block[8], block[9]);
+    carrySave(&twosB, ones, *ones, block[10], block[11]);
+    carrySave(&foursA, twos, *twos, twosA, twosB);
+    carrySave(&twosA, ones, *ones, block[12], block[13]);
+    carrySave(&twosB, ones, *ones, block[14], block[15]);
+    carrySave(&foursB, twos, *twos, twosA, twosB);
+    carrySave(&eightsB, fours, *fours, foursA, foursB);
+    carrySave(&sixteens, eights, *eights, eightsA, eightsB);
+    return sixteens;
+}
+
+void slicePopulations(const SliceWorld_t *world, uint32_t populations[SLICE_UNIVERSES]) {
+    // counter bit plane i holds bit i of every universe's population
+    // optimisation: words are added 16 at a time with carry save adders, so the counters only
+    // take a (branchy) ripple carry once every 16 words
+    uint64_t counters[SLICE_COUNTER_BITS] = {0};
+    uint64_t ones = 0, twos = 0, fours = 0, eights = 0;
+    uint64_t block[16];
+    uint32_t blockSize = 0;
+    for (uint32_t y = 0; y < world->height; y++) {
+        const uint64_t *row = &world->cells[sliceIndex(world, 0, y)];
+        for (uint32_t x = 0; x < world->width; x++) {
+            block[blockSize++] = row[x];
+            if (blockSize == 16) {
+                addToCounters(counters, addBlock(block, &ones, &twos, &fours, &eights), 4);
+                blockSize = 0;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < blockSize; i++) {
+        addToCounters(counters, block[i], 0);
+    }
+    addToCounters(counters, ones, 0);
+    addToCounters(counters, twos, 1);
+    addToCounters(counters, fours, 2);
+    addToCounters(counters, eights, 3);
+
+    for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+        populations[u] = 0;
+        for (uint32_t i = 0; i < SLICE_COUNTER_BITS; i++) {
+            populations[u] |= (uint32_t) ((counters[i] >> u) & 1) << i;
+        }
+    }
+}
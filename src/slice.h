@@ -0,0 +1,87 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Bit-sliced engine for search workloads: bit k of every cell word belongs to universe k, so one
+// pass of boolean logic over the words advances SLICE_UNIVERSES separate universes at once. Each
+// universe can run its own outer totalistic rule, which makes it suitable for rule space sweeps as
+// well as soup searches.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "life.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Number of universes advanced together, one per bit of a cell word
+#define SLICE_UNIVERSES 64
+
+typedef struct {
+    uint32_t width, height;
+    LifeTopology_t topology;
+    /// Cells, with a border one cell wide all round, so (width + 2) * (height + 2) words,
+    /// row-major. The border is dead for bounded universes, and a copy of the opposite edge for
+    /// tori.
+    uint64_t *cells, *next;
+    /// Bit k of born[t] is set if in universe k, a dead cell whose 3x3 neighbourhood has t live
+    /// cells is born, and of kept[t] if a live cell with that total survives. Totals include the
+    /// cell itself, which is what the adders count.
+    uint64_t born[10], kept[10];
+    /// Totals that any universe's rule cares about, so the others can be skipped
+    uint8_t totals[10];
+    uint32_t numTotals;
+    uint64_t generations;
+} SliceWorld_t;
+
+/**
+ * Initialises a set of SLICE_UNIVERSES empty universes, all running B3/S23.
+ * @param world world to initialise
+ * @param width width of each universe in cells
+ * @param height height of each universe in cells
+ * @param topology how the edges of each universe behave
+ * @return true on success, false (after logging why) if the size is invalid
+ */
+bool sliceInit(SliceWorld_t *world, uint32_t width, uint32_t height, LifeTopology_t topology);
+
+/// Frees memory associated with sliceInit()
+void sliceDestroy(SliceWorld_t *world);
+
+/// Sets the rule one universe runs, which must be a two-state outer totalistic rule
+void sliceSetRule(SliceWorld_t *world, uint32_t universe, const LifeRule_t *rule);
+
+/**
+ * Replaces the contents of one universe, leaving the others alone.
+ * @param cells width*height cells, row-major, or NULL to clear the universe
+ */
+void sliceLoad(SliceWorld_t *world, uint32_t universe, const bool *cells);
+
+/// Copies one universe out into width*height cells, row-major
+void sliceExtract(const SliceWorld_t *world, uint32_t universe, bool *cells);
+
+/**
+ * Advances every universe by the given number of generations. Rows are split between OpenMP
+ * threads, with the threads only started once for the whole batch.
+ */
+void sliceUpdate(SliceWorld_t *world, uint32_t steps);
+
+/**
+ * Same as sliceUpdate(), but runs on the calling thread without starting a parallel region, for
+ * callers that already give each thread a world of its own (like gol_census).
+ */
+void sliceUpdateSingle(SliceWorld_t *world, uint32_t steps);
+
+/**
+ * Counts the live cells in every universe. The words are added up with bit-sliced counters, so
+ * this costs about as much as copying the cells, rather than a loop per universe.
+ * @param populations where to store the population of each universe
+ */
+void slicePopulations(const SliceWorld_t *world, uint32_t populations[SLICE_UNIVERSES]);
+
+#ifdef __cplusplus
+}
+#endif
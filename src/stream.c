@@ -0,0 +1,411 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "stream.h"
+#include "utils.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef GOL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/// Size of zlib's internal buffer for compressed input
+#define STREAM_GZ_BUFFER_SIZE (256 * 1024)
+
+/// A block of input, filled by the reader thread
+typedef struct {
+    char *data;
+    size_t size;
+} StreamBlock_t;
+
+struct StreamReader {
+    /// Compressed (or, for stdin, possibly uncompressed) input, if reading with zlib
+    gzFile gz;
+#ifdef GOL_HAVE_ZSTD
+    /// Compressed input, if reading with zstd
+    int fd;
+    ZSTD_DStream *zstd;
+    char *zstdIn;
+    ZSTD_inBuffer zstdInput;
+    bool zstdInputEof;
+    /// Last result of ZSTD_decompressStream() that made progress, 0 once a frame is complete
+    size_t zstdRemaining;
+#endif
+    pthread_t thread;
+    /// Protects everything below that is shared with the reader thread
+    pthread_mutex_t lock;
+    /// Signalled when a block is filled or released, or the reader thread should stop
+    pthread_cond_t changed;
+    StreamBlock_t blocks[STREAM_NUM_BLOCKS];
+    /// Blocks filled by the reader thread, and blocks released by the decoder, so far
+    uint64_t filled, released;
+    /// True once the reader thread has reached the end of the input, or failed
+    bool eof;
+    /// Set to tell the reader thread to stop
+    bool stop;
+    /// Reason reading failed, or NULL
+    const char *error;
+};
+
+/**
+ * Decompresses the next part of the input into a block. Called from the reader thread.
+ * @return number of bytes decompressed, 0 at the end of the input or on error
+ */
+static size_t fillBlock(StreamReader_t *reader, char *data, size_t capacity, const char **error) {
+#ifdef GOL_HAVE_ZSTD
+    if (reader->zstd != NULL) {
+        ZSTD_outBuffer output = {data, capacity, 0};
+        while (output.pos < output.size) {
+            size_t inputPos = reader->zstdInput.pos, outputPos = output.pos;
+            size_t result = ZSTD_decompressStream(reader->zstd, &output, &reader->zstdInput);
+            if (ZSTD_isError(result)) {
+                *error = ZSTD_getErrorName(result);
+                return 0;
+            }
+            // a call that does nothing just returns a hint for the next frame, which says nothing
+            // about whether the last one was complete
+            if (reader->zstdInput.pos != inputPos || output.pos != outputPos) {
+                reader->zstdRemaining = result;
+            }
+            if (reader->zstdInput.pos < reader->zstdInput.size || output.pos == output.size) {
+                continue;
+            } else if (reader->zstdInputEof) {
+                // an empty read flushes anything the decompressor still has buffered, so we only
+                // stop once the input is exhausted and nothing more comes out
+                if (reader->zstdRemaining != 0 && output.pos == 0) {
+                    *error = "unexpected end of file";
+                }
+                break;
+            }
+            ssize_t size = read(reader->fd, reader->zstdIn, ZSTD_DStreamInSize());
+            if (size == -1 && errno == EINTR) {
+                continue;
+            } else if (size == -1) {
+                *error = strerror(errno);
+                return 0;
+            }
+            reader->zstdInput = (ZSTD_inBuffer) {reader->zstdIn, (size_t) size, 0};
+            reader->zstdInputEof = size == 0;
+        }
+        return output.pos;
+    }
+#endif
+    int size = gzread(reader->gz, data, (unsigned) capacity);
+    int status = Z_OK;
+    const char *message = gzerror(reader->gz, &status);
+    if (size < 0 || (status != Z_OK && status != Z_STREAM_END)) {
+        // truncated files are reported as Z_BUF_ERROR once the data that was there has been read.
+        // zlib prefixes its messages with the path, which for gzdopen() is just "<fd:N>".
+        const char *reason = strstr(message, ": ");
+        *error = status == Z_ERRNO ? strerror(errno) : reason != NULL ? reason + 2 : message;
+        return 0;
+    }
+    return (size_t) size;
+}
+
+/// Reader thread: decompresses the input into the ring of blocks, ahead of the decoder
+static void *readerMain(void *arg) {
+    StreamReader_t *reader = arg;
+    // the thread is only ever cancelled while it's blocked reading (e.g. waiting on stdin), never
+    // while it holds the lock
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    while (true) {
+        pthread_mutex_lock(&reader->lock);
+        while (!reader->stop && reader->filled - reader->released == STREAM_NUM_BLOCKS) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+        bool stop = reader->stop;
+        StreamBlock_t *block = &reader->blocks[reader->filled % STREAM_NUM_BLOCKS];
+        pthread_mutex_unlock(&reader->lock);
+        if (stop) {
+            break;
+        }
+
+        const char *error = NULL;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        size_t size = fillBlock(reader, block->data, STREAM_BLOCK_SIZE, &error);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        pthread_mutex_lock(&reader->lock);
+        block->size = size;
+        if (error != NULL || size == 0) {
+            reader->error = error;
+            reader->eof = true;
+        } else {
+            reader->filled++;
+        }
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+        if (error != NULL || size == 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/// Frees a reader whose thread isn't running, closing its input
+static void readerFree(StreamReader_t *reader) {
+    if (reader->gz != NULL) {
+        gzclose(reader->gz);
+    }
+#ifdef GOL_HAVE_ZSTD
+    if (reader->zstd != NULL) {
+        ZSTD_freeDStream(reader->zstd);
+        free(reader->zstdIn);
+        close(reader->fd);
+    }
+#endif
+    for (int i = 0; i < STREAM_NUM_BLOCKS; i++) {
+        free(reader->blocks[i].data);
+    }
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+    free(reader);
+}
+
+/// Frees a reader, stopping its thread first
+static void readerDestroy(StreamReader_t *reader) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = true;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    // if the thread is blocked reading more input than we need (e.g. stdin that hasn't been closed
+    // yet), cancel it rather than waiting
+    pthread_cancel(reader->thread);
+    pthread_join(reader->thread, NULL);
+    readerFree(reader);
+}
+
+/// Creates a reader for a file descriptor and starts its thread, returning NULL on error
+static StreamReader_t *readerCreate(int fd, bool zstd) {
+    StreamReader_t *reader = calloc(1, sizeof(StreamReader_t));
+    if (zstd) {
+#ifdef GOL_HAVE_ZSTD
+        reader->fd = fd;
+        reader->zstd = ZSTD_createDStream();
+        reader->zstdIn = malloc(ZSTD_DStreamInSize());
+        ZSTD_initDStream(reader->zstd);
+#else
+        close(fd);
+        free(reader);
+        errno = ENOTSUP;
+        return NULL;
+#endif
+    } else {
+        reader->gz = gzdopen(fd, "rb");
+        if (reader->gz == NULL) {
+            close(fd);
+            free(reader);
+            errno = ENOMEM;
+            return NULL;
+        }
+        gzbuffer(reader->gz, STREAM_GZ_BUFFER_SIZE);
+    }
+    for (int i = 0; i < STREAM_NUM_BLOCKS; i++) {
+        reader->blocks[i].data = malloc(STREAM_BLOCK_SIZE);
+    }
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    int error = pthread_create(&reader->thread, NULL, readerMain, reader);
+    if (error != 0) {
+        readerFree(reader);
+        errno = error;
+        return NULL;
+    }
+    return reader;
+}
+
+const char *streamBaseName(const char *filename, char *buf, size_t size) {
+    snprintf(buf, size, "%s", filename);
+    size_t length = strlen(buf);
+    if (utilsEndsWith(".gz", buf)) {
+        buf[length - 3] = '\0';
+    } else if (utilsEndsWith(".zst", buf)) {
+        buf[length - 4] = '\0';
+    }
+    return buf;
+}
+
+bool streamOpen(Stream_t *stream, const char *filename) {
+    *stream = (Stream_t) {.filename = filename};
+    if (strcmp(filename, "-") == 0) {
+        // duplicate stdin, since closing the reader closes its file descriptor
+        int fd = dup(STDIN_FILENO);
+        stream->reader = fd == -1 ? NULL : readerCreate(fd, false);
+        return stream->reader != NULL;
+    }
+
+    bool zstd = utilsEndsWith(".zst", filename);
+    if (zstd || utilsEndsWith(".gz", filename)) {
+        int fd = open(filename, O_RDONLY);
+        stream->reader = fd == -1 ? NULL : readerCreate(fd, zstd);
+        return stream->reader != NULL;
+    }
+
+    // optimisation: plain files are mapped rather than read, so there's no copying at all
+    stream->mapping = utilsMapFile(filename, &stream->mappingSize);
+    if (stream->mapping == NULL) {
+        return false;
+    }
+    stream->blockBegin = stream->pos = stream->mapping;
+    stream->end = stream->mapping + stream->mappingSize;
+    return true;
+}
+
+void streamClose(Stream_t *stream) {
+    if (stream->mapping != NULL) {
+        utilsUnmapFile(stream->mapping, stream->mappingSize);
+    }
+    StreamReader_t *reader = stream->reader;
+    if (reader != NULL) {
+        if (stream->holding) {
+            pthread_mutex_lock(&reader->lock);
+            reader->released++;
+            pthread_cond_broadcast(&reader->changed);
+            pthread_mutex_unlock(&reader->lock);
+        }
+        readerDestroy(reader);
+    }
+    free(stream->line);
+    *stream = (Stream_t) {0};
+}
+
+/**
+ * Moves on to the next block of input, releasing the current one back to the reader thread
+ * @return false at the end of the input
+ */
+static bool nextBlock(Stream_t *stream) {
+    StreamReader_t *reader = stream->reader;
+    if (reader == NULL) {
+        // mapped files are a single block
+        return false;
+    }
+    stream->blockOffset += stream->end - stream->blockBegin;
+
+    pthread_mutex_lock(&reader->lock);
+    if (stream->holding) {
+        reader->released++;
+        stream->holding = false;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    while (reader->filled == reader->released && !reader->eof) {
+        pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+    bool available = reader->filled != reader->released;
+    StreamBlock_t block = reader->blocks[reader->released % STREAM_NUM_BLOCKS];
+    stream->holding = available;
+    pthread_mutex_unlock(&reader->lock);
+    if (!available) {
+        stream->blockBegin = stream->pos = stream->end = NULL;
+        return false;
+    }
+
+    stream->blockBegin = stream->pos = block.data;
+    stream->end = block.data + block.size;
+    return true;
+}
+
+bool streamReadLine(Stream_t *stream, const char **line, size_t *length) {
+    if (stream->pushedBack) {
+        stream->pushedBack = false;
+        *line = stream->lastLine;
+        *length = stream->lastLength;
+        return true;
+    }
+    size_t used = 0;
+    bool copied = false;
+    while (true) {
+        if (stream->pos == stream->end && !nextBlock(stream)) {
+            if (!copied) {
+                return false;
+            }
+            // last line with no line ending
+            break;
+        }
+        const char *newline = memchr(stream->pos, '\n', stream->end - stream->pos);
+        if (newline != NULL && !copied) {
+            // fast path: the whole line is in the current block, so there's no need to copy it
+            *line = stream->pos;
+            *length = newline - stream->pos;
+            stream->pos = newline + 1;
+            break;
+        }
+        // the line carries on into the next block, so copy it out
+        const char *lineEnd = newline == NULL ? stream->end : newline;
+        size_t chunk = lineEnd - stream->pos;
+        if (used + chunk > stream->lineCapacity) {
+            stream->lineCapacity = MAX(stream->lineCapacity * 2, used + chunk);
+            stream->line = realloc(stream->line, stream->lineCapacity);
+        }
+        memcpy(stream->line + used, stream->pos, chunk);
+        used += chunk;
+        copied = true;
+        stream->pos = newline == NULL ? stream->end : newline + 1;
+        if (newline != NULL) {
+            break;
+        }
+    }
+    if (copied) {
+        *line = stream->line;
+        *length = used;
+    }
+    if (*length > 0 && (*line)[*length - 1] == '\r') {
+        (*length)--;
+    }
+    stream->lastLine = *line;
+    stream->lastLength = *length;
+    return true;
+}
+
+void streamUnreadLine(Stream_t *stream) {
+    if (stream->lastLine >= stream->blockBegin && stream->lastLine < stream->end) {
+        // the line is still in the current block, so just go back to it
+        stream->pos = stream->lastLine;
+    } else {
+        stream->pushedBack = true;
+    }
+}
+
+bool streamRead(Stream_t *stream, const char **data, size_t *size) {
+    if (stream->pushedBack) {
+        stream->pushedBack = false;
+        *data = stream->lastLine;
+        *size = stream->lastLength;
+        return true;
+    }
+    if (stream->pos == stream->end && !nextBlock(stream)) {
+        return false;
+    }
+    *data = stream->pos;
+    *size = stream->end - stream->pos;
+    stream->pos = stream->end;
+    return true;
+}
+
+uint64_t streamOffset(const Stream_t *stream, const char *p) {
+    if (p >= stream->blockBegin && p <= stream->end) {
+        return stream->blockOffset + (p - stream->blockBegin);
+    }
+    // p is in a line that was copied out, so the start of the block is the best we can do
+    return stream->blockOffset;
+}
+
+bool streamIsMapped(const Stream_t *stream) {
+    return stream->mapping != NULL;
+}
+
+const char *streamError(const Stream_t *stream) {
+    if (stream->reader == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&stream->reader->lock);
+    const char *error = stream->reader->error;
+    pthread_mutex_unlock(&stream->reader->lock);
+    return error;
+}
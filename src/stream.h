@@ -0,0 +1,91 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Forward-only input for the pattern loaders. Plain files are mapped into memory and handed out as
+// one block. Compressed files (.gz, and .zst if built with zstd) and stdin ("-") are decompressed
+// by a reader thread into a ring of blocks, so decompression overlaps with decoding.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/// Size of each block decompressed by the reader thread
+#define STREAM_BLOCK_SIZE (1024 * 1024)
+/// Number of blocks in the ring between the reader thread and the decoder
+#define STREAM_NUM_BLOCKS 4
+
+/// Reader thread and the ring of blocks it fills, private to stream.c
+typedef struct StreamReader StreamReader_t;
+
+typedef struct {
+    /// Name of the file, for error messages
+    const char *filename;
+    /// Whole file, for plain files that are mapped into memory, otherwise NULL
+    const char *mapping;
+    size_t mappingSize;
+    /// Reader thread for compressed files and stdin, otherwise NULL
+    StreamReader_t *reader;
+    /// True if the decoder holds a block from the reader thread, which it mustn't overwrite
+    bool holding;
+
+    /// Unread part of the current block
+    const char *pos, *end;
+    /// Start of the current block, and its offset in the input
+    const char *blockBegin;
+    uint64_t blockOffset;
+    /// Lines that span two blocks are copied here
+    char *line;
+    size_t lineCapacity;
+    /// Last line returned, and whether it was pushed back to be returned again
+    const char *lastLine;
+    size_t lastLength;
+    bool pushedBack;
+} Stream_t;
+
+/**
+ * Opens a pattern file for reading. Files ending in .gz are decompressed with zlib, and files
+ * ending in .zst with zstd (if available), in a reader thread. "-" reads stdin, which may also be
+ * gzip compressed. stdin can only be read once.
+ * @param stream stream to open
+ * @param filename path to the file, or "-" for stdin
+ * @return true on success, false on error with errno set
+ */
+bool streamOpen(Stream_t *stream, const char *filename);
+
+/// Closes a stream and frees its memory, stopping the reader thread if it's still running
+void streamClose(Stream_t *stream);
+
+/**
+ * Reads the next line, without its line ending.
+ * @param line where to store a pointer to the line, valid until the next read
+ * @param length where to store the length of the line
+ * @return false at the end of the input, or if reading failed (see streamError())
+ */
+bool streamReadLine(Stream_t *stream, const char **line, size_t *length);
+
+/// Makes the next streamReadLine() or streamRead() start from the beginning of the last line again
+void streamUnreadLine(Stream_t *stream);
+
+/**
+ * Reads the next block of input, which for mapped files is the whole of the rest of the file.
+ * @param data where to store a pointer to the block, valid until the next read
+ * @param size where to store the size of the block
+ * @return false at the end of the input, or if reading failed (see streamError())
+ */
+bool streamRead(Stream_t *stream, const char **data, size_t *size);
+
+/// Returns the offset in the input of a pointer into the data last returned by streamRead()
+uint64_t streamOffset(const Stream_t *stream, const char *p);
+
+/// Returns true if the stream is a plain file mapped into memory, so streamRead() returns the rest
+/// of the file in one go
+bool streamIsMapped(const Stream_t *stream);
+
+/// Returns why reading failed, or NULL if it hasn't
+const char *streamError(const Stream_t *stream);
+
+/// Returns the filename with any compression extension (.gz, .zst) removed, in buf
+const char *streamBaseName(const char *filename, char *buf, size_t size);
@@ -0,0 +1,142 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#include "trace.h"
+#include "log.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+/// Maximum number of threads that can record events
+#define TRACE_MAX_THREADS 256
+/// Number of events a thread buffer grows by when it fills up
+#define TRACE_CHUNK_EVENTS 4096
+/// Maximum number of events per thread, further events are dropped (~64 MiB per thread)
+#define TRACE_MAX_EVENTS (2 * 1024 * 1024)
+
+typedef struct {
+    /// Name of the span, not owned
+    const char *name;
+    /// Time since traceInit() in microseconds
+    double timestamp;
+    /// 'B' for begin, 'E' for end
+    char phase;
+} TraceEvent_t;
+
+/// Events recorded by one thread. Only ever touched by that thread until traceDestroy().
+typedef struct {
+    TraceEvent_t *events;
+    size_t count;
+    size_t capacity;
+    /// Number of events dropped because the buffer was full
+    size_t dropped;
+} TraceBuffer_t;
+
+bool traceActive = false;
+static char *traceFilename = NULL;
+static double traceStart = 0.0;
+/// Buffers of every thread that has recorded an event, indexed by trace thread id
+static TraceBuffer_t *buffers[TRACE_MAX_THREADS] = {NULL};
+/// Number of threads that have registered a buffer
+static atomic_int numBuffers = 0;
+/// The calling thread's buffer, or NULL if it hasn't recorded anything yet
+static _Thread_local TraceBuffer_t *localBuffer = NULL;
+/// Set if a thread could not get a buffer, so we only warn once
+static _Thread_local bool localNoBuffer = false;
+
+void traceInit(const char *filename) {
+    traceFilename = strdup(filename);
+    traceStart = utilsGetTime();
+    traceActive = true;
+    log_info("Tracing to %s", filename);
+}
+
+/// Registers a buffer for the calling thread
+static TraceBuffer_t *registerBuffer(void) {
+    int id = atomic_fetch_add(&numBuffers, 1);
+    if (id >= TRACE_MAX_THREADS) {
+        log_warn("Too many threads to trace, ignoring events from this thread");
+        localNoBuffer = true;
+        return NULL;
+    }
+    TraceBuffer_t *buffer = calloc(1, sizeof(TraceBuffer_t));
+    buffers[id] = buffer;
+    return buffer;
+}
+
+void traceRecord(const char *name, char phase) {
+    double now = utilsGetTime();
+    if (localBuffer == NULL) {
+        if (localNoBuffer || (localBuffer = registerBuffer()) == NULL) {
+            return;
+        }
+    }
+    TraceBuffer_t *buffer = localBuffer;
+    if (buffer->count == buffer->capacity) {
+        if (buffer->capacity >= TRACE_MAX_EVENTS) {
+            buffer->dropped++;
+            return;
+        }
+        buffer->capacity += TRACE_CHUNK_EVENTS;
+        buffer->events = realloc(buffer->events, buffer->capacity * sizeof(TraceEvent_t));
+    }
+    buffer->events[buffer->count++] = (TraceEvent_t) {
+        .name = name,
+        .timestamp = (now - traceStart) * 1e6,
+        .phase = phase,
+    };
+}
+
+void traceDestroy(void) {
+    if (!traceActive) {
+        return;
+    }
+    traceActive = false;
+    int threads = MIN(atomic_load(&numBuffers), TRACE_MAX_THREADS);
+
+    FILE *f = fopen(traceFilename, "w");
+    if (f == NULL) {
+        log_error("Failed to open trace file %s for writing: %s", traceFilename, strerror(errno));
+    } else {
+        size_t written = 0;
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (int t = 0; t < threads; t++) {
+            TraceBuffer_t *buffer = buffers[t];
+            if (buffer == NULL) {
+                continue;
+            }
+            // name the thread in the viewer; the first thread to record is the main thread
+            fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                       "\"args\": {\"name\": \"%s %d\"}}", written++ > 0 ? ",\n" : "", t,
+                    t == 0 ? "main" : "worker", t);
+            for (size_t i = 0; i < buffer->count; i++) {
+                TraceEvent_t *event = &buffer->events[i];
+                fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, "
+                           "\"tid\": %d}", event->name, event->phase, event->timestamp, t);
+            }
+            if (buffer->dropped > 0) {
+                log_warn("Trace buffer for thread %d overflowed, dropped %zu events", t,
+                         buffer->dropped);
+            }
+        }
+        fprintf(f, "\n]}\n");
+        fclose(f);
+        log_info("Wrote trace of %d thread(s) to %s", threads, traceFilename);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (buffers[t] != NULL) {
+            free(buffers[t]->events);
+            free(buffers[t]);
+            buffers[t] = NULL;
+        }
+    }
+    free(traceFilename);
+    traceFilename = NULL;
+}
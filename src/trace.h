@@ -0,0 +1,42 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+#pragma once
+#include <stdbool.h>
+
+// Event tracer that writes Chrome Trace Event format JSON, viewable in chrome://tracing or
+// https://ui.perfetto.dev. Each thread records into its own buffer, so recording never takes a
+// lock; the buffers are merged and written to disk by traceDestroy().
+
+/// True if tracing is enabled. Use traceBegin() and traceEnd() rather than checking this directly.
+extern bool traceActive;
+
+/**
+ * Enables tracing. Events recorded from now on will be written to the given file by traceDestroy().
+ * @param filename path of the JSON file to write
+ */
+void traceInit(const char *filename);
+
+/// Records an event in the calling thread's buffer. Use traceBegin() and traceEnd() instead.
+void traceRecord(const char *name, char phase);
+
+/// Marks the beginning of a span on the calling thread. The name must be a string literal (or
+/// otherwise live until traceDestroy()).
+static inline void traceBegin(const char *name) {
+    if (traceActive) {
+        traceRecord(name, 'B');
+    }
+}
+
+/// Marks the end of the span most recently begun on the calling thread
+static inline void traceEnd(const char *name) {
+    if (traceActive) {
+        traceRecord(name, 'E');
+    }
+}
+
+/// Writes all recorded events to the trace file and frees the buffers. Does nothing if tracing
+/// is not enabled.
+void traceDestroy(void);
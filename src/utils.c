@@ -4,8 +4,14 @@
 // If a copy of the MPL was not distributed with this file, You can obtain one at
 // http://mozilla.org/MPL/2.0/.
 #include "utils.h"
+#include <time.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-void utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut) {
+bool utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut) {
     char *copy = strdup(size);
     if (strchr(copy, 'x') == NULL) {
         // no x character found, so strtok would fail
@@ -13,6 +19,9 @@ void utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut) {
     }
     char *widthStr = strtok(copy, "x");
     char *heightStr = strtok(NULL, "x");
+    if (widthStr == NULL || heightStr == NULL) {
+        goto die;
+    }
 
     char *endptr = NULL;
     *widthOut = strtol(widthStr, &endptr, 10);
@@ -28,14 +37,61 @@ void utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut) {
 
     // return here, so we don't jump into our goto accidentally (also free-ing copy to avoid memory leak)
     free(copy);
-    return;
+    return true;
 
     die:
-    fprintf(stderr, "Invalid size string %s", size);
+    fprintf(stderr, "Invalid size string %s\n", size);
     free(copy);
-    exit(1);
+    return false;
 }
 
 bool utilsStartsWith(const char *prefix, const char *str) {
     return strncmp(prefix, str, strlen(prefix)) == 0;
+}
+
+bool utilsEndsWith(const char *suffix, const char *str) {
+    size_t suffixLen = strlen(suffix);
+    size_t strLen = strlen(str);
+    return strLen >= suffixLen && strcasecmp(str + strLen - suffixLen, suffix) == 0;
+}
+
+double utilsGetTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+const char *utilsMapFile(const char *filename, size_t *sizeOut) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    *sizeOut = (size_t) st.st_size;
+    if (st.st_size == 0) {
+        // mmap doesn't allow empty mappings
+        close(fd);
+        return "";
+    }
+    void *data = mmap(NULL, *sizeOut, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive, so we can close it straight away
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    // advice values aren't flags, so each needs its own call: read ahead aggressively, and start
+    // reading now
+    madvise(data, *sizeOut, MADV_SEQUENTIAL);
+    madvise(data, *sizeOut, MADV_WILLNEED);
+    return data;
+}
+
+void utilsUnmapFile(const char *data, size_t size) {
+    if (size > 0) {
+        munmap((void *) data, size);
+    }
 }
\ No newline at end of file
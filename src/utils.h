@@ -20,8 +20,9 @@
  * @param size size string (not modified)
  * @param widthOut pointer to store width component in
  * @param heightOut pointer to store height component in
+ * @return true on success, false (after printing why to stderr) if the string isn't a valid size
  */
-void utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut);
+bool utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut);
 
 /**
  * Determines if a line starts with the given substring.
@@ -31,4 +32,27 @@ void utilsParseSize(const char *size, uint32_t *widthOut, uint32_t *heightOut);
  * @param str the line
  * @return true if it starts with this, else false
  */
-bool utilsStartsWith(const char *prefix, const char *str);
\ No newline at end of file
+bool utilsStartsWith(const char *prefix, const char *str);
+
+/**
+ * Determines if a string ends with the given suffix, ignoring case (e.g. for file extensions).
+ * @param suffix string to determine if the string ends with
+ * @param str the string
+ * @return true if it ends with this, else false
+ */
+bool utilsEndsWith(const char *suffix, const char *str);
+
+/// Returns a high resolution monotonic time in SECONDS
+double utilsGetTime(void);
+
+/**
+ * Maps a whole file into memory, read only, with sequential access advice.
+ * @param filename path to the file
+ * @param sizeOut where to store the size of the file in bytes
+ * @return the contents of the file (not null terminated), or NULL on error with errno set. Must be
+ * released with utilsUnmapFile().
+ */
+const char *utilsMapFile(const char *filename, size_t *sizeOut);
+
+/// Releases a file mapped with utilsMapFile()
+void utilsUnmapFile(const char *data, size_t size);
\ No newline at end of file
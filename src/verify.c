@@ -0,0 +1,867 @@
+// Copyright (c) 2022 Matt Young. All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+
+// Differential correctness harness: runs every kernel at several thread counts and in every
+// topology in lockstep with the reference kernel, on random soups (with several rules) and the
+// bundled patterns, and compares the grids after every generation. The bit-sliced engine is checked
+// the same way, with each of its universes running a different soup and rule, against a
+// straightforward update of that universe on its own. Rule parsing is checked first, since the
+// reference kernel relies on it for isotropic rules. Pattern and snapshot I/O is checked at the
+// end: the parallel RLE decoder against the single-threaded one, export and import round trips,
+// compressed input, and snapshots. Exits with status 1 and reports the first divergent cell on
+// mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <omp.h>
+#include <zlib.h>
+#include "life.h"
+#include "slice.h"
+#include "defines.h"
+#include "utils.h"
+#include "log.h"
+#include "argtable3.h"
+
+#ifndef GOL_PATTERNS_DIR
+#define GOL_PATTERNS_DIR "data/patterns"
+#endif
+
+/// Thread counts every kernel is checked with. Odd counts catch uneven splits of the rows.
+static const int threadCounts[] = {1, 2, 3, 4, 7, 8};
+#define NUM_THREAD_COUNTS (sizeof(threadCounts) / sizeof(threadCounts[0]))
+
+/// Soup grid sizes, including degenerate ones and ones that don't divide evenly between threads
+static const uint32_t soupSizes[][2] = {{1, 1}, {1, 17}, {17, 1}, {2, 2}, {3, 3}, {7, 5},
+                                        {31, 33}, {64, 64}, {65, 63}, {127, 129}, {200, 100}};
+#define NUM_SOUP_SIZES (sizeof(soupSizes) / sizeof(soupSizes[0]))
+
+/// Rules the kernels are checked with: the ones with specialised kernels, then some that run on the
+/// generic kernel, then isotropic non-totalistic ones, then Generations ones (with a power of two
+/// number of states and otherwise). Universe k of the bit-sliced engine runs rule
+/// k % NUM_TOTALISTIC_RULES, since it can only run two-state outer totalistic rules.
+static const char *const rules[] = {"B3/S23", "B36/S23", "B2/S", "B3678/S34678", "B1357/S1357",
+                                    "B0/S8", "B2-a/S12", "B3/S2-i34q",
+                                    "B2ce3aiy4ei/S1e2ak3jnr4wz5c", "/2/3", "345/2/4",
+                                    "B2/S345/C20"};
+#define NUM_RULES (sizeof(rules) / sizeof(rules[0]))
+#define NUM_TOTALISTIC_RULES 6
+
+/// Hensel notation letters for each neighbour count
+static const char *const henselLetters[9] = {"", "ce", "aceikn", "aceijknqry", "aceijknqrtwyz",
+                                              "aceijknqry", "aceikn", "ce", ""};
+
+/// A bundled pattern and a grid size that holds it
+typedef struct {
+    const char *file;
+    uint32_t width, height;
+} VerifyPattern_t;
+
+static const VerifyPattern_t patterns[] = {
+    {"gosperglidergun.rle", 64, 48},
+    {"gosperglidergun.txt", 40, 12},
+    {"4812diamond.txt", 16, 12},
+    {"breeder1.txt", 800, 400},
+    {"turingmachine.rle", 1800, 1700},
+};
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+/// Size of the body of the RLE file the parallel decoder is checked with. It's over the 1 MiB the
+/// decoder needs, and a multiple of 168 (the lowest common multiple of the thread counts) so chunk
+/// edges for different thread counts that coincide really are in the same place.
+#define CHUNK_EDGE_RLE_BYTES (168 * 12288)
+
+/// Rules snapshots are checked with, including Generations ones so the dying states are saved
+static const char *const snapshotRules[] = {"B3/S23", "B2-a/S12", "/2/3", "345/2/4",
+                                            "B2/S345/C20"};
+#define NUM_SNAPSHOT_RULES (sizeof(snapshotRules) / sizeof(snapshotRules[0]))
+
+/// Input to one comparison run
+typedef struct {
+    /// Description of the input, for error messages
+    char name[256];
+    uint32_t width, height;
+    /// Initial state of the grid
+    bool *cells;
+} VerifyInput_t;
+
+/// xorshift64* PRNG, good enough for generating soups
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Advances the world running the kernel under test and the world running the reference kernel by
+ * one generation each, and compares the results. Both start from the same state, so the worlds
+ * stay in lockstep as long as they match.
+ * @return true if the results are identical
+ */
+static bool stepAndCompare(const VerifyInput_t *input, LifeWorld_t *world, LifeWorld_t *reference,
+                           int threads, uint32_t generation) {
+    uint32_t width = input->width, height = input->height;
+    size_t size = (size_t) width * height;
+    lifeWorldUpdate(reference);
+    lifeWorldUpdate(world);
+    const bool *expected = lifeWorldGetGrid(reference);
+    const bool *actual = lifeWorldGetGrid(world);
+    LifeRule_t rule = lifeWorldGetRule(world);
+
+    for (size_t i = 0; i < size; i++) {
+        if (actual[i] != expected[i]) {
+            char ruleName[LIFE_MAX_RULE_STRING];
+            lifeFormatRule(&rule, ruleName);
+            log_error("MISMATCH: kernel %s with %d threads on %s (%ux%u, %s, %s), generation %u "
+                      "-> %u: first divergent cell is (%zu,%zu), expected %s but got %s",
+                      lifeGetKernelName(lifeWorldGetKernel(world)), threads, input->name, width,
+                      height, lifeGetTopologyName(lifeWorldGetTopology(world)), ruleName,
+                      generation, generation + 1, i % width, i / width,
+                      expected[i] ? "alive" : "dead", actual[i] ? "alive" : "dead");
+            return false;
+        }
+    }
+
+    // the dying states of Generations rules too
+    bool same = true;
+    uint8_t *expectedStates = malloc(width), *actualStates = malloc(width);
+    for (uint32_t y = 0; y < height && rule.dyingStates > 0 && same; y++) {
+        lifeWorldGetStates(reference, y, expectedStates);
+        lifeWorldGetStates(world, y, actualStates);
+        for (uint32_t x = 0; x < width && same; x++) {
+            if (actualStates[x] != expectedStates[x]) {
+                char ruleName[LIFE_MAX_RULE_STRING];
+                lifeFormatRule(&rule, ruleName);
+                log_error("MISMATCH: kernel %s with %d threads on %s (%ux%u, %s, %s), "
+                          "generation %u -> %u: first divergent cell is (%u,%u), expected state "
+                          "%u but got %u", lifeGetKernelName(lifeWorldGetKernel(world)), threads,
+                          input->name, width, height,
+                          lifeGetTopologyName(lifeWorldGetTopology(world)), ruleName, generation,
+                          generation + 1, x, y, expectedStates[x], actualStates[x]);
+                same = false;
+            }
+        }
+    }
+    free(expectedStates);
+    free(actualStates);
+    return same;
+}
+
+/// Creates a world holding the input, running the given kernel, topology and rule
+static LifeWorld_t *createWorld(const VerifyInput_t *input, LifeKernel_t kernel,
+                                LifeTopology_t topology, const LifeRule_t *rule) {
+    LifeWorld_t *world = lifeWorldCreate(input->width, input->height);
+    lifeWorldSetKernel(world, kernel);
+    lifeWorldSetTopology(world, topology);
+    lifeWorldSetRule(world, rule);
+    lifeWorldSetGrid(world, input->cells);
+    return world;
+}
+
+/**
+ * Checks every kernel, thread count and topology against the reference kernel on one input, with
+ * each of the first numRules rules.
+ * @return number of failed configurations
+ */
+static int verifyInput(const VerifyInput_t *input, uint32_t generations, size_t numRules) {
+    int failures = 0;
+    for (size_t r = 0; r < numRules; r++) {
+        LifeRule_t rule;
+        lifeParseRule(rules[r], &rule);
+        for (LifeTopology_t topology = 0; topology < LIFE_TOPOLOGY_COUNT; topology++) {
+            for (LifeKernel_t kernel = 0; kernel < LIFE_KERNEL_COUNT; kernel++) {
+                if (kernel == LIFE_KERNEL_REFERENCE) {
+                    continue;
+                }
+                for (size_t t = 0; t < NUM_THREAD_COUNTS; t++) {
+                    omp_set_num_threads(threadCounts[t]);
+                    LifeWorld_t *world = createWorld(input, kernel, topology, &rule);
+                    LifeWorld_t *reference = createWorld(input, LIFE_KERNEL_REFERENCE, topology,
+                                                         &rule);
+                    for (uint32_t gen = 0; gen < generations; gen++) {
+                        if (!stepAndCompare(input, world, reference, threadCounts[t], gen)) {
+                            failures++;
+                            break;
+                        }
+                    }
+                    lifeWorldDestroy(world);
+                    lifeWorldDestroy(reference);
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+/// Works out whether a cell with the given 3x3 neighbourhood is alive next generation under any
+/// rule. Bit 3 * (2 - c) + r of the neighbourhood is the cell in column c and row r.
+static bool ruleAlive(const LifeRule_t *rule, uint32_t neighbourhood) {
+    if (rule->isotropic) {
+        return (rule->table[neighbourhood / 64] >> (neighbourhood % 64)) & 1;
+    }
+    uint32_t neighbours = __builtin_popcount(neighbourhood & ~(1u << 4));
+    uint16_t counts = neighbourhood & (1u << 4) ? rule->survival : rule->birth;
+    return (counts >> neighbours) & 1;
+}
+
+/// Rotates a neighbourhood by a quarter turn, or reflects it left to right
+static uint32_t transformNeighbourhood(uint32_t neighbourhood, bool reflect) {
+    uint32_t result = 0;
+    for (uint32_t c = 0; c < 3; c++) {
+        for (uint32_t r = 0; r < 3; r++) {
+            uint32_t toC = reflect ? 2 - c : 2 - r, toR = reflect ? r : c;
+            result |= ((neighbourhood >> (3 * (2 - c) + r)) & 1) << (3 * (2 - toC) + toR);
+        }
+    }
+    return result;
+}
+
+/// Parses a rule the harness relies on, logging it if it doesn't parse
+static bool parseRule(const char *string, LifeRule_t *rule) {
+    if (!lifeParseRule(string, rule)) {
+        log_error("MISMATCH: rule %s doesn't parse", string);
+        return false;
+    }
+    return true;
+}
+
+/// Checks two rules do the same thing for every neighbourhood
+static bool compareRules(const char *name, const LifeRule_t *a, const char *otherName,
+                         const LifeRule_t *b) {
+    if (a->dyingStates != b->dyingStates) {
+        log_error("MISMATCH: rules %s and %s have different numbers of states", name, otherName);
+        return false;
+    }
+    for (uint32_t n = 0; n < 512; n++) {
+        if (ruleAlive(a, n) != ruleAlive(b, n)) {
+            log_error("MISMATCH: rules %s and %s differ for neighbourhood %03x", name, otherName,
+                      n);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Checks rule parsing and formatting, independently of the kernels: the Hensel letters of each
+ * neighbour count pick out disjoint sets of neighbourhoods that together make up that count, every
+ * isotropic rule is the same under rotation and reflection, formatting a rule and parsing it again
+ * gives the same rule, and a totalistic rule written out letter by letter is stored as totalistic.
+ * @return number of failed checks
+ */
+static int verifyRules(void) {
+    int failures = 0;
+    for (uint32_t count = 0; count <= 8; count++) {
+        char string[16];
+        LifeRule_t whole, letter;
+        snprintf(string, sizeof(string), "B%u/S", count);
+        if (!parseRule(string, &whole)) {
+            failures++;
+            continue;
+        }
+        uint64_t seen[8] = {0};
+        size_t numLetters = strlen(henselLetters[count]);
+        for (size_t i = 0; i < numLetters; i++) {
+            snprintf(string, sizeof(string), "B%u%c/S", count, henselLetters[count][i]);
+            if (!parseRule(string, &letter)) {
+                failures++;
+                continue;
+            }
+            for (uint32_t n = 0; n < 512; n++) {
+                if (ruleAlive(&letter, n) && (seen[n / 64] >> (n % 64)) & 1) {
+                    log_error("MISMATCH: neighbourhood %03x has more than one letter for %u", n,
+                              count);
+                    failures++;
+                }
+                seen[n / 64] |= (uint64_t) ruleAlive(&letter, n) << (n % 64);
+            }
+        }
+        for (uint32_t n = 0; numLetters > 0 && n < 512; n++) {
+            if (((seen[n / 64] >> (n % 64)) & 1) != ruleAlive(&whole, n)) {
+                log_error("MISMATCH: the letters for %u don't make up neighbourhood %03x", count,
+                          n);
+                failures++;
+            }
+        }
+    }
+
+    for (size_t r = 0; r < NUM_RULES; r++) {
+        LifeRule_t rule, again;
+        char formatted[LIFE_MAX_RULE_STRING];
+        if (!parseRule(rules[r], &rule)) {
+            failures++;
+            continue;
+        }
+        lifeFormatRule(&rule, formatted);
+        if (!parseRule(formatted, &again) || !compareRules(rules[r], &rule, formatted, &again)) {
+            failures++;
+        }
+        for (uint32_t n = 0; n < 512; n++) {
+            if (ruleAlive(&rule, n) != ruleAlive(&rule, transformNeighbourhood(n, false))
+                || ruleAlive(&rule, n) != ruleAlive(&rule, transformNeighbourhood(n, true))) {
+                log_error("MISMATCH: rule %s isn't isotropic for neighbourhood %03x", rules[r], n);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    LifeRule_t life, lettered;
+    const char *letteredLife = "B3aceijknqry/S2aceikn3aceijknqry";
+    if (!parseRule(LIFE_RULE, &life) || !parseRule(letteredLife, &lettered)) {
+        failures++;
+    } else if (lettered.isotropic || !compareRules(LIFE_RULE, &life, letteredLife, &lettered)) {
+        log_error("MISMATCH: %s isn't stored as %s", letteredLife, LIFE_RULE);
+        failures++;
+    }
+    return failures;
+}
+
+/// Straightforward update of one universe with any outer totalistic rule, which the bit-sliced
+/// engine is checked against
+static void stepRule(const bool *cells, bool *next, uint32_t width, uint32_t height,
+                     LifeTopology_t topology, const LifeRule_t *rule) {
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t neighbours = 0;
+            for (int64_t dy = -1; dy <= 1; dy++) {
+                for (int64_t dx = -1; dx <= 1; dx++) {
+                    int64_t nx = x + dx, ny = y + dy;
+                    if (dx == 0 && dy == 0) {
+                        continue;
+                    } else if (topology == LIFE_TOPOLOGY_TORUS) {
+                        nx = (nx + width) % width;
+                        ny = (ny + height) % height;
+                    } else if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                        continue;
+                    }
+                    neighbours += cells[(size_t) width * ny + nx];
+                }
+            }
+            uint16_t counts = cells[(size_t) width * y + x] ? rule->survival : rule->birth;
+            next[(size_t) width * y + x] = (counts >> neighbours) & 1;
+        }
+    }
+}
+
+/**
+ * Checks the bit-sliced engine at every thread count and in every topology, on SLICE_UNIVERSES
+ * random soups of one size, each universe running one of the rules.
+ * @return number of failed configurations
+ */
+static int verifySliced(uint32_t width, uint32_t height, uint32_t generations,
+                        uint64_t *rngState) {
+    size_t size = (size_t) width * height;
+    // every universe's expected state at every generation, worked out once per topology
+    bool *expected = malloc((generations + 1) * SLICE_UNIVERSES * size * sizeof(bool));
+    bool *actual = malloc(size * sizeof(bool));
+    LifeRule_t universeRules[SLICE_UNIVERSES];
+    for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+        lifeParseRule(rules[u % NUM_TOTALISTIC_RULES], &universeRules[u]);
+    }
+    int failures = 0;
+
+    for (LifeTopology_t topology = 0; topology < LIFE_TOPOLOGY_COUNT; topology++) {
+        for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+            uint32_t density = 10 + (uint32_t) (nextRandom(rngState) % 81);
+            for (size_t i = 0; i < size; i++) {
+                expected[u * size + i] = nextRandom(rngState) % 100 < density;
+            }
+        }
+        for (uint32_t gen = 0; gen < generations; gen++) {
+            for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+                stepRule(&expected[(gen * SLICE_UNIVERSES + u) * size],
+                         &expected[((gen + 1) * SLICE_UNIVERSES + u) * size], width, height,
+                         topology, &universeRules[u]);
+            }
+        }
+
+        for (size_t t = 0; t < NUM_THREAD_COUNTS; t++) {
+            omp_set_num_threads(threadCounts[t]);
+            SliceWorld_t world;
+            sliceInit(&world, width, height, topology);
+            for (uint32_t u = 0; u < SLICE_UNIVERSES; u++) {
+                sliceSetRule(&world, u, &universeRules[u]);
+                sliceLoad(&world, u, &expected[u * size]);
+            }
+            bool ok = true;
+            for (uint32_t gen = 1; gen <= generations && ok; gen++) {
+                sliceUpdate(&world, 1);
+                uint32_t populations[SLICE_UNIVERSES];
+                slicePopulations(&world, populations);
+                for (uint32_t u = 0; u < SLICE_UNIVERSES && ok; u++) {
+                    const bool *want = &expected[((size_t) gen * SLICE_UNIVERSES + u) * size];
+                    sliceExtract(&world, u, actual);
+                    uint32_t population = 0;
+                    for (size_t i = 0; i < size && ok; i++) {
+                        population += want[i];
+                        if (actual[i] != want[i]) {
+                            log_error("MISMATCH: bit-sliced engine with %d threads, universe %u "
+                                      "(%s) of %ux%u soups (%s), generation %u -> %u: first "
+                                      "divergent cell is (%zu,%zu), expected %s but got %s",
+                                      threadCounts[t], u, rules[u % NUM_TOTALISTIC_RULES], width,
+                                      height, lifeGetTopologyName(topology), gen - 1, gen,
+                                      i % width, i / width, want[i] ? "alive" : "dead",
+                                      actual[i] ? "alive" : "dead");
+                            ok = false;
+                        }
+                    }
+                    if (ok && population != populations[u]) {
+                        log_error("MISMATCH: bit-sliced engine with %d threads, universe %u of "
+                                  "%ux%u soups (%s), generation %u: population should be %u, "
+                                  "but slicePopulations() says %u", threadCounts[t], u, width,
+                                  height, lifeGetTopologyName(topology), gen, population,
+                                  populations[u]);
+                        ok = false;
+                    }
+                }
+            }
+            failures += !ok;
+            sliceDestroy(&world);
+        }
+    }
+
+    free(expected);
+    free(actual);
+    return failures;
+}
+
+/**
+ * Checks two worlds hold the same cells, including the dying states of Generations rules.
+ * @param what description of the check, for error messages
+ * @return true if they match
+ */
+static bool compareWorlds(const char *what, const LifeWorld_t *expected,
+                          const LifeWorld_t *actual) {
+    uint32_t width = lifeWorldGetWidth(expected), height = lifeWorldGetHeight(expected);
+    uint8_t *want = malloc(MAX(width, 1)), *got = malloc(MAX(width, 1));
+    bool same = true;
+    for (uint32_t y = 0; y < height && same; y++) {
+        lifeWorldGetStates(expected, y, want);
+        lifeWorldGetStates(actual, y, got);
+        for (uint32_t x = 0; x < width && same; x++) {
+            if (want[x] != got[x]) {
+                log_error("MISMATCH: %s: first divergent cell is (%u,%u), expected state %u but "
+                          "got %u", what, x, y, want[x], got[x]);
+                same = false;
+            }
+        }
+    }
+    free(want);
+    free(got);
+    return same;
+}
+
+/// Finds the top left corner of the bounding box of the cells that aren't dead, which is where
+/// exported patterns have to be inserted to line up with the world they came from
+static void findTopLeft(const LifeWorld_t *world, uint32_t *minX, uint32_t *minY) {
+    uint32_t width = lifeWorldGetWidth(world), height = lifeWorldGetHeight(world);
+    uint8_t *states = malloc(MAX(width, 1));
+    *minX = width;
+    *minY = height;
+    for (uint32_t y = 0; y < height; y++) {
+        lifeWorldGetStates(world, y, states);
+        for (uint32_t x = 0; x < width; x++) {
+            if (states[x] != 0) {
+                *minX = MIN(*minX, x);
+                *minY = MIN(*minY, y);
+            }
+        }
+    }
+    free(states);
+}
+
+/// Compresses a file with gzip, writing it to the same path with ".gz" on the end
+static bool gzipFile(const char *path) {
+    char gzPath[4096];
+    snprintf(gzPath, sizeof(gzPath), "%s.gz", path);
+    FILE *in = fopen(path, "rb");
+    gzFile out = gzopen(gzPath, "wb");
+    bool ok = in != NULL && out != NULL;
+    char buf[65536];
+    size_t size;
+    while (ok && (size = fread(buf, 1, sizeof(buf), in)) > 0) {
+        ok = gzwrite(out, buf, (unsigned) size) == (int) size;
+    }
+    ok = ok && !ferror(in);
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL) {
+        ok = gzclose(out) == Z_OK && ok;
+    }
+    if (!ok) {
+        log_error("Failed to compress %s", path);
+    }
+    return ok;
+}
+
+/**
+ * Exports the world in each pattern format, compresses each file with gzip, then imports both the
+ * plain and the compressed file into a new world and checks they match the original.
+ * @param dir scratch directory to write the files to
+ * @return number of failed round trips
+ */
+static int verifyRoundTrips(const LifeWorld_t *world, const char *name, const char *dir) {
+    static const char *const extensions[] = {"rle", "txt", "mc"};
+    uint32_t width = lifeWorldGetWidth(world), height = lifeWorldGetHeight(world);
+    LifeRule_t rule = lifeWorldGetRule(world);
+    // only RLE has multi-state tags, so Generations rules' dying cells don't survive the others
+    size_t numExtensions = rule.dyingStates > 0 ? 1 : sizeof(extensions) / sizeof(extensions[0]);
+    uint32_t minX, minY;
+    findTopLeft(world, &minX, &minY);
+    int failures = 0;
+    for (size_t e = 0; e < numExtensions; e++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/roundtrip.%s", dir, extensions[e]);
+        if (!lifeWorldExportPattern(world, path) || !gzipFile(path)) {
+            log_error("MISMATCH: failed to export %s as %s", name, path);
+            failures++;
+            continue;
+        }
+        for (int compressed = 0; compressed <= 1; compressed++) {
+            char file[4096], what[4096 + 256];
+            snprintf(file, sizeof(file), "%s%s", path, compressed ? ".gz" : "");
+            snprintf(what, sizeof(what), "%s exported and imported as %s", name, file);
+            LifeWorld_t *copy = lifeWorldCreate(width, height);
+            lifeWorldSetRule(copy, &rule);
+            if (!lifeWorldInsertPattern(copy, file, minX, minY)) {
+                log_error("MISMATCH: failed to import %s", what);
+                failures++;
+            } else if (!compareWorlds(what, world, copy)) {
+                failures++;
+            }
+            lifeWorldDestroy(copy);
+            unlink(file);
+        }
+    }
+    return failures;
+}
+
+static int compareSize(const void *a, const void *b) {
+    size_t x = *(const size_t *) a, y = *(const size_t *) b;
+    return (x > y) - (x < y);
+}
+
+/// Appends a formatted RLE item to the body being built by writeChunkEdgeRLE()
+static size_t appendItem(char *body, size_t pos, uint64_t count, char tag) {
+    return pos + (count == 1 ? (size_t) sprintf(&body[pos], "%c", tag)
+                             : (size_t) sprintf(&body[pos], "%lu%c", count, tag));
+}
+
+/**
+ * Writes a Life RLE file for checking the parallel decoder: random runs of live and dead cells,
+ * with multi-row "N$" tags where the body is split into chunks for each thread count. Depending on
+ * the edge, the split falls just before the tag, inside its run length or just before its "$".
+ * The body is exactly CHUNK_EDGE_RLE_BYTES long, padded with newlines (which the decoder skips) so
+ * the tags land in the right places.
+ * @return height of the pattern, or 0 if the file couldn't be written
+ */
+static uint32_t writeChunkEdgeRLE(const char *path, uint32_t width, uint64_t *rngState) {
+    // no thread count is over 8, so none has more than 7 edges
+    size_t edges[NUM_THREAD_COUNTS * 7];
+    size_t numEdges = 0;
+    for (size_t t = 0; t < NUM_THREAD_COUNTS; t++) {
+        assert(threadCounts[t] <= 8);
+        for (int i = 1; i < threadCounts[t]; i++) {
+            edges[numEdges++] = CHUNK_EDGE_RLE_BYTES / threadCounts[t] * i;
+        }
+    }
+    qsort(edges, numEdges, sizeof(size_t), compareSize);
+
+    char *body = malloc(CHUNK_EDGE_RLE_BYTES + 1);
+    size_t pos = 0, edge = 0;
+    uint64_t x = 0, y = 0;
+    while (pos + 32 < CHUNK_EDGE_RLE_BYTES) {
+        while (edge < numEdges && edges[edge] < pos + 8) {
+            edge++;
+        }
+        uint64_t r = nextRandom(rngState);
+        if (edge < numEdges && edges[edge] < pos + 16) {
+            // "$NN$", with the edge after the first "$", or before the second or last character
+            // of the multi-row tag
+            size_t start = edges[edge] - 1 - edge % 3;
+            memset(&body[pos], '\n', start - pos);
+            uint64_t rows = 10 + r % 90;
+            pos = appendItem(body, appendItem(body, start, 1, '$'), rows, '$');
+            x = 0;
+            y += 1 + rows;
+            edge++;
+        } else if (r % 16 == 0) {
+            uint64_t rows = 1 + (r >> 8) % 5;
+            pos = appendItem(body, pos, rows, '$');
+            x = 0;
+            y += rows;
+        } else {
+            uint64_t run = 1 + (r >> 8) % 20;
+            if (x + run > width) {
+                pos = appendItem(body, pos, 1, '$');
+                x = 0;
+                y++;
+            } else {
+                pos = appendItem(body, pos, run, (r >> 16) & 1 ? 'o' : 'b');
+                x += run;
+            }
+        }
+    }
+    memset(&body[pos], '\n', CHUNK_EDGE_RLE_BYTES - 2 - pos);
+    memcpy(&body[CHUNK_EDGE_RLE_BYTES - 2], "!\n", 2);
+
+    uint32_t height = (uint32_t) y + 1;
+    FILE *file = fopen(path, "w");
+    bool ok = file != NULL;
+    if (ok) {
+        fprintf(file, "x = %u, y = %u, rule = B3/S23\n", width, height);
+        ok = fwrite(body, 1, CHUNK_EDGE_RLE_BYTES, file) == CHUNK_EDGE_RLE_BYTES;
+        ok = fclose(file) == 0 && ok;
+    }
+    free(body);
+    if (!ok) {
+        log_error("Failed to write %s", path);
+        return 0;
+    }
+    return height;
+}
+
+/**
+ * Checks the parallel RLE decoder at every thread count against the single-threaded decoder, on a
+ * file with multi-row "N$" tags at the chunk edges.
+ * @param dir scratch directory to write the file to
+ * @return number of failed thread counts
+ */
+static int verifyParallelRLE(const char *dir, uint64_t *rngState) {
+    const uint32_t width = 256;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/chunkedges.rle", dir);
+    uint32_t height = writeChunkEdgeRLE(path, width, rngState);
+    if (height == 0) {
+        return 1;
+    }
+    omp_set_num_threads(1);
+    LifeWorld_t *expected = lifeWorldCreate(width, height);
+    int failures = 0;
+    if (!lifeWorldInsertPattern(expected, path, 0, 0)) {
+        log_error("MISMATCH: the single-threaded RLE decoder failed to load %s", path);
+        failures++;
+    }
+    for (size_t t = 0; failures == 0 && t < NUM_THREAD_COUNTS; t++) {
+        if (threadCounts[t] == 1) {
+            continue;
+        }
+        omp_set_num_threads(threadCounts[t]);
+        char what[4096 + 64];
+        snprintf(what, sizeof(what), "RLE decoder with %d threads on %s", threadCounts[t], path);
+        LifeWorld_t *actual = lifeWorldCreate(width, height);
+        if (!lifeWorldInsertPattern(actual, path, 0, 0)) {
+            log_error("MISMATCH: %s failed to load it", what);
+            failures++;
+        } else if (!compareWorlds(what, expected, actual)) {
+            failures++;
+        }
+        lifeWorldDestroy(actual);
+    }
+    lifeWorldDestroy(expected);
+    unlink(path);
+    return failures;
+}
+
+/**
+ * Checks saving a snapshot and loading it into a new world restores the cells (including the dying
+ * states of Generations rules), generation count, topology and rule, for each of snapshotRules.
+ * @param dir scratch directory to write the snapshots to
+ * @return number of failed rules
+ */
+static int verifySnapshots(const char *dir, uint64_t *rngState) {
+    const uint32_t width = 97, height = 61;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/snapshot.gol", dir);
+    int failures = 0;
+    for (size_t r = 0; r < NUM_SNAPSHOT_RULES; r++) {
+        LifeRule_t rule;
+        lifeParseRule(snapshotRules[r], &rule);
+        LifeWorld_t *world = lifeWorldCreate(width, height);
+        lifeWorldSetRule(world, &rule);
+        lifeWorldSetTopology(world, (LifeTopology_t) (r % LIFE_TOPOLOGY_COUNT));
+        lifeWorldInsertSoup(world, 0, 0, width, height, 0.4, nextRandom(rngState));
+        // some dying cells have to be left over for the states to be checked
+        lifeWorldUpdateMulti(world, 5);
+
+        char what[4096 + 64];
+        snprintf(what, sizeof(what), "snapshot %s of a %s soup", path, snapshotRules[r]);
+        LifeWorld_t *loaded = lifeWorldCreate(width, height);
+        if (!lifeWorldSaveSnapshot(world, path) || !lifeWorldLoadSnapshot(loaded, path)) {
+            log_error("MISMATCH: failed to save and load %s", what);
+            failures++;
+        } else if (!compareWorlds(what, world, loaded)) {
+            failures++;
+        } else {
+            LifeRule_t loadedRule = lifeWorldGetRule(loaded);
+            char ruleName[LIFE_MAX_RULE_STRING], loadedRuleName[LIFE_MAX_RULE_STRING];
+            lifeFormatRule(&rule, ruleName);
+            lifeFormatRule(&loadedRule, loadedRuleName);
+            if (lifeWorldGetGenerations(loaded) != lifeWorldGetGenerations(world)
+                || lifeWorldGetTopology(loaded) != lifeWorldGetTopology(world)
+                || strcmp(ruleName, loadedRuleName) != 0) {
+                log_error("MISMATCH: %s restored generation %lu, %s, %s instead of generation "
+                          "%lu, %s, %s", what, lifeWorldGetGenerations(loaded),
+                          lifeGetTopologyName(lifeWorldGetTopology(loaded)), loadedRuleName,
+                          lifeWorldGetGenerations(world),
+                          lifeGetTopologyName(lifeWorldGetTopology(world)), ruleName);
+                failures++;
+            }
+        }
+        lifeWorldDestroy(world);
+        lifeWorldDestroy(loaded);
+        unlink(path);
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    struct arg_lit *argHelp = arg_lit0(NULL, "help", "Display help and exit.");
+    struct arg_int *argGens = arg_int0(NULL, "generations", "int",
+            "Generations to compare per configuration. Defaults to 32.");
+    struct arg_int *argPatternGens = arg_int0(NULL, "pattern-generations", "int",
+            "Generations to compare per configuration for the bundled patterns, which are much "
+            "bigger than the soups. Defaults to 8.");
+    struct arg_int *argSoups = arg_int0(NULL, "soups", "int",
+            "Random soups per grid size. Defaults to 4.");
+    struct arg_int *argSeed = arg_int0(NULL, "seed", "int", "Random soup seed. Defaults to 1.");
+    struct arg_lit *argNoPatterns = arg_lit0(NULL, "no-patterns",
+            "Only check random soups, not the bundled patterns.");
+    struct arg_end *argEnd = arg_end(20);
+
+    void *argtable[] = {argHelp, argGens, argPatternGens, argSoups, argSeed, argNoPatterns,
+                        argEnd};
+    assert(arg_nullcheck(argtable) == 0);
+    *argGens->ival = 32;
+    *argPatternGens->ival = 8;
+    *argSoups->ival = 4;
+    *argSeed->ival = 1;
+
+    int nerrors = arg_parse(argc, argv, argtable);
+    if (argHelp->count > 0) {
+        printf("Game of Life kernel verifier v" VERSION "\n");
+        printf("Usage: gol_verify");
+        arg_print_syntax(stdout, argtable, "\n");
+        arg_print_glossary(stdout, argtable, "  %-30s %s\n");
+        arg_free(argtable);
+        exit(0);
+    } else if (nerrors > 0) {
+        arg_print_errors(stderr, argEnd, "gol_verify");
+        arg_free(argtable);
+        exit(1);
+    }
+    uint32_t generations = *argGens->ival;
+    uint32_t patternGenerations = *argPatternGens->ival;
+    int soups = *argSoups->ival;
+    uint64_t rngState = (uint64_t) *argSeed->ival * 0x9E3779B97F4A7C15ULL + 1;
+    bool checkPatterns = argNoPatterns->count == 0;
+    arg_free(argtable);
+
+    // lifeWorldCreate is noisy, and we call it a lot
+    log_set_level(LOG_WARN);
+    int failures = verifyRules();
+    int inputs = 0;
+
+    // random soups of varying density
+    for (size_t s = 0; s < NUM_SOUP_SIZES; s++) {
+        for (int soup = 0; soup < soups; soup++) {
+            VerifyInput_t input = {.width = soupSizes[s][0], .height = soupSizes[s][1]};
+            size_t size = (size_t) input.width * input.height;
+            uint32_t density = 10 + (uint32_t) (nextRandom(&rngState) % 81);
+            snprintf(input.name, sizeof(input.name), "soup %d with %u%% density", soup, density);
+            input.cells = calloc(size, sizeof(bool));
+            for (size_t i = 0; i < size; i++) {
+                input.cells[i] = nextRandom(&rngState) % 100 < density;
+            }
+            failures += verifyInput(&input, generations, NUM_RULES);
+            inputs++;
+            free(input.cells);
+        }
+    }
+
+    // the bit-sliced engine, on the same grid sizes
+    for (size_t s = 0; s < NUM_SOUP_SIZES; s++) {
+        failures += verifySliced(soupSizes[s][0], soupSizes[s][1], generations, &rngState);
+        inputs++;
+    }
+
+    // bundled patterns
+    for (size_t p = 0; checkPatterns && p < NUM_PATTERNS; p++) {
+        VerifyInput_t input = {.width = patterns[p].width, .height = patterns[p].height};
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", GOL_PATTERNS_DIR, patterns[p].file);
+        snprintf(input.name, sizeof(input.name), "%s", patterns[p].file);
+
+        LifeWorld_t *world = lifeWorldCreate(input.width, input.height);
+        if (!lifeWorldInsertPattern(world, path, 0, 0)) {
+            log_error("Failed to load %s", path);
+            lifeWorldDestroy(world);
+            failures++;
+            continue;
+        }
+        size_t size = (size_t) input.width * input.height;
+        input.cells = malloc(size * sizeof(bool));
+        memcpy(input.cells, lifeWorldGetGrid(world), size * sizeof(bool));
+        lifeWorldDestroy(world);
+
+        // the patterns are all for Life, so they're only checked with it
+        failures += verifyInput(&input, patternGenerations, 1);
+        inputs++;
+        free(input.cells);
+    }
+
+    // pattern and snapshot I/O, in a scratch directory
+    const char *tmp = getenv("TMPDIR");
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/gol_verify.XXXXXX", tmp != NULL ? tmp : "/tmp");
+    if (mkdtemp(dir) == NULL) {
+        log_error("Failed to create a scratch directory in %s: %s", tmp != NULL ? tmp : "/tmp",
+                  strerror(errno));
+        return 1;
+    }
+    int ioChecks = 0;
+    failures += verifyParallelRLE(dir, &rngState);
+    ioChecks++;
+    LifeWorld_t *soup = lifeWorldCreate(200, 100);
+    lifeWorldInsertSoup(soup, 20, 10, 150, 70, 0.3, nextRandom(&rngState));
+    failures += verifyRoundTrips(soup, "soup", dir);
+    ioChecks++;
+    // a Generations soup with over 24 dying states, for the two letter multi-state tags
+    LifeRule_t generationsRule;
+    lifeParseRule("B2/S345/C40", &generationsRule);
+    lifeWorldSetRule(soup, &generationsRule);
+    lifeWorldUpdateMulti(soup, 30);
+    failures += verifyRoundTrips(soup, "Generations soup", dir);
+    ioChecks++;
+    lifeWorldDestroy(soup);
+    for (size_t p = 0; checkPatterns && p < NUM_PATTERNS; p++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", GOL_PATTERNS_DIR, patterns[p].file);
+        LifeWorld_t *world = lifeWorldCreate(patterns[p].width, patterns[p].height);
+        if (lifeWorldInsertPattern(world, path, 0, 0)) {
+            failures += verifyRoundTrips(world, patterns[p].file, dir);
+            ioChecks++;
+        }
+        lifeWorldDestroy(world);
+    }
+    failures += verifySnapshots(dir, &rngState);
+    ioChecks++;
+    rmdir(dir);
+
+    if (failures > 0) {
+        log_error("%d configuration(s) diverged from the reference kernel or failed a round trip",
+                  failures);
+        return 1;
+    }
+    printf("All kernels match the reference kernel on %d inputs, and %d pattern and snapshot I/O "
+           "checks pass\n", inputs, ioChecks);
+    return 0;
+}